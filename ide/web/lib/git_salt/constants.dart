@@ -9,4 +9,12 @@ class GitSaltConstants {
   static const int GIT_SALT_LOCAL_BRANCHES = 1;
   static const int GIT_SALT_REMOTE_BRANCHES = 2;
   static const int GIT_SALT_ALL_BRANCHES = 3;
+
+  // Layout of requests posted as an ArrayBuffer; see cpp/message_frame.h.
+  static const int GIT_SALT_FRAME_VERSION = 1;
+  static const int GIT_SALT_FRAME_FALSE = 0;
+  static const int GIT_SALT_FRAME_TRUE = 1;
+  static const int GIT_SALT_FRAME_INT = 2;
+  static const int GIT_SALT_FRAME_STRING = 3;
+  static const int GIT_SALT_FRAME_STRINGS = 4;
 }
\ No newline at end of file
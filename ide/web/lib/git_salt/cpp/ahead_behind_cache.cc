@@ -0,0 +1,33 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "ahead_behind_cache.h"
+
+AheadBehindCache::AheadBehindCache(size_t maxEntries)
+    : _maxEntries(maxEntries) {}
+
+int AheadBehindCache::get(git_repository* repo, const git_oid& tip,
+                          const git_oid& upstream, size_t* ahead,
+                          size_t* behind) {
+  Key key(tip, upstream);
+  CountMap::iterator it = _counts.find(key);
+  if (it != _counts.end()) {
+    *ahead = it->second.first;
+    *behind = it->second.second;
+    return 0;
+  }
+
+  int error = git_graph_ahead_behind(ahead, behind, repo, &tip, &upstream);
+  if (error) {
+    return error;
+  }
+
+  if (_order.size() >= _maxEntries) {
+    _counts.erase(_order.front());
+    _order.pop_front();
+  }
+  _counts[key] = std::make_pair(*ahead, *behind);
+  _order.push_back(key);
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_AHEAD_BEHIND_CACHE_H__
+#define GIT_SALT_AHEAD_BEHIND_CACHE_H__
+
+#include <git2.h>
+
+#include <deque>
+#include <map>
+#include <utility>
+
+#include "oid_util.h"
+
+/**
+ * Ahead/behind counts keyed by (tip, upstream) commit pair. Commits are
+ * immutable, so a count stays valid until one of the refs moves to a new
+ * commit, which simply makes a new key. Only used from the file thread.
+ */
+class AheadBehindCache {
+ public:
+  explicit AheadBehindCache(size_t maxEntries);
+
+  // Counts the commits |tip| has that |upstream| lacks and vice versa.
+  int get(git_repository* repo, const git_oid& tip, const git_oid& upstream,
+      size_t* ahead, size_t* behind);
+
+ private:
+  struct OidPairLess {
+    bool operator()(const std::pair<git_oid, git_oid>& a,
+                    const std::pair<git_oid, git_oid>& b) const {
+      int c = git_oid_cmp(&a.first, &b.first);
+      return c < 0 || (c == 0 && git_oid_cmp(&a.second, &b.second) < 0);
+    }
+  };
+
+  typedef std::pair<git_oid, git_oid> Key;
+  typedef std::map<Key, std::pair<size_t, size_t>, OidPairLess> CountMap;
+
+  CountMap _counts;
+  std::deque<Key> _order;
+  size_t _maxEntries;
+};
+
+#endif  // GIT_SALT_AHEAD_BEHIND_CACHE_H__
@@ -0,0 +1,354 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "archive_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+
+namespace {
+// A batch ends at whichever limit comes first.
+const size_t kBatchFiles = 64;
+const size_t kBatchBytes = 16 << 20;
+const size_t kTarBlock = 512;
+const size_t kTarNameSize = 100;
+// Entry count and offsets beyond these need zip64, which is not written.
+const size_t kZipMaxEntries = 0xffff;
+const double kZipMaxOffset = 4294967295.0;
+const uint16_t kZipVersion = 20;
+// Made by Unix, so the external attributes carry the file mode.
+const uint16_t kZipMadeBy = (3 << 8) | kZipVersion;
+// Names are UTF-8.
+const uint16_t kZipFlags = 0x0800;
+const uint16_t kZipStored = 0;
+const uint16_t kZipDeflated = 8;
+
+void Put16(std::string* out, uint16_t value) {
+  out->push_back((char) (value & 0xff));
+  out->push_back((char) (value >> 8));
+}
+
+void Put32(std::string* out, uint32_t value) {
+  Put16(out, (uint16_t) (value & 0xffff));
+  Put16(out, (uint16_t) (value >> 16));
+}
+
+// MS-DOS date and time, in local time as other zip tools write them.
+void DosDateTime(time_t mtime, uint16_t* date, uint16_t* time) {
+  struct tm tm;
+  localtime_r(&mtime, &tm);
+  if (tm.tm_year < 80) {
+    *date = (1 << 5) | 1;
+    *time = 0;
+    return;
+  }
+  *date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+  *time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+}
+
+uint32_t FileMode(git_filemode_t mode) {
+  if (mode == GIT_FILEMODE_LINK) {
+    return 0120777;
+  }
+  return mode == GIT_FILEMODE_BLOB_EXECUTABLE ? 0100755 : 0100644;
+}
+
+// Raw deflate, as zip wants it. False when it would not save anything.
+bool Deflate(const std::string& in, std::string* out) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+      Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  out->resize(deflateBound(&stream, in.size()));
+  stream.next_in = (Bytef*) in.data();
+  stream.avail_in = in.size();
+  stream.next_out = (Bytef*) &(*out)[0];
+  stream.avail_out = out->size();
+  bool ok = deflate(&stream, Z_FINISH) == Z_STREAM_END &&
+      stream.total_out < in.size();
+  out->resize(stream.total_out);
+  deflateEnd(&stream);
+  return ok;
+}
+
+// Writes |value| as a NUL terminated octal field of |size| bytes.
+bool PutOctal(char* field, size_t size, uint64_t value) {
+  char digits[24];
+  int length = snprintf(digits, sizeof(digits), "%0*llo", (int) size - 1,
+      (unsigned long long) value);
+  if (length < 0 || (size_t) length > size - 1) {
+    return false;
+  }
+  memcpy(field, digits, length + 1);
+  return true;
+}
+}
+
+ArchiveWriter::ArchiveWriter(Format format, WorkerPool* pool, WriteFn fn,
+    void* payload)
+    : _format(format), _pool(pool), _fn(fn), _payload(payload), _repo(NULL),
+      _mtime(0), _batchBegin(0), _files(0), _bytesIn(0), _offset(0) {}
+
+int ArchiveWriter::collectEntry(const char* root, const git_tree_entry* entry,
+    void* payload) {
+  git_filemode_t mode = git_tree_entry_filemode(entry);
+  // Directories are implied by the paths; submodules have no contents here.
+  if (git_tree_entry_type(entry) != GIT_OBJ_BLOB) {
+    return 0;
+  }
+  ArchiveWriter* writer = static_cast<ArchiveWriter*>(payload);
+  writer->_entries.push_back(Entry());
+  Entry& item = writer->_entries.back();
+  item.path = writer->_prefix + root + git_tree_entry_name(entry);
+  git_oid_cpy(&item.id, git_tree_entry_id(entry));
+  item.mode = mode;
+  return 0;
+}
+
+void ArchiveWriter::readEntry(size_t index, void* payload) {
+  ArchiveWriter* writer = static_cast<ArchiveWriter*>(payload);
+  Entry& entry = writer->_entries[writer->_batchBegin + index];
+  git_blob* blob = NULL;
+  entry.error = git_blob_lookup(&blob, writer->_repo, &entry.id);
+  if (entry.error) {
+    return;
+  }
+  entry.size = (size_t) git_blob_rawsize(blob);
+  entry.data.assign((const char*) git_blob_rawcontent(blob), entry.size);
+  git_blob_free(blob);
+
+  entry.deflated = false;
+  if (writer->_format == kZip) {
+    entry.crc = crc32(0, (const Bytef*) entry.data.data(), entry.size);
+    std::string deflated;
+    if (Deflate(entry.data, &deflated)) {
+      entry.data.swap(deflated);
+      entry.deflated = true;
+    }
+  }
+}
+
+int ArchiveWriter::emit(const char* data, size_t size) {
+  _offset += size;
+  return size ? _fn(data, size, _payload) : 0;
+}
+
+int ArchiveWriter::write(git_repository* repo, git_tree* tree,
+    const std::string& prefix, time_t mtime) {
+  git_odb* odb = NULL;
+  _repo = repo;
+  _prefix = prefix;
+  _mtime = mtime;
+  int r = git_tree_walk(tree, GIT_TREEWALK_PRE, &ArchiveWriter::collectEntry,
+      this);
+  if (!r) {
+    r = git_repository_odb(&odb, repo);
+  }
+  if (!r && _format == kZip && _entries.size() > kZipMaxEntries) {
+    giterr_set_str(GITERR_INVALID, "too many files for zip, use tar");
+    r = GIT_ERROR;
+  }
+
+  while (!r && _batchBegin < _entries.size()) {
+    // Sizes come from the object headers, so a batch is sized before any
+    // contents are read. A file larger than the limit is a batch of one.
+    size_t end = _batchBegin;
+    size_t bytes = 0;
+    while (end < _entries.size() && end - _batchBegin < kBatchFiles &&
+           (end == _batchBegin || bytes < kBatchBytes)) {
+      size_t size = 0;
+      git_otype type;
+      if (!git_odb_read_header(&size, &type, odb, &_entries[end].id)) {
+        bytes += size;
+      }
+      end++;
+    }
+
+    _pool->parallelFor(end - _batchBegin, &ArchiveWriter::readEntry, this);
+    for (size_t i = _batchBegin; !r && i < end; ++i) {
+      Entry& entry = _entries[i];
+      r = entry.error;
+      if (!r) {
+        r = writeEntry(entry);
+      }
+      // Only the contents of the current batch are held at a time.
+      std::string().swap(entry.data);
+    }
+    _batchBegin = end;
+  }
+
+  if (!r && _format == kZip) {
+    r = writeZipDirectory();
+  } else if (!r) {
+    // Two empty blocks end a tar archive.
+    std::string trailer(2 * kTarBlock, '\0');
+    r = emit(trailer.data(), trailer.size());
+  }
+  git_odb_free(odb);
+  _repo = NULL;
+  return r;
+}
+
+int ArchiveWriter::writeEntry(const Entry& entry) {
+  _files++;
+  _bytesIn += entry.size;
+  return _format == kZip ? writeZipEntry(entry) : writeTarEntry(entry);
+}
+
+int ArchiveWriter::writeZipEntry(const Entry& entry) {
+  if (_offset + entry.data.size() + entry.path.size() + 30 > kZipMaxOffset) {
+    giterr_set_str(GITERR_INVALID, "archive too large for zip, use tar");
+    return GIT_ERROR;
+  }
+
+  CentralRecord record;
+  record.path = entry.path;
+  record.crc = entry.crc;
+  record.compressedSize = entry.data.size();
+  record.size = entry.size;
+  record.method = entry.deflated ? kZipDeflated : kZipStored;
+  record.mode = FileMode(entry.mode);
+  record.offset = (uint32_t) _offset;
+  _central.push_back(record);
+
+  uint16_t date, time;
+  DosDateTime(_mtime, &date, &time);
+  std::string header;
+  Put32(&header, 0x04034b50);
+  Put16(&header, kZipVersion);
+  Put16(&header, kZipFlags);
+  Put16(&header, record.method);
+  Put16(&header, time);
+  Put16(&header, date);
+  Put32(&header, record.crc);
+  Put32(&header, record.compressedSize);
+  Put32(&header, record.size);
+  Put16(&header, record.path.size());
+  Put16(&header, 0);
+  header.append(record.path);
+
+  int r = emit(header.data(), header.size());
+  if (!r) {
+    r = emit(entry.data.data(), entry.data.size());
+  }
+  return r;
+}
+
+int ArchiveWriter::writeZipDirectory() {
+  uint16_t date, time;
+  DosDateTime(_mtime, &date, &time);
+  double start = _offset;
+  std::string directory;
+  for (size_t i = 0; i < _central.size(); ++i) {
+    const CentralRecord& record = _central[i];
+    Put32(&directory, 0x02014b50);
+    Put16(&directory, kZipMadeBy);
+    Put16(&directory, kZipVersion);
+    Put16(&directory, kZipFlags);
+    Put16(&directory, record.method);
+    Put16(&directory, time);
+    Put16(&directory, date);
+    Put32(&directory, record.crc);
+    Put32(&directory, record.compressedSize);
+    Put32(&directory, record.size);
+    Put16(&directory, record.path.size());
+    // Extra field, comment, disk number and internal attributes.
+    Put16(&directory, 0);
+    Put16(&directory, 0);
+    Put16(&directory, 0);
+    Put16(&directory, 0);
+    Put32(&directory, record.mode << 16);
+    Put32(&directory, record.offset);
+    directory.append(record.path);
+  }
+  if (start + directory.size() > kZipMaxOffset) {
+    giterr_set_str(GITERR_INVALID, "archive too large for zip, use tar");
+    return GIT_ERROR;
+  }
+
+  Put32(&directory, 0x06054b50);
+  Put16(&directory, 0);
+  Put16(&directory, 0);
+  Put16(&directory, _central.size());
+  Put16(&directory, _central.size());
+  Put32(&directory, directory.size() - 12);
+  Put32(&directory, (uint32_t) start);
+  Put16(&directory, 0);
+  return emit(directory.data(), directory.size());
+}
+
+int ArchiveWriter::writeTarHeader(const std::string& name, size_t size,
+    uint32_t mode, char type, const std::string& link) {
+  // Names that do not fit go first, in GNU long name entries.
+  int r = 0;
+  if (name.size() > kTarNameSize) {
+    r = writeTarLongName('L', name);
+  }
+  if (!r && link.size() > kTarNameSize) {
+    r = writeTarLongName('K', link);
+  }
+  if (r) {
+    return r;
+  }
+
+  char header[kTarBlock];
+  memset(header, 0, sizeof(header));
+  memcpy(header, name.data(), std::min(name.size(), kTarNameSize));
+  if (!PutOctal(header + 100, 8, mode & 07777) ||
+      !PutOctal(header + 108, 8, 0) || !PutOctal(header + 116, 8, 0) ||
+      !PutOctal(header + 124, 12, size) ||
+      !PutOctal(header + 136, 12, _mtime > 0 ? _mtime : 0)) {
+    giterr_set_str(GITERR_INVALID, "file too large for tar");
+    return GIT_ERROR;
+  }
+  header[156] = type;
+  memcpy(header + 157, link.data(), std::min(link.size(), kTarNameSize));
+  memcpy(header + 257, "ustar", 6);
+  memcpy(header + 263, "00", 2);
+  memcpy(header + 265, "root", 4);
+  memcpy(header + 297, "root", 4);
+
+  // The checksum is computed with its own field taken as spaces.
+  memset(header + 148, ' ', 8);
+  unsigned checksum = 0;
+  for (size_t i = 0; i < kTarBlock; ++i) {
+    checksum += (unsigned char) header[i];
+  }
+  snprintf(header + 148, 8, "%06o", checksum);
+  return emit(header, sizeof(header));
+}
+
+int ArchiveWriter::writeTarLongName(char type, const std::string& name) {
+  int r = writeTarHeader("././@LongLink", name.size() + 1, 0644, type, "");
+  if (!r) {
+    std::string data(name);
+    data.resize((name.size() / kTarBlock + 1) * kTarBlock, '\0');
+    r = emit(data.data(), data.size());
+  }
+  return r;
+}
+
+int ArchiveWriter::writeTarEntry(const Entry& entry) {
+  if (entry.mode == GIT_FILEMODE_LINK) {
+    return writeTarHeader(entry.path, 0, FileMode(entry.mode), '2',
+        entry.data);
+  }
+  int r = writeTarHeader(entry.path, entry.size, FileMode(entry.mode), '0',
+      "");
+  if (!r) {
+    r = emit(entry.data.data(), entry.data.size());
+  }
+  size_t padding = (kTarBlock - entry.size % kTarBlock) % kTarBlock;
+  if (!r && padding) {
+    char zeros[kTarBlock];
+    memset(zeros, 0, padding);
+    r = emit(zeros, padding);
+  }
+  return r;
+}
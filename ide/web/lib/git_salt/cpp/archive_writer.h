@@ -0,0 +1,106 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_ARCHIVE_WRITER_H__
+#define GIT_SALT_ARCHIVE_WRITER_H__
+
+#include <git2.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "worker_pool.h"
+
+/**
+ * Writes the files of a tree as a zip or ustar archive, passing the bytes
+ * on as they are produced. Blobs are read, and for zip deflated, a batch at
+ * a time on the worker pool and then written out in order, so memory is
+ * bounded by the batch size rather than by the size of the tree.
+ */
+class ArchiveWriter {
+ public:
+  enum Format {
+    kZip,
+    kTar
+  };
+
+  // Receives the archive in order; a non-zero return stops the writer.
+  typedef int (*WriteFn)(const char* data, size_t size, void* payload);
+
+  ArchiveWriter(Format format, WorkerPool* pool, WriteFn fn, void* payload);
+
+  /**
+   * Writes every blob and symlink of |tree| with |prefix| in front of its
+   * path, dated |mtime|, followed by the archive trailer.
+   */
+  int write(git_repository* repo, git_tree* tree, const std::string& prefix,
+      time_t mtime);
+
+  size_t files() const { return _files; }
+  // Bytes of file contents, and of the archive written for them.
+  double bytesIn() const { return _bytesIn; }
+  double bytesOut() const { return _offset; }
+
+ private:
+  struct Entry {
+    std::string path;
+    git_oid id;
+    git_filemode_t mode;
+    // Read on the worker pool: the contents, deflated when that is smaller.
+    std::string data;
+    size_t size;
+    uint32_t crc;
+    bool deflated;
+    int error;
+  };
+
+  struct CentralRecord {
+    std::string path;
+    uint32_t crc;
+    uint32_t compressedSize;
+    uint32_t size;
+    uint16_t method;
+    uint32_t mode;
+    uint32_t offset;
+  };
+
+  static int collectEntry(const char* root, const git_tree_entry* entry,
+      void* payload);
+
+  static void readEntry(size_t index, void* payload);
+
+  int emit(const char* data, size_t size);
+
+  int writeEntry(const Entry& entry);
+
+  int writeZipEntry(const Entry& entry);
+
+  int writeZipDirectory();
+
+  int writeTarHeader(const std::string& name, size_t size, uint32_t mode,
+      char type, const std::string& link);
+
+  int writeTarLongName(char type, const std::string& name);
+
+  int writeTarEntry(const Entry& entry);
+
+  Format _format;
+  WorkerPool* _pool;
+  WriteFn _fn;
+  void* _payload;
+  git_repository* _repo;
+  std::string _prefix;
+  time_t _mtime;
+  std::vector<Entry> _entries;
+  // First entry of the batch being read.
+  size_t _batchBegin;
+  std::vector<CentralRecord> _central;
+  size_t _files;
+  double _bytesIn;
+  double _offset;
+};
+
+#endif  // GIT_SALT_ARCHIVE_WRITER_H__
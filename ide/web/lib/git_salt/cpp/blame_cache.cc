@@ -0,0 +1,31 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "blame_cache.h"
+
+#include "oid_util.h"
+
+BlameCache::BlameCache(size_t maxEntries) : _maxEntries(maxEntries) {}
+
+BlameCache::Entry* BlameCache::get(const std::string& path,
+                                   const git_oid& commit,
+                                   bool* created) {
+  std::string key = oidToString(&commit) + ":" + path;
+
+  std::map<std::string, Entry>::iterator it = _entries.find(key);
+  *created = it == _entries.end();
+  if (!*created) {
+    return &it->second;
+  }
+
+  while (_order.size() >= _maxEntries) {
+    _entries.erase(_order.front());
+    _order.pop_front();
+  }
+
+  Entry& entry = _entries[key];
+  entry.lineCount = 0;
+  _order.push_back(key);
+  return &entry;
+}
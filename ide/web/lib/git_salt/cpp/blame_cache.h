@@ -0,0 +1,57 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_BLAME_CACHE_H__
+#define GIT_SALT_BLAME_CACHE_H__
+
+#include <git2.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BlameHunk {
+  // 1-based first line of the hunk in the blamed revision.
+  uint32_t start;
+  uint32_t lines;
+  git_oid commit;
+  std::string origPath;
+  uint32_t origStart;
+  std::string author;
+  std::string email;
+  int64_t time;
+  bool boundary;
+};
+
+/**
+ * Blame results keyed by (path, commit). The attribution of a line at a given
+ * commit never changes, so every range blamed once can be served again from
+ * here. Only used from the file thread.
+ */
+class BlameCache {
+ public:
+  struct Entry {
+    uint32_t lineCount;
+    // covered[i] is set once line i + 1 has been blamed.
+    std::vector<bool> covered;
+    std::vector<BlameHunk> hunks;
+  };
+
+  explicit BlameCache(size_t maxEntries);
+
+  /**
+   * Returns the entry for |path| at |commit|. A new, empty entry is created
+   * when there is none, and |created| is set.
+   */
+  Entry* get(const std::string& path, const git_oid& commit, bool* created);
+
+ private:
+  std::map<std::string, Entry> _entries;
+  std::deque<std::string> _order;
+  size_t _maxEntries;
+};
+
+#endif  // GIT_SALT_BLAME_CACHE_H__
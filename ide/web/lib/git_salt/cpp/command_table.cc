@@ -0,0 +1,66 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "command_table.h"
+
+#include <string.h>
+
+namespace {
+const size_t kInitialSlots = 64;
+const uint32_t kFnvOffset = 2166136261u;
+const uint32_t kFnvPrime = 16777619u;
+}
+
+CommandTable::CommandTable() : _count(0) {
+  Slot empty = { NULL, 0, 0, -1 };
+  _slots.assign(kInitialSlots, empty);
+}
+
+uint32_t CommandTable::hash(const char* name, size_t length) {
+  uint32_t h = kFnvOffset;
+  for (size_t i = 0; i < length; ++i) {
+    h = (h ^ (unsigned char) name[i]) * kFnvPrime;
+  }
+  return h;
+}
+
+void CommandTable::insert(const Slot& slot) {
+  size_t mask = _slots.size() - 1;
+  size_t i = slot.hash & mask;
+  while (_slots[i].name != NULL) {
+    i = (i + 1) & mask;
+  }
+  _slots[i] = slot;
+}
+
+void CommandTable::add(const char* name, int id) {
+  if ((_count + 1) * 2 > _slots.size()) {
+    std::vector<Slot> old;
+    old.swap(_slots);
+    Slot empty = { NULL, 0, 0, -1 };
+    _slots.assign(old.size() * 2, empty);
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i].name != NULL) {
+        insert(old[i]);
+      }
+    }
+  }
+  size_t length = strlen(name);
+  Slot slot = { name, length, hash(name, length), id };
+  insert(slot);
+  _count++;
+}
+
+int CommandTable::find(const char* name, size_t length) const {
+  uint32_t h = hash(name, length);
+  size_t mask = _slots.size() - 1;
+  for (size_t i = h & mask; _slots[i].name != NULL; i = (i + 1) & mask) {
+    const Slot& slot = _slots[i];
+    if (slot.hash == h && slot.length == length &&
+        !memcmp(slot.name, name, length)) {
+      return slot.id;
+    }
+  }
+  return -1;
+}
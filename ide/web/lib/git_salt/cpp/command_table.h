@@ -0,0 +1,48 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_COMMAND_TABLE_H__
+#define GIT_SALT_COMMAND_TABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Maps command names to small ids through an open addressed hash table, so
+ * dispatching a message costs one hash and usually a single compare rather
+ * than a compare per known command. Names are looked up by pointer and
+ * length, so they can come straight out of a message buffer. Filled once,
+ * then only read.
+ */
+class CommandTable {
+ public:
+  CommandTable();
+
+  // Adds |name|, which must outlive the table, with |id|.
+  void add(const char* name, int id);
+
+  // The id of the |length| bytes at |name|, or -1 for an unknown command.
+  int find(const char* name, size_t length) const;
+
+ private:
+  struct Slot {
+    const char* name;
+    size_t length;
+    uint32_t hash;
+    int id;
+  };
+
+  static uint32_t hash(const char* name, size_t length);
+
+  // Places |slot| in _slots, which must have a free slot.
+  void insert(const Slot& slot);
+
+  // Kept a power of two and at most half full.
+  std::vector<Slot> _slots;
+  size_t _count;
+};
+
+#endif  // GIT_SALT_COMMAND_TABLE_H__
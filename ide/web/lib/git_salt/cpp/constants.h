@@ -7,34 +7,191 @@
 
 namespace {
 // Used for our simple protocol to communicate with Javascript
+const char* const kAhead = "ahead";
+const char* const kAnalysis = "analysis";
+const char* const kAncestor = "ancestor";
 const char* const kArg = "arg";
+const char* const kAt = "at";
+const char* const kBackground = "background";
+const char* const kBackoff = "backoff";
+const char* const kBehind = "behind";
+const char* const kBlobs = "blobs";
+const char* const kBlobsIndexed = "blobsIndexed";
+const char* const kBoundary = "boundary";
+const char* const kBytes = "bytes";
+const char* const kBytesAfter = "bytesAfter";
+const char* const kBytesBefore = "bytesBefore";
 const char* const kBranch = "branch";
 const char* const kBranches = "branches";
+const char* const kBytesStreamed = "bytesStreamed";
+const char* const kCached = "cached";
+const char* const kCacheHits = "cacheHits";
+const char* const kCacheMisses = "cacheMisses";
+const char* const kCandidates = "candidates";
+const char* const kChunkLines = "chunkLines";
+const char* const kCommit = "commit";
 const char* const kCommitMessage = "commitMessage";
+const char* const kCompleted = "completed";
+const char* const kConflicts = "conflicts";
+const char* const kCopies = "copies";
+const char* const kCount = "count";
+const char* const kData = "data";
+const char* const kDeltas = "deltas";
+const char* const kDepth = "depth";
+const char* const kDirectories = "directories";
+const char* const kDone = "done";
+const char* const kElapsed = "elapsed";
+const char* const kEmail = "email";
 const char* const kEntries = "entries";
+const char* const kFailures = "failures";
+const char* const kFallbacks = "fallbacks";
+const char* const kFastForwardOnly = "fastForwardOnly";
+const char* const kFilesSearched = "filesSearched";
+const char* const kFileSystemName = "filesystemName";
+const char* const kFilter = "filter";
 const char* const kFlags = "flags";
 const char* const kFileSystem = "filesystem";
+const char* const kFiles = "files";
+const char* const kFilesAfter = "filesAfter";
+const char* const kFilesBefore = "filesBefore";
+const char* const kFilesChmodded = "filesChmodded";
+const char* const kFilesDeleted = "filesDeleted";
+const char* const kFilesWritten = "filesWritten";
+const char* const kFindCopies = "findCopies";
+const char* const kForce = "force";
+const char* const kFormat = "format";
+const char* const kFrom = "from";
 const char* const kFullPath = "fullPath";
+const char* const kGeneration = "generation";
+const char* const kHead = "head";
+const char* const kHunks = "hunks";
+const char* const kHits = "hits";
+const char* const kId = "id";
+const char* const kIdle = "idle";
+const char* const kIds = "ids";
+const char* const kIgnoreCase = "ignoreCase";
+const char* const kIndexing = "indexing";
+const char* const kIndexMs = "indexMs";
+const char* const kInteractive = "interactive";
+const char* const kInterval = "interval";
+const char* const kLength = "length";
+const char* const kLimit = "limit";
+const char* const kLine = "line";
+const char* const kLines = "lines";
+const char* const kMatches = "matches";
+const char* const kMaxLine = "maxLine";
+const char* const kMaxResults = "maxResults";
+const char* const kMaxWaitMs = "maxWaitMs";
+const char* const kMergeConflicts = "mergeConflicts";
 const char* const kMessage = "message";
+const char* const kMinLine = "minLine";
+const char* const kMisses = "misses";
+const char* const kMode = "mode";
+const char* const kMounted = "mounted";
+const char* const kMounts = "mounts";
+const char* const kMs = "ms";
 const char* const kName = "name";
+const char* const kNames = "names";
+const char* const kNewPath = "newPath";
+const char* const kNormal = "normal";
+const char* const kObjects = "objects";
+const char* const kObjectsPacked = "objectsPacked";
+const char* const kOffset = "offset";
+const char* const kOldPath = "oldPath";
+const char* const kOrigPath = "origPath";
+const char* const kOrigStart = "origStart";
+const char* const kOurs = "ours";
+const char* const kPacks = "packs";
+const char* const kPacksRemoved = "packsRemoved";
+const char* const kParseMs = "parseMs";
+const char* const kPath = "path";
+const char* const kPattern = "pattern";
+const char* const kPeakDepth = "peakDepth";
+const char* const kPhase = "phase";
+const char* const kPhaseInit = "init";
+const char* const kPhaseLibgit2 = "libgit2";
+const char* const kPhaseNaclIo = "naclIo";
+const char* const kPhaseWorkers = "workers";
+const char* const kPrefetch = "prefetch";
+const char* const kPrefix = "prefix";
+const char* const kPreview = "preview";
+const char* const kReceiveMs = "receiveMs";
 const char* const kRefs = "refs";
 const char* const kRegarding = "regarding";
+const char* const kRegex = "regex";
+const char* const kRenameLimit = "renameLimit";
+const char* const kRenameThreshold = "renameThreshold";
+const char* const kRenames = "renames";
+const char* const kResolveMs = "resolveMs";
 const char* const kResult = "result";
+const char* const kResume = "resume";
+const char* const kReused = "reused";
+const char* const kRev = "rev";
+const char* const kRevisions = "revisions";
+const char* const kRevs = "revs";
+const char* const kRuns = "runs";
+const char* const kScheduler = "scheduler";
+const char* const kSearch = "search";
+const char* const kSimilarity = "similarity";
+const char* const kSize = "size";
+const char* const kSizes = "sizes";
+const char* const kSparse = "sparse";
+const char* const kStart = "start";
+const char* const kStartup = "startup";
+const char* const kStatus = "status";
 const char* const kStatuses = "statuses";
+const char* const kStreamMs = "streamMs";
 const char* const kSubject = "subject";
+const char* const kSuccess = "success";
+const char* const kSummaries = "summaries";
+const char* const kText = "text";
+const char* const kTheirs = "theirs";
+const char* const kThreads = "threads";
+const char* const kTime = "time";
+const char* const kTimes = "times";
+const char* const kTo = "to";
+const char* const kTotal = "total";
+const char* const kTree = "tree";
+const char* const kTrigrams = "trigrams";
+const char* const kTruncated = "truncated";
+const char* const kType = "type";
+const char* const kTypes = "types";
+const char* const kUpstreams = "upstreams";
 const char* const kUrl = "url";
 const char* const kUserEmail = "userEmail";
 const char* const kUserName = "userName";
+const char* const kWaitMs = "waitMs";
+const char* const kWriteFailures = "writeFailures";
+const char* const kWriteMs = "writeMs";
+const char* const kWriteWorkdir = "writeWorkdir";
+const char* const kYields = "yields";
 
 // Git command constants.
 const char* const kCmdAdd = "add";
+const char* const kCmdArchive = "archive";
+const char* const kCmdBlame = "blame";
+const char* const kCmdCheckout = "checkout";
+const char* const kCmdBranchOverview = "branchOverview";
 const char* const kCmdClone = "clone";
 const char* const kCmdCommit = "commit";
 const char* const kCmdCurrentBranch = "currentBranch";
+const char* const kCmdDiff = "diff";
 const char* const kCmdGetBranches = "getBranches";
+const char* const kCmdGrep = "grep";
+const char* const kCmdSearch = "search";
 const char* const kLsRemote = "lsRemote";
+const char* const kCmdSparseCheckout = "sparseCheckout";
+const char* const kCmdStats = "stats";
 const char* const kCmdStatus = "status";
+const char* const kCmdSubscribe = "subscribe";
+const char* const kCmdUnsubscribe = "unsubscribe";
 const char* const kCmdInit = "init";
+const char* const kCmdLsTree = "lsTree";
+const char* const kCmdMaintenance = "maintenance";
+const char* const kCmdMerge = "merge";
+const char* const kCmdPrefetch = "prefetch";
+const char* const kCmdReadBlob = "readBlob";
+const char* const kCmdResolve = "resolve";
 }
 #endif  // GIT_SALT_CONSTANTS_H__
 
@@ -0,0 +1,23 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "file_util.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+int writeFileAtomically(const std::string& path, const std::string& data) {
+  std::string tmp = path + ".tmp";
+  FILE* file = fopen(tmp.c_str(), "wb");
+  if (file == NULL) {
+    return -1;
+  }
+  size_t written = fwrite(data.data(), 1, data.size(), file);
+  if (fclose(file) || written != data.size() ||
+      rename(tmp.c_str(), path.c_str())) {
+    unlink(tmp.c_str());
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,17 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_FILE_UTIL_H__
+#define GIT_SALT_FILE_UTIL_H__
+
+#include <string>
+
+/**
+ * Writes |data| to |path| through a temporary file next to it that is then
+ * renamed over it, so readers see either the old file or the complete new
+ * one. Returns 0 on success and -1, leaving |path| untouched, on failure.
+ */
+int writeFileAtomically(const std::string& path, const std::string& data);
+
+#endif  // GIT_SALT_FILE_UTIL_H__
@@ -4,8 +4,17 @@
 
 #include "git_command.h"
 
-int GitCommand::parseFileSystem(pp::VarDictionary message, std::string name,
-    pp::FileSystem& system) {
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "timing.h"
+
+int GitCommand::parseFileSystem(const pp::VarDictionary& message,
+    const std::string& name, pp::FileSystem& system) {
   pp::Var var_filesystem = message.Get(name);
 
   if (!var_filesystem.is_resource()) {
@@ -18,6 +27,70 @@ int GitCommand::parseFileSystem(pp::VarDictionary message, std::string name,
   return 0;
 }
 
+void GitCommand::parseRenameOptions(RenameOptions& options) {
+  int value;
+  bool findCopies;
+
+  if (!parseInt(_args, kRenameLimit, &value) && value >= 0) {
+    options.limit = value;
+  }
+
+  if (!parseInt(_args, kRenameThreshold, &value)) {
+    options.threshold = value;
+  }
+
+  if (!parseBool(_args, kFindCopies, &findCopies)) {
+    options.findCopies = findCopies;
+  }
+}
+
+int GitCommand::lookupTree(const std::string& spec, git_tree** tree) {
+  git_object* object = NULL;
+  git_object* peeled = NULL;
+
+  int r = git_revparse_single(&object, repo, spec.c_str());
+  if (!r) {
+    r = git_object_peel(&peeled, object, GIT_OBJ_TREE);
+    git_object_free(object);
+  }
+  *tree = (git_tree*) peeled;
+  return r;
+}
+
+int GitCommand::lookupCommit(const std::string& spec, git_commit** commit) {
+  git_object* object = NULL;
+  git_object* peeled = NULL;
+
+  int r = git_revparse_single(&object, repo, spec.c_str());
+  if (!r) {
+    r = git_object_peel(&peeled, object, GIT_OBJ_COMMIT);
+    git_object_free(object);
+  }
+  *commit = (git_commit*) peeled;
+  return r;
+}
+
+int GitCommand::yieldProgress(const git_transfer_progress* stats,
+                              void* payload) {
+  static_cast<GitCommand*>(payload)->_gitSalt->scheduler()->yield();
+  return 0;
+}
+
+void GitCommand::setOutcome(int error, pp::VarDictionary& arg) {
+  arg.Set(kSuccess, !error);
+  if (!error) {
+    return;
+  }
+  const git_error* a = giterr_last();
+  if (a != NULL) {
+    arg.Set(kMessage, a->message);
+  } else {
+    char message[64];
+    snprintf(message, sizeof(message), "failed with error %d", error);
+    arg.Set(kMessage, message);
+  }
+}
+
 int GitCommand::parseArgs() {
 
   if ((error = parseFileSystem(_args, kFileSystem, fileSystem))) {
@@ -28,25 +101,300 @@ int GitCommand::parseArgs() {
 
   }
 
+  if ((error = parseString(_args, kFileSystemName, fileSystemName))) {
+
+  }
+
   if ((error = parseString(_args, kUrl,  url))) {
 
   }
   return 0;
 }
 
-int GitClone::runCommand() {
-  // mount the folder as a filesystem.
-  ChromefsInit();
+namespace {
+const char* const kDefaultFetchRefspec = "+refs/heads/*:refs/remotes/origin/*";
+
+// Accepts "blob:none" and "blob:limit=<n>[kmg]".
+bool IsValidFilter(const std::string& filter) {
+  if (filter == "blob:none") {
+    return true;
+  }
+  const std::string limit = "blob:limit=";
+  if (filter.compare(0, limit.length(), limit) != 0) {
+    return false;
+  }
+  size_t end = filter.find_first_not_of("0123456789", limit.length());
+  return end > limit.length() && (end == std::string::npos ||
+      (end == filter.length() - 1 && strchr("kKmMgG", filter[end])));
+}
+
+int SetFetchRefspec(git_remote* remote, const std::string& refspec) {
+  char* strings[] = {const_cast<char*>(refspec.c_str())};
+  git_strarray refspecs = {strings, 1};
+  return git_remote_set_fetch_refspecs(remote, &refspecs);
+}
+}
+
+int GitClone::parseArgs() {
+  GitCommand::parseArgs();
+
+  if ((error = parseBool(_args, kResume, &resume))) {
+  }
+
+  pp::VarArray sparseArray;
+  if ((error = parseArray(_args, kSparse, sparseArray))) {
+  }
+
+  uint32_t length = sparseArray.GetLength();
+  for (uint32_t i = 0; i < length; ++i) {
+    sparse.push_back(sparseArray.Get(i).AsString());
+  }
+
+  if ((error = parseString(_args, kFilter, filter))) {
+  }
+  return 0;
+}
+
+void GitClone::postProgress(size_t completed, size_t total) {
+  pp::VarDictionary arg;
+  arg.Set(kPhase, "fetch");
+  arg.Set(kCompleted, (int) completed);
+  arg.Set(kTotal, (int) total);
+  arg.Set(kDone, false);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  _gitSalt->scheduler()->yield();
+}
+
+int GitClone::fetchBranches(git_remote* remote, std::string* defaultBranch) {
+  git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+  callbacks.transfer_progress = &GitCommand::yieldProgress;
+  callbacks.payload = this;
+  git_remote_set_callbacks(remote, &callbacks);
+
+  int r = git_remote_connect(remote, GIT_DIRECTION_FETCH);
+  const git_remote_head** heads = NULL;
+  size_t size = 0;
+  if (!r) {
+    r = git_remote_ls(&heads, &size, remote);
+  }
+
+  // The default branch goes first, so it is complete as early as possible.
+  std::vector<std::pair<std::string, git_oid> > branches;
+  const git_oid* headId = NULL;
+  for (size_t i = 0; !r && i < size; ++i) {
+    std::string name = heads[i]->name;
+    if (name == "HEAD") {
+      headId = &heads[i]->oid;
+    } else if (name.compare(0, 11, "refs/heads/") == 0) {
+      branches.push_back(std::make_pair(name.substr(11), heads[i]->oid));
+      bool isDefault = headId != NULL &&
+          git_oid_equal(headId, &heads[i]->oid) &&
+          (defaultBranch->empty() || name == "refs/heads/master");
+      if (isDefault) {
+        *defaultBranch = branches.back().first;
+        std::swap(branches.front(), branches.back());
+      }
+    }
+  }
+  git_remote_disconnect(remote);
+
+  for (size_t i = 0; !r && i < branches.size(); ++i) {
+    // Branches that already arrived in an earlier attempt are skipped.
+    std::string tracking = "refs/remotes/origin/" + branches[i].first;
+    git_oid local;
+    if (git_reference_name_to_id(&local, repo, tracking.c_str()) ||
+        !git_oid_equal(&local, &branches[i].second)) {
+      giterr_clear();
+      r = SetFetchRefspec(remote,
+          "+refs/heads/" + branches[i].first + ":" + tracking);
+      if (!r) {
+        r = git_remote_fetch(remote, NULL, NULL);
+      }
+    }
+    postProgress(i + 1, branches.size());
+  }
+
+  if (!r) {
+    r = SetFetchRefspec(remote, kDefaultFetchRefspec);
+  }
+  if (!r) {
+    r = git_remote_save(remote);
+  }
+  return r;
+}
+
+int GitClone::resumableClone() {
+  git_remote* remote = NULL;
+  git_reference* branch = NULL;
+  git_commit* tip = NULL;
+  git_tree* tree = NULL;
+  std::string defaultBranch;
+  int r;
+
+  struct stat st;
+  if (!stat(_cloneStateFile.c_str(), &st)) {
+    r = git_repository_open(&repo, _workdir.c_str());
+    if (!r) {
+      r = installPackIndexer();
+    }
+    if (!r) {
+      r = git_remote_load(&remote, repo, "origin");
+    }
+  } else {
+    r = git_repository_init(&repo, _workdir.c_str(), false);
+    if (!r) {
+      r = installPackIndexer();
+    }
+    if (!r) {
+      r = git_remote_create(&remote, repo, "origin", url.c_str());
+    }
+    if (!r) {
+      FILE* state = fopen(_cloneStateFile.c_str(), "wb");
+      r = state != NULL ? fclose(state) : -1;
+    }
+    // The cone is in place before anything is checked out.
+    if (!r && !sparse.empty()) {
+      SparseCone cone;
+      cone.setDirectories(sparse);
+      r = cone.save(git_repository_path(repo));
+    }
+  }
+
+  if (!r) {
+    r = fetchBranches(remote, &defaultBranch);
+  }
+
+  // An empty remote clones into an unborn HEAD.
+  if (!r && !defaultBranch.empty()) {
+    std::string tracking = "refs/remotes/origin/" + defaultBranch;
+    r = lookupCommit(tracking, &tip);
+    if (!r && git_branch_lookup(&branch, repo, defaultBranch.c_str(),
+        GIT_BRANCH_LOCAL)) {
+      giterr_clear();
+      r = git_branch_create(&branch, repo, defaultBranch.c_str(), tip, 0,
+          NULL, NULL);
+      if (!r) {
+        std::string upstream = "origin/" + defaultBranch;
+        r = git_branch_set_upstream(branch, upstream.c_str());
+      }
+    }
+    if (!r) {
+      r = git_repository_set_head(repo, git_reference_name(branch), NULL,
+          NULL);
+    }
+    if (!r) {
+      r = git_commit_tree(&tree, tip);
+    }
+    if (!r) {
+      // Files left over from an interrupted checkout are simply rewritten.
+      GitCheckout checkout(_gitSalt, subject, _args, repo);
+      checkout.force = true;
+      r = checkout.checkoutTree(NULL, tree);
+    }
+  }
 
-  git_threads_init();
+  if (!r) {
+    unlink(_cloneStateFile.c_str());
+  }
+
+  git_tree_free(tree);
+  git_commit_free(tip);
+  git_reference_free(branch);
+  git_remote_free(remote);
+  return r;
+}
+
+int GitClone::installPackIndexer() {
+  return PackIndexer::install(repo, _gitSalt->workerPool(),
+      _gitSalt->packIndexStats());
+}
+
+int GitClone::plainClone() {
+  git_remote* remote = NULL;
+  int r = git_repository_init(&repo, _workdir.c_str(), false);
+  if (!r) {
+    r = installPackIndexer();
+  }
+  if (!r) {
+    r = git_remote_create(&remote, repo, "origin", url.c_str());
+  }
+  if (!r) {
+    git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+    callbacks.transfer_progress = &GitCommand::yieldProgress;
+    callbacks.payload = this;
+    git_remote_set_callbacks(remote, &callbacks);
+
+    git_checkout_options options = GIT_CHECKOUT_OPTIONS_INIT;
+    options.checkout_strategy = GIT_CHECKOUT_SAFE_CREATE;
+    r = git_clone_into(repo, remote, &options, NULL, NULL);
+  }
+  git_remote_free(remote);
+  return r;
+}
+
+int GitClone::openWorkdir() {
+  MountRegistry* mounts = _gitSalt->mountRegistry();
+  std::string target;
+  // Every message brings a new resource for the same file system, so the
+  // page's name for it is what identifies a mount.
+  int32_t resource = (int32_t) fileSystem.pp_resource();
+  std::string identity = fileSystemName;
+  if (identity.empty()) {
+    char id[32];
+    snprintf(id, sizeof(id), "resource:%d", (int) resource);
+    identity = id;
+  }
+  int r = mounts->acquire(identity, resource, fullPath, &target);
+  if (r) {
+    return r;
+  }
 
+  if (repo != NULL && target == _gitSalt->repositoryMount()) {
+    // Already the open repository, which holds a reference of its own.
+    mounts->release(target);
+  } else {
+    _gitSalt->CloseRepository();
+    _gitSalt->SetRepositoryMount(target);
+  }
+  _workdir = target;
+  _cloneStateFile = target + "/.git/salt_clone";
+  return 0;
+}
+
+int GitClone::runCommand() {
   std::string message = "clone successful";
 
-  if (!url.length()) {
-    git_repository_open(&repo, "/chromefs");
-    message = "repository load successful";
+  if (openWorkdir()) {
+    message = "could not mount " + fullPath;
+  } else if (repo != NULL) {
+    message = url.length() ? "repository already exists." :
+        "repository load successful";
+  } else if (!url.length()) {
+    if (!git_repository_open(&repo, _workdir.c_str())) {
+      installPackIndexer();
+      message = "repository load successful";
+    } else {
+      // Nothing to keep the mount for.
+      _gitSalt->CloseRepository();
+      message = "repository load failed";
+    }
+  } else if (!filter.empty()) {
+    // The fetch protocol of this libgit2 has no filter capability and cannot
+    // ask for single blobs later, so a partial clone is refused rather than
+    // silently turned into a full one.
+    message = IsValidFilter(filter) ?
+        "partial clone (filter " + filter + ") is not supported" :
+        "invalid filter: " + filter;
+  } else if (resume || !sparse.empty()) {
+    resumableClone();
   } else {
-    git_clone(&repo, url.c_str(), "/chromefs", NULL);
+    plainClone();
   }
 
   const git_error *a = giterr_last();
@@ -68,11 +416,10 @@ int GitClone::runCommand() {
 }
 
 int GitInit::runCommand() {
-  ChromefsInit();
-
-  git_threads_init();
-
-  git_repository_init(&repo, "/chromefs", true);
+  // Initializing the open repository again would not change anything.
+  if (!openWorkdir() && repo == NULL) {
+    git_repository_init(&repo, _workdir.c_str(), true);
+  }
 
   pp::VarDictionary arg;
   arg.Set(kMessage, "Git init success.");
@@ -87,17 +434,6 @@ int GitInit::runCommand() {
   return 0;
 }
 
-void GitClone::ChromefsInit() {
-  int32_t r = (int32_t) fileSystem.pp_resource();
-  char fs_resource[100] = "filesystem_resource=";
-  sprintf(&fs_resource[20], "%d", r);
-  mount(fullPath.c_str(),                     /* source */
-      "/chromefs",                            /* target */
-      "html5fs",                              /* filesystemtype */
-      0,                                      /* mountflags */
-      fs_resource);                           /* data */
-}
-
 int GitCommit::parseArgs() {
   if ((error = parseString(_args, kUserName, userName))) {
 
@@ -111,6 +447,24 @@ int GitCommit::parseArgs() {
 
   }
 
+  pp::Var var_files = _args.Get(kFiles);
+  if (var_files.is_dictionary()) {
+    pp::VarDictionary fileDict(var_files);
+    pp::VarArray paths = fileDict.GetKeys();
+    uint32_t length = paths.GetLength();
+    for (uint32_t i = 0; i < length; ++i) {
+      pp::Var content = fileDict.Get(paths.Get(i));
+      if (content.is_array_buffer()) {
+        files.push_back(std::make_pair(paths.Get(i).AsString(),
+            pp::VarArrayBuffer(content)));
+      }
+    }
+  }
+
+  if ((error = parseBool(_args, kWriteWorkdir, &writeWorkdir))) {
+
+  }
+
   return 0;
 }
 
@@ -169,18 +523,191 @@ bool GitCommit::commitStage() {
   return !error;
 }
 
+namespace {
+int MakeParentDirs(const std::string& path, size_t rootLength) {
+  for (size_t i = path.find('/', rootLength); i != std::string::npos;
+       i = path.find('/', i + 1)) {
+    if (mkdir(path.substr(0, i).c_str(), 0755) && errno != EEXIST) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int WriteFile(const std::string& path, const void* data, size_t size) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == NULL) {
+    return -1;
+  }
+  size_t written = size ? fwrite(data, 1, size, file) : 0;
+  return (fclose(file) || written != size) ? -1 : 0;
+}
+
+// Whether |path| names a file inside the working tree: relative, with no
+// empty, ".", ".." or ".git" components.
+bool IsWorkdirPath(const std::string& path) {
+  if (path.empty() || path[0] == '/') {
+    return false;
+  }
+  for (size_t start = 0; start <= path.size();) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    std::string part = path.substr(start, end - start);
+    if (part.empty() || part == "." || part == ".." || part == ".git") {
+      return false;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+}
+
+void GitCommit::writeWorkdirFile(size_t index, void* payload) {
+  GitCommit* commit = static_cast<GitCommit*>(payload);
+  WorkdirFile& file = commit->_workdirFiles[index];
+  file.error = MakeParentDirs(file.path, commit->_workdirLength) ||
+      WriteFile(file.path, file.data, file.size);
+}
+
+void GitCommit::writeWorkdirFiles(const char* workdir) {
+  _workdirLength = strlen(workdir);
+  _workdirFiles.resize(files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    pp::VarArrayBuffer& buffer = files[i].second;
+    WorkdirFile& file = _workdirFiles[i];
+    file.path = workdir + files[i].first;
+    file.size = buffer.ByteLength();
+    file.data = file.size ? static_cast<const char*>(buffer.Map()) : NULL;
+    file.error = 0;
+  }
+
+  // The buffers stay mapped until every worker is done with them.
+  _gitSalt->workerPool()->parallelFor(_workdirFiles.size(),
+      &GitCommit::writeWorkdirFile, this);
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (_workdirFiles[i].size) {
+      files[i].second.Unmap();
+    }
+    if (_workdirFiles[i].error) {
+      writeFailures.push_back(files[i].first);
+    }
+  }
+  _workdirFiles.clear();
+}
+
+bool GitCommit::commitBuffers() {
+  git_index* index = NULL;
+  git_oid treeId;
+  git_tree* tree = NULL;
+  git_signature* sign = NULL;
+  // Head commit, NULL when HEAD is unborn.
+  git_commit* parent = getLastCommit();
+  giterr_clear();
+  error = 0;
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!IsWorkdirPath(files[i].first)) {
+      giterr_set_str(GITERR_INVALID,
+          ("invalid path: " + files[i].first).c_str());
+      error = GIT_ERROR;
+      break;
+    }
+  }
+
+  if (!error) {
+    error = git_repository_index(&index, repo);
+  }
+  if (!error) {
+    error = git_index_read(index, false);
+  }
+
+  for (size_t i = 0; !error && i < files.size(); ++i) {
+    const std::string& path = files[i].first;
+    pp::VarArrayBuffer& buffer = files[i].second;
+    uint32_t size = buffer.ByteLength();
+
+    git_index_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    error = git_blob_create_frombuffer(&entry.id, repo,
+        size ? buffer.Map() : "", size);
+    if (size) {
+      buffer.Unmap();
+    }
+    if (error) {
+      break;
+    }
+
+    // Keep the mode of tracked files. The stat data stays empty, so the
+    // next status compares the working file by content.
+    const git_index_entry* tracked = git_index_get_bypath(index,
+        path.c_str(), 0);
+    entry.mode = tracked != NULL ? tracked->mode : (uint32_t) GIT_FILEMODE_BLOB;
+    entry.file_size = size;
+    entry.path = path.c_str();
+    error = git_index_add(index, &entry);
+  }
+
+  if (!error) {
+    error = git_index_write_tree(&treeId, index);
+  }
+  if (!error) {
+    error = git_tree_lookup(&tree, repo, &treeId);
+  }
+  if (!error) {
+    error = git_signature_now(&sign, userName.c_str(), userEmail.c_str());
+  }
+  if (!error) {
+    error = git_commit_create(
+        &commitId,
+        repo,
+        "HEAD",
+        sign,
+        sign,
+        NULL,
+        commitMsg.c_str(),
+        tree,
+        parent != NULL ? 1 : 0,
+        (const git_commit**)&parent);
+  }
+  if (!error) {
+    error = git_index_write(index);
+  }
+
+  const char* workdir = git_repository_workdir(repo);
+  if (!error && writeWorkdir && workdir != NULL) {
+    writeWorkdirFiles(workdir);
+  }
+
+  git_signature_free(sign);
+  git_tree_free(tree);
+  git_index_free(index);
+  git_commit_free(parent);
+  return !error;
+}
+
 int GitCommit::runCommand() {
-  int r = commitStage();
+  int r = files.empty() ? commitStage() : commitBuffers();
 
   pp::VarDictionary arg;
+  if (!files.empty() && r) {
+    arg.Set(kCommit, oidToString(&commitId));
+  }
+  if (writeWorkdir) {
+    pp::VarArray failures;
+    for (size_t i = 0; i < writeFailures.size(); ++i) {
+      failures.Set(i, writeFailures[i]);
+    }
+    arg.Set(kWriteFailures, failures);
+  }
+  setOutcome(r ? 0 : GIT_ERROR, arg);
 
   pp::VarDictionary response;
   response.Set(kRegarding, subject);
   response.Set(kArg, arg);
   response.Set(kName, kResult);
-  if (r != 0) {
-    //TODO(grv): handle error.
-  }
   _gitSalt->PostMessage(response);
   return 0;
 }
@@ -190,13 +717,8 @@ int GitCurrentBranch::parseArgs() {
 }
 
 int GitCurrentBranch::runCommand() {
-
-  git_reference* ref = NULL;
-  char *branch = NULL;
-  int r= git_repository_head(&ref, repo);
-  if (r == 0) {
-    git_branch_name((const char**)&branch, ref);
-  }
+  std::string branch;
+  bool hasBranch = _gitSalt->refSnapshot()->currentBranch(repo, &branch);
 
   const git_error *a = giterr_last();
 
@@ -205,7 +727,7 @@ int GitCurrentBranch::runCommand() {
   }
 
   pp::VarDictionary arg;
-  arg.Set(kBranch, branch);
+  arg.Set(kBranch, hasBranch ? pp::Var(branch) : pp::Var(pp::Var::Null()));
 
   pp::VarDictionary response;
   response.Set(kRegarding, subject);
@@ -213,7 +735,6 @@ int GitCurrentBranch::runCommand() {
   response.Set(kName, kResult);
 
   _gitSalt->PostMessage(response);
-  git_reference_free(ref);
   return 0;
 }
 
@@ -224,30 +745,13 @@ int GitGetBranches::parseArgs() {
 }
 
 int GitGetBranches::runCommand() {
-
-  git_branch_iterator* iter = NULL;
-
-  git_branch_t type = (git_branch_t) flags;
-
-  int r = git_branch_iterator_new(&iter, repo, type);
+  const std::vector<std::string>& names =
+      _gitSalt->refSnapshot()->branches(repo, flags);
 
   pp::VarDictionary arg;
   pp::VarArray branches;
-  int index = 0;
-
-  char* branch = NULL;
-
-  if (r == 0) {
-    while (r == 0) {
-      git_reference* ref;
-      r = git_branch_next(&ref, &type, iter);
-      if (r == 0) {
-        git_branch_name((const char**)&branch, ref);
-        branches.Set(index, branch);
-        index++;
-        git_reference_free(ref);
-      }
-    }
+  for (size_t i = 0; i < names.size(); ++i) {
+    branches.Set(i, names[i]);
   }
 
   arg.Set(kBranches, branches);
@@ -258,57 +762,93 @@ int GitGetBranches::runCommand() {
   response.Set(kName, kResult);
 
   _gitSalt->PostMessage(response);
-  git_branch_iterator_free(iter);
-  return 0;
-}
-
-int GitAdd::parseArgs() {
-  pp::VarArray entryArray;
-  if ((error = parseArray(_args, kEntries, entryArray))) {
-  }
-
-  uint32_t length = entryArray.GetLength();
-  for (uint32_t i = 0; i < length; ++i) {
-    entries.push_back(entryArray.Get(i).AsString());
-  }
   return 0;
 }
 
-int GitAdd::runCommand() {
-  git_index* index = NULL;
-  error = git_repository_index(&index, repo);
-  if (error) {
-    //TODO(grv): handle errors.
-  }
-  for (uint32_t i = 0; i < entries.size(); i++) {
-    //TODO(grv) : This only works for filepaths. Add support for adding
-    // directory paths recursively.
-    git_index_add_bypath(index, entries[i].c_str());
+int GitBranchOverview::parseArgs() {
+  if ((error = parseInt(_args, kFlags, &flags))) {
   }
   return 0;
 }
 
-int StatusCb(const char* path, unsigned int status, void* payload) {
-  pp::VarDictionary* statuses = (pp::VarDictionary*) payload;
-  statuses->Set(path, (int)status);
-  return 0;
-}
+int GitBranchOverview::runCommand() {
+  git_branch_iterator* iter = NULL;
+  git_branch_t type = (git_branch_t) flags;
+  pp::VarArray names;
+  pp::VarArray ids;
+  pp::VarArray summaries;
+  pp::VarArray times;
+  pp::VarArray upstreams;
+  pp::VarArray ahead;
+  pp::VarArray behind;
+  uint32_t index = 0;
 
-int GitStatus::runCommand() {
+  int r = git_branch_iterator_new(&iter, repo, type);
+  while (!r) {
+    git_reference* ref = NULL;
+    r = git_branch_next(&ref, &type, iter);
+    if (r) {
+      break;
+    }
 
-  git_status_cb cb = StatusCb;
+    const char* name = NULL;
+    git_reference* resolved = NULL;
+    git_commit* tip = NULL;
+    git_reference* upstream = NULL;
+    git_branch_name(&name, ref);
+
+    // Remote HEADs are symbolic, everything else points at a commit.
+    if (git_reference_resolve(&resolved, ref) ||
+        git_commit_lookup(&tip, repo, git_reference_target(resolved))) {
+      giterr_clear();
+      git_reference_free(resolved);
+      git_reference_free(ref);
+      continue;
+    }
 
-  pp::VarDictionary statuses;
-  git_status_foreach(repo, cb, &statuses);
+    names.Set(index, name);
+    ids.Set(index, oidToString(git_commit_id(tip)));
+    summaries.Set(index, git_commit_summary(tip));
+    times.Set(index, (double) git_commit_time(tip));
+
+    size_t numAhead = 0;
+    size_t numBehind = 0;
+    if (type == GIT_BRANCH_LOCAL && !git_branch_upstream(&upstream, ref) &&
+        git_reference_target(upstream) != NULL) {
+      upstreams.Set(index, git_reference_shorthand(upstream));
+      if (_gitSalt->aheadBehindCache()->get(repo, *git_commit_id(tip),
+          *git_reference_target(upstream), &numAhead, &numBehind)) {
+        giterr_clear();
+      }
+    } else {
+      giterr_clear();
+      upstreams.Set(index, "");
+    }
+    ahead.Set(index, (int) numAhead);
+    behind.Set(index, (int) numBehind);
+    index++;
+
+    git_reference_free(upstream);
+    git_commit_free(tip);
+    git_reference_free(resolved);
+    git_reference_free(ref);
+  }
+  git_branch_iterator_free(iter);
 
   const git_error *a = giterr_last();
 
-  if (a != NULL) {
+  if (r != GIT_ITEROVER && a != NULL) {
     printf("giterror: %s\n", a->message);
   }
 
   pp::VarDictionary arg;
-  arg.Set(kStatuses, statuses);
+  arg.Set(kNames, names);
+  arg.Set(kIds, ids);
+  arg.Set(kSummaries, summaries);
+  arg.Set(kTimes, times);
+  arg.Set(kUpstreams, upstreams);
+  arg.Set(kAhead, ahead);
+  arg.Set(kBehind, behind);
 
   pp::VarDictionary response;
   response.Set(kRegarding, subject);
@@ -319,18 +859,458 @@ int GitStatus::runCommand() {
   return 0;
 }
 
-int GitLsRemote::parseArgs() {
-  pp::VarArray entryArray;
-  if ((error = parseString(_args, kUrl, url))) {
+namespace {
+// Files from this size on are streamed into the object database instead of
+// being read whole, so adding a large asset needs little memory.
+const off_t kStreamBlobThreshold = 8 << 20;
+const size_t kStreamChunkBytes = 1 << 20;
+// Files read and hashed together before their blobs are written.
+const size_t kAddBatchFiles = 128;
+
+/**
+ * Writes the file at |path|, |size| bytes long, as a blob through an object
+ * database write stream: it is read, hashed and deflated one chunk at a
+ * time.
+ */
+int StreamBlob(git_odb* odb, const std::string& path, size_t size,
+    git_oid* id) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    giterr_set_str(GITERR_OS, ("cannot read " + path).c_str());
+    return GIT_ERROR;
   }
-  return 0;
-}
 
-int GitLsRemote::runCommand() {
-  git_remote* remote = NULL;
-  error = git_remote_create_anonymous(&remote, repo, url.c_str(), NULL);
+  git_odb_stream* stream = NULL;
+  int r = git_odb_open_wstream(&stream, odb, size, GIT_OBJ_BLOB);
+  std::vector<char> buffer(kStreamChunkBytes);
+  size_t read;
+  while (!r && (read = fread(&buffer[0], 1, buffer.size(), file)) > 0) {
+    r = git_odb_stream_write(stream, &buffer[0], read);
+  }
+  if (!r && ferror(file)) {
+    giterr_set_str(GITERR_OS, ("cannot read " + path).c_str());
+    r = GIT_ERROR;
+  }
+  // Fails unless exactly |size| bytes were written.
+  if (!r) {
+    r = git_odb_stream_finalize_write(id, stream);
+  }
+  git_odb_stream_free(stream);
+  fclose(file);
+  return r;
+}
+}
 
-  error = git_remote_connect(remote, GIT_DIRECTION_FETCH);
+int GitAdd::parseArgs() {
+  pp::VarArray entryArray;
+  if ((error = parseArray(_args, kEntries, entryArray))) {
+  }
+
+  uint32_t length = entryArray.GetLength();
+  for (uint32_t i = 0; i < length; ++i) {
+    entries.push_back(entryArray.Get(i).AsString());
+  }
+  return 0;
+}
+
+void GitAdd::hashFiles(size_t index, void* payload) {
+  GitAdd* add = static_cast<GitAdd*>(payload);
+  size_t begin = add->_batchStart + index * kSha1Lanes;
+  size_t end = std::min(begin + kSha1Lanes, add->_batchEnd);
+
+  std::string headers[kSha1Lanes];
+  Sha1Message messages[kSha1Lanes];
+  size_t lanes[kSha1Lanes];
+  size_t count = 0;
+
+  for (size_t i = begin; i < end; ++i) {
+    AddedFile& file = add->_files[i];
+    // Anything but a readable regular file is left to libgit2.
+    file.error = -1;
+    file.large = false;
+    if (lstat(file.path.c_str(), &file.st) || !S_ISREG(file.st.st_mode)) {
+      continue;
+    }
+    if (file.st.st_size >= kStreamBlobThreshold) {
+      file.large = true;
+      continue;
+    }
+    FILE* f = fopen(file.path.c_str(), "rb");
+    if (f == NULL) {
+      continue;
+    }
+    std::string& content = file.content;
+    content.resize(file.st.st_size);
+    size_t read = content.empty() ? 0 : fread(&content[0], 1, content.size(),
+        f);
+    fclose(f);
+    if (read != content.size()) {
+      std::string().swap(content);
+      continue;
+    }
+
+    char header[64];
+    int length = snprintf(header, sizeof(header), "blob %lu",
+        (unsigned long) content.size());
+    headers[count].assign(header, length + 1);
+
+    Sha1Message& message = messages[count];
+    message.prefix = (const unsigned char*) headers[count].data();
+    message.prefixSize = headers[count].size();
+    message.data = (const unsigned char*) content.data();
+    message.size = content.size();
+    lanes[count++] = i;
+  }
+
+  sha1HashLanes(messages, count);
+  for (size_t i = 0; i < count; ++i) {
+    AddedFile& file = add->_files[lanes[i]];
+    git_oid_fromraw(&file.id, messages[i].digest);
+    file.error = 0;
+  }
+}
+
+int GitAdd::addFile(git_index* index, git_odb* odb, bool fileMode,
+    const std::string& path, AddedFile& file) {
+  int r = 0;
+  if (file.large) {
+    double streamStart = nowMs();
+    r = StreamBlob(odb, file.path, file.st.st_size, &file.id);
+    streamMs += nowMs() - streamStart;
+    bytesStreamed += file.st.st_size;
+    filesWritten++;
+  } else if (file.error) {
+    filesWritten++;
+    return git_index_add_bypath(index, path.c_str());
+  } else if (!git_odb_exists(odb, &file.id)) {
+    // Written from the contents already read and hashed.
+    r = git_odb_write(&file.id, odb, file.content.data(),
+        file.content.size(), GIT_OBJ_BLOB);
+    filesWritten++;
+  }
+  std::string().swap(file.content);
+  if (r) {
+    return r;
+  }
+
+  git_index_entry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.ctime.seconds = file.st.st_ctime;
+  entry.mtime.seconds = file.st.st_mtime;
+  entry.dev = file.st.st_dev;
+  entry.ino = file.st.st_ino;
+  entry.uid = file.st.st_uid;
+  entry.gid = file.st.st_gid;
+  entry.file_size = file.st.st_size;
+  // Like git, the executable bit only counts with core.filemode; otherwise
+  // tracked files keep the mode they have.
+  const git_index_entry* tracked = git_index_get_bypath(index, path.c_str(),
+      0);
+  if (fileMode) {
+    entry.mode = (file.st.st_mode & 0111) ?
+        GIT_FILEMODE_BLOB_EXECUTABLE : GIT_FILEMODE_BLOB;
+  } else if (tracked != NULL &&
+             tracked->mode == GIT_FILEMODE_BLOB_EXECUTABLE) {
+    entry.mode = GIT_FILEMODE_BLOB_EXECUTABLE;
+  } else {
+    entry.mode = GIT_FILEMODE_BLOB;
+  }
+  git_oid_cpy(&entry.id, &file.id);
+  entry.path = path.c_str();
+  return git_index_add(index, &entry);
+}
+
+int GitAdd::runCommand() {
+  double start = nowMs();
+  git_index* index = NULL;
+  git_odb* odb = NULL;
+  git_config* config = NULL;
+  int fileMode = 1;
+  error = git_repository_index(&index, repo);
+  if (!error) {
+    error = git_repository_odb(&odb, repo);
+  }
+  if (!error && !git_repository_config(&config, repo) &&
+      git_config_get_bool(&fileMode, config, "core.filemode")) {
+    giterr_clear();
+  }
+  git_config_free(config);
+
+  const char* workdir = git_repository_workdir(repo);
+  _files.resize(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    _files[i].path = std::string(workdir ? workdir : "") + entries[i];
+  }
+
+  // Contents are held from hashing until they are written, so a batch at a
+  // time bounds the memory used.
+  for (_batchStart = 0; !error && _batchStart < _files.size();
+       _batchStart = _batchEnd) {
+    _batchEnd = std::min(_batchStart + kAddBatchFiles, _files.size());
+    size_t groups = (_batchEnd - _batchStart + kSha1Lanes - 1) / kSha1Lanes;
+    _gitSalt->workerPool()->parallelFor(groups, &GitAdd::hashFiles, this);
+
+    //TODO(grv) : This only works for filepaths. Add support for adding
+    // directory paths recursively.
+    for (size_t i = _batchStart; !error && i < _batchEnd; ++i) {
+      error = addFile(index, odb, fileMode != 0, entries[i], _files[i]);
+    }
+  }
+  _files.clear();
+
+  if (!error) {
+    error = git_index_write(index);
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  git_odb_free(odb);
+  git_index_free(index);
+
+  pp::VarDictionary arg;
+  arg.Set(kFilesWritten, (int) filesWritten);
+  arg.Set(kElapsed, nowMs() - start);
+  if (bytesStreamed > 0) {
+    arg.Set(kBytesStreamed, bytesStreamed);
+    arg.Set(kStreamMs, streamMs);
+  }
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int StatusCb(const char* path, unsigned int status, void* payload) {
+  pp::VarDictionary* statuses = (pp::VarDictionary*) payload;
+  statuses->Set(path, (int)status);
+  return 0;
+}
+
+namespace {
+unsigned int DeltaToStatus(git_delta_t delta, bool workdir) {
+  switch (delta) {
+    case GIT_DELTA_ADDED:
+      return workdir ? GIT_STATUS_WT_NEW : GIT_STATUS_INDEX_NEW;
+    case GIT_DELTA_UNTRACKED:
+      return GIT_STATUS_WT_NEW;
+    case GIT_DELTA_DELETED:
+      return workdir ? GIT_STATUS_WT_DELETED : GIT_STATUS_INDEX_DELETED;
+    case GIT_DELTA_MODIFIED:
+      return workdir ? GIT_STATUS_WT_MODIFIED : GIT_STATUS_INDEX_MODIFIED;
+    case GIT_DELTA_RENAMED:
+      return workdir ? GIT_STATUS_WT_RENAMED : GIT_STATUS_INDEX_RENAMED;
+    case GIT_DELTA_TYPECHANGE:
+      return workdir ? GIT_STATUS_WT_TYPECHANGE : GIT_STATUS_INDEX_TYPECHANGE;
+    case GIT_DELTA_IGNORED:
+      return GIT_STATUS_IGNORED;
+    default:
+      return GIT_STATUS_CURRENT;
+  }
+}
+
+/**
+ * Runs rename detection on |diff| and indexes the result by delta: the match
+ * each target takes part in, and the sources that were renamed away.
+ */
+void FindRenames(git_repository* repo,
+                 GitSaltInstance* gitSalt,
+                 git_diff* diff,
+                 const RenameOptions& options,
+                 std::vector<RenameMatch>& matches,
+                 std::vector<const RenameMatch*>& byTarget,
+                 std::vector<bool>& renamedAway) {
+  size_t numDeltas = git_diff_num_deltas(diff);
+  RenameDetector detector(repo, gitSalt->workerPool(),
+      gitSalt->similarityCache());
+  detector.detect(diff, options, matches);
+
+  byTarget.assign(numDeltas, NULL);
+  renamedAway.assign(numDeltas, false);
+  for (size_t i = 0; i < matches.size(); ++i) {
+    byTarget[matches[i].target] = &matches[i];
+    if (!matches[i].copy) {
+      renamedAway[matches[i].source] = true;
+    }
+  }
+}
+}
+
+bool GitStatus::sparsePathspec(git_index* index,
+                               std::vector<std::string>& specs,
+                               std::vector<char*>& pointers,
+                               git_strarray* pathspec) {
+  SparseCone cone;
+  if (cone.load(git_repository_path(repo)) || !cone.enabled()) {
+    return false;
+  }
+
+  cone.pathspecs(index, git_repository_workdir(repo), &specs);
+  for (size_t i = 0; i < specs.size(); ++i) {
+    pointers.push_back(const_cast<char*>(specs[i].c_str()));
+  }
+  pathspec->strings = pointers.empty() ? NULL : &pointers[0];
+  pathspec->count = pointers.size();
+  return true;
+}
+
+int GitStatus::parseArgs() {
+  if ((error = parseBool(_args, kRenames, &renames))) {
+  }
+
+  parseRenameOptions(renameOptions);
+  return 0;
+}
+
+void GitStatus::addStatuses(git_diff* diff,
+                            bool workdir,
+                            std::map<std::string, unsigned int>& statuses,
+                            pp::VarDictionary& renamed,
+                            pp::VarDictionary& copied) {
+  std::vector<RenameMatch> matches;
+  std::vector<const RenameMatch*> byTarget;
+  std::vector<bool> renamedAway;
+  FindRenames(repo, _gitSalt, diff, renameOptions, matches, byTarget,
+      renamedAway);
+
+  size_t numDeltas = git_diff_num_deltas(diff);
+  for (size_t i = 0; i < numDeltas; ++i) {
+    if (renamedAway[i]) {
+      continue;
+    }
+
+    const git_diff_delta* delta = git_diff_get_delta(diff, i);
+    unsigned int status = DeltaToStatus(delta->status, workdir);
+    const RenameMatch* match = byTarget[i];
+    if (match != NULL) {
+      const char* oldPath =
+          git_diff_get_delta(diff, match->source)->old_file.path;
+      if (match->copy) {
+        copied.Set(delta->new_file.path, oldPath);
+      } else {
+        status = workdir ? GIT_STATUS_WT_RENAMED : GIT_STATUS_INDEX_RENAMED;
+        renamed.Set(delta->new_file.path, oldPath);
+      }
+    }
+
+    const char* path = delta->status == GIT_DELTA_DELETED ?
+        delta->old_file.path : delta->new_file.path;
+    statuses[path] |= status;
+  }
+}
+
+int GitStatus::statusWithRenames(pp::VarDictionary& statuses,
+                                 pp::VarDictionary& renamed,
+                                 pp::VarDictionary& copied) {
+  git_tree* head = NULL;
+  git_index* index = NULL;
+  git_diff* staged = NULL;
+  git_diff* unstaged = NULL;
+
+  // An unborn HEAD is diffed as the empty tree.
+  if (lookupTree("HEAD", &head)) {
+    giterr_clear();
+  }
+
+  error = git_repository_index(&index, repo);
+  std::vector<std::string> specs;
+  std::vector<char*> specPointers;
+  if (!error) {
+    git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+    if (sparsePathspec(index, specs, specPointers, &options.pathspec)) {
+      options.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+    }
+    error = git_diff_tree_to_index(&staged, repo, head, index, &options);
+    if (!error) {
+      options.flags |= GIT_DIFF_INCLUDE_UNTRACKED |
+          GIT_DIFF_RECURSE_UNTRACKED_DIRS | GIT_DIFF_INCLUDE_IGNORED;
+      error = git_diff_index_to_workdir(&unstaged, repo, index, &options);
+    }
+  }
+
+  if (!error) {
+    std::map<std::string, unsigned int> flags;
+    addStatuses(staged, false, flags, renamed, copied);
+    addStatuses(unstaged, true, flags, renamed, copied);
+
+    for (std::map<std::string, unsigned int>::iterator it = flags.begin();
+         it != flags.end(); ++it) {
+      statuses.Set(it->first, (int) it->second);
+    }
+  }
+
+  git_diff_free(unstaged);
+  git_diff_free(staged);
+  git_index_free(index);
+  git_tree_free(head);
+  return error;
+}
+
+int GitStatus::runCommand() {
+
+  pp::VarDictionary statuses;
+  pp::VarDictionary renamed;
+  pp::VarDictionary copied;
+
+  git_index* index = NULL;
+  std::vector<std::string> specs;
+  std::vector<char*> specPointers;
+  git_status_options options = GIT_STATUS_OPTIONS_INIT;
+
+  if (renames) {
+    statusWithRenames(statuses, renamed, copied);
+  } else if (!git_repository_index(&index, repo) &&
+             sparsePathspec(index, specs, specPointers, &options.pathspec)) {
+    options.flags = GIT_STATUS_OPT_DEFAULTS |
+        GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    git_status_foreach_ext(repo, &options, StatusCb, &statuses);
+  } else {
+    git_status_cb cb = StatusCb;
+    git_status_foreach(repo, cb, &statuses);
+  }
+  git_index_free(index);
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  pp::VarDictionary arg;
+  arg.Set(kStatuses, statuses);
+  if (renames) {
+    arg.Set(kRenames, renamed);
+    arg.Set(kCopies, copied);
+  }
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int GitLsRemote::parseArgs() {
+  pp::VarArray entryArray;
+  if ((error = parseString(_args, kUrl, url))) {
+  }
+  return 0;
+}
+
+int GitLsRemote::runCommand() {
+  git_remote* remote = NULL;
+  error = git_remote_create_anonymous(&remote, repo, url.c_str(), NULL);
+
+  error = git_remote_connect(remote, GIT_DIRECTION_FETCH);
 
   size_t size = 0;
   git_remote_head** heads = NULL;
@@ -356,3 +1336,2201 @@ int GitLsRemote::runCommand() {
   _gitSalt->PostMessage(response);
   return 0;
 }
+
+int GitDiff::parseArgs() {
+  from = "HEAD";
+  if ((error = parseString(_args, kFrom, from))) {
+  }
+
+  if ((error = parseString(_args, kTo, to))) {
+  }
+
+  if ((error = parseBool(_args, kRenames, &renames))) {
+  }
+
+  parseRenameOptions(renameOptions);
+  return 0;
+}
+
+int GitDiff::runCommand() {
+  git_tree* fromTree = NULL;
+  git_tree* toTree = NULL;
+  git_diff* diff = NULL;
+  git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+
+  error = lookupTree(from, &fromTree);
+  if (!error) {
+    if (to.empty()) {
+      // Compare against the working directory, as "git diff <from>" does.
+      options.flags = GIT_DIFF_INCLUDE_UNTRACKED |
+          GIT_DIFF_RECURSE_UNTRACKED_DIRS;
+      error = git_diff_tree_to_workdir_with_index(&diff, repo, fromTree,
+          &options);
+    } else if (!(error = lookupTree(to, &toTree))) {
+      error = git_diff_tree_to_tree(&diff, repo, fromTree, toTree, &options);
+    }
+  }
+
+  pp::VarArray deltas;
+
+  if (!error) {
+    std::vector<RenameMatch> matches;
+    std::vector<const RenameMatch*> byTarget;
+    std::vector<bool> renamedAway;
+    if (renames) {
+      FindRenames(repo, _gitSalt, diff, renameOptions, matches, byTarget,
+          renamedAway);
+    }
+
+    size_t numDeltas = git_diff_num_deltas(diff);
+    int index = 0;
+    for (size_t i = 0; i < numDeltas; ++i) {
+      if (renames && renamedAway[i]) {
+        continue;
+      }
+
+      const git_diff_delta* delta = git_diff_get_delta(diff, i);
+      pp::VarDictionary entry;
+      entry.Set(kStatus, (int) delta->status);
+      entry.Set(kOldPath, delta->old_file.path);
+      entry.Set(kNewPath, delta->new_file.path);
+
+      const RenameMatch* match = renames ? byTarget[i] : NULL;
+      if (match != NULL) {
+        entry.Set(kStatus, (int) (match->copy ?
+            GIT_DELTA_COPIED : GIT_DELTA_RENAMED));
+        entry.Set(kOldPath,
+            git_diff_get_delta(diff, match->source)->old_file.path);
+        entry.Set(kSimilarity, match->similarity);
+      }
+      deltas.Set(index++, entry);
+    }
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  git_diff_free(diff);
+  git_tree_free(toTree);
+  git_tree_free(fromTree);
+
+  pp::VarDictionary arg;
+  arg.Set(kDeltas, deltas);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int GitBlame::parseArgs() {
+  if ((error = parseString(_args, kPath, path))) {
+  }
+
+  if ((error = parseString(_args, kCommit, commit))) {
+  }
+
+  if ((error = parseInt(_args, kMinLine, &minLine))) {
+  }
+
+  if ((error = parseInt(_args, kMaxLine, &maxLine))) {
+  }
+
+  if ((error = parseInt(_args, kChunkLines, &chunkLines))) {
+  }
+  return 0;
+}
+
+int GitBlame::countLines(git_commit* commit, uint32_t* lineCount) {
+  git_tree* tree = NULL;
+  git_tree_entry* entry = NULL;
+  git_blob* blob = NULL;
+
+  int r = git_commit_tree(&tree, commit);
+  if (!r && !(r = git_tree_entry_bypath(&entry, tree, path.c_str()))) {
+    r = git_blob_lookup(&blob, repo, git_tree_entry_id(entry));
+  }
+
+  if (!r) {
+    const char* data = (const char*) git_blob_rawcontent(blob);
+    size_t size = (size_t) git_blob_rawsize(blob);
+    uint32_t count = 0;
+    for (size_t i = 0; i < size; ++i) {
+      if (data[i] == '\n') {
+        count++;
+      }
+    }
+    if (size && data[size - 1] != '\n') {
+      count++;
+    }
+    *lineCount = count;
+  }
+
+  git_blob_free(blob);
+  git_tree_entry_free(entry);
+  git_tree_free(tree);
+  return r;
+}
+
+int GitBlame::blameRange(const git_oid& commitId, uint32_t first,
+                         uint32_t last, BlameCache::Entry* entry) {
+  git_blame* blame = NULL;
+  git_blame_options options = GIT_BLAME_OPTIONS_INIT;
+  options.newest_commit = commitId;
+  options.min_line = first;
+  options.max_line = last;
+
+  int r = git_blame_file(&blame, repo, path.c_str(), &options);
+  if (r) {
+    return r;
+  }
+
+  std::vector<BlameHunk> hunks;
+  uint32_t count = git_blame_get_hunk_count(blame);
+  for (uint32_t i = 0; i < count; ++i) {
+    const git_blame_hunk* source = git_blame_get_hunk_byindex(blame, i);
+    BlameHunk hunk;
+    hunk.start = source->final_start_line_number;
+    hunk.lines = source->lines_in_hunk;
+    hunk.commit = source->final_commit_id;
+    hunk.origPath = source->orig_path ? source->orig_path : "";
+    hunk.origStart = source->orig_start_line_number;
+    hunk.time = 0;
+    if (source->final_signature != NULL) {
+      hunk.author = source->final_signature->name;
+      hunk.email = source->final_signature->email;
+      hunk.time = source->final_signature->when.time;
+    }
+    hunk.boundary = source->boundary != 0;
+    hunks.push_back(hunk);
+  }
+  git_blame_free(blame);
+
+  for (uint32_t line = first; line <= last; ++line) {
+    entry->covered[line - 1] = true;
+  }
+  entry->hunks.insert(entry->hunks.end(), hunks.begin(), hunks.end());
+
+  postHunks(hunks, false);
+  return 0;
+}
+
+void GitBlame::postHunks(const std::vector<BlameHunk>& hunks, bool done,
+                         int error) {
+  pp::VarArray list;
+  for (size_t i = 0; i < hunks.size(); ++i) {
+    const BlameHunk& hunk = hunks[i];
+    pp::VarDictionary item;
+    item.Set(kStart, (int) hunk.start);
+    item.Set(kLines, (int) hunk.lines);
+    item.Set(kCommit, oidToString(&hunk.commit));
+    item.Set(kOrigPath, hunk.origPath);
+    item.Set(kOrigStart, (int) hunk.origStart);
+    item.Set(kName, hunk.author);
+    item.Set(kEmail, hunk.email);
+    item.Set(kTime, (double) hunk.time);
+    item.Set(kBoundary, hunk.boundary);
+    list.Set(i, item);
+  }
+
+  pp::VarDictionary arg;
+  arg.Set(kHunks, list);
+  arg.Set(kDone, done);
+  if (done) {
+    setOutcome(error, arg);
+  }
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+}
+
+int GitBlame::runCommand() {
+  git_commit* target = NULL;
+  BlameCache::Entry* entry = NULL;
+
+  error = lookupCommit(commit, &target);
+  if (!error) {
+    bool created;
+    entry = _gitSalt->blameCache()->get(path, *git_commit_id(target),
+        &created);
+    if (created || entry->lineCount == 0) {
+      error = countLines(target, &entry->lineCount);
+      entry->covered.assign(entry->lineCount, false);
+    }
+  }
+
+  if (!error) {
+    uint32_t first = minLine > 1 ? minLine : 1;
+    uint32_t last = entry->lineCount;
+    if (maxLine > 0 && (uint32_t) maxLine < last) {
+      last = maxLine;
+    }
+    // Every git_blame_file walks the history again, so only a narrowed
+    // request, such as a viewport, is worth splitting into chunks.
+    bool narrowed = minLine > 1 || maxLine > 0;
+    uint32_t step = narrowed && chunkLines > 0 ? chunkLines :
+        entry->lineCount;
+
+    // Whatever is known already goes out first.
+    std::vector<BlameHunk> cached;
+    for (size_t i = 0; i < entry->hunks.size(); ++i) {
+      const BlameHunk& hunk = entry->hunks[i];
+      if (hunk.start <= last && hunk.start + hunk.lines > first) {
+        cached.push_back(hunk);
+      }
+    }
+    if (!cached.empty()) {
+      postHunks(cached, false);
+    }
+
+    // Then the missing lines, a chunk at a time.
+    uint32_t line = first;
+    while (!error && line <= last) {
+      if (entry->covered[line - 1]) {
+        line++;
+        continue;
+      }
+      uint32_t end = line;
+      while (end < last && end - line + 1 < step && !entry->covered[end]) {
+        end++;
+      }
+      error = blameRange(*git_commit_id(target), line, end, entry);
+      line = end + 1;
+    }
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  git_commit_free(target);
+
+  postHunks(std::vector<BlameHunk>(), true, error);
+  return 0;
+}
+
+int GitLsTree::parseArgs() {
+  if ((error = parseString(_args, kRev, rev))) {
+  }
+
+  if ((error = parseString(_args, kTree, tree))) {
+  }
+
+  if ((error = parseString(_args, kPath, path))) {
+  }
+
+  if ((error = parseInt(_args, kOffset, &offset))) {
+  }
+
+  if ((error = parseInt(_args, kLimit, &limit))) {
+  }
+  return 0;
+}
+
+int GitLsTree::resolveTree(git_oid* id) {
+  if (!tree.empty()) {
+    return git_oid_fromstr(id, tree.c_str());
+  }
+
+  git_tree* root = NULL;
+  int r = lookupTree(rev, &root);
+  if (r) {
+    return r;
+  }
+
+  if (path.empty()) {
+    git_oid_cpy(id, git_tree_id(root));
+  } else {
+    git_tree_entry* entry = NULL;
+    r = git_tree_entry_bypath(&entry, root, path.c_str());
+    if (!r) {
+      if (git_tree_entry_type(entry) == GIT_OBJ_TREE) {
+        git_oid_cpy(id, git_tree_entry_id(entry));
+      } else {
+        giterr_set_str(GITERR_INVALID, (path + " is not a tree").c_str());
+        r = GIT_ENOTFOUND;
+      }
+      git_tree_entry_free(entry);
+    }
+  }
+  git_tree_free(root);
+  return r;
+}
+
+int GitLsTree::runCommand() {
+  git_oid treeId;
+  TreeListing* listing = NULL;
+
+  error = resolveTree(&treeId);
+  if (!error) {
+    listing = _gitSalt->treeCache()->get(repo, treeId, &error);
+  }
+
+  pp::VarDictionary arg;
+  pp::VarArray entries;
+
+  if (!error) {
+    git_odb* odb = NULL;
+    size_t begin = offset > 0 ? offset : 0;
+    size_t end = listing->size();
+    if (limit >= 0 && begin + limit < end) {
+      end = begin + limit;
+    }
+
+    for (size_t i = begin; i < end; ++i) {
+      TreeListingEntry& item = (*listing)[i];
+      // Sizes are looked up for the requested page only, and remembered.
+      if (item.size < 0 && item.type == GIT_OBJ_BLOB &&
+          (odb != NULL || !git_repository_odb(&odb, repo))) {
+        size_t size;
+        git_otype type;
+        if (!git_odb_read_header(&size, &type, odb, &item.id)) {
+          item.size = size;
+        }
+      }
+
+      pp::VarDictionary entry;
+      entry.Set(kName, item.name);
+      entry.Set(kMode, (int) item.mode);
+      entry.Set(kType, git_object_type2string(item.type));
+      entry.Set(kId, oidToString(&item.id));
+      if (item.size >= 0) {
+        entry.Set(kSize, (double) item.size);
+      }
+      entries.Set(i - begin, entry);
+    }
+    git_odb_free(odb);
+
+    arg.Set(kTree, oidToString(&treeId));
+    arg.Set(kTotal, (int) listing->size());
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  arg.Set(kEntries, entries);
+  setOutcome(error, arg);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int GitReadBlob::parseArgs() {
+  if ((error = parseString(_args, kId, id))) {
+  }
+
+  if ((error = parseString(_args, kRev, rev))) {
+  }
+
+  if ((error = parseString(_args, kPath, path))) {
+  }
+
+  if ((error = parseInt(_args, kOffset, &offset))) {
+  }
+
+  if ((error = parseInt(_args, kLength, &length))) {
+  }
+  return 0;
+}
+
+int GitReadBlob::resolveBlob(git_oid* blobId) {
+  if (!id.empty()) {
+    return git_oid_fromstr(blobId, id.c_str());
+  }
+
+  git_tree* root = NULL;
+  git_tree_entry* entry = NULL;
+  int r = lookupTree(rev, &root);
+  if (!r && !(r = git_tree_entry_bypath(&entry, root, path.c_str()))) {
+    if (git_tree_entry_type(entry) == GIT_OBJ_BLOB) {
+      git_oid_cpy(blobId, git_tree_entry_id(entry));
+    } else {
+      giterr_set_str(GITERR_INVALID, (path + " is not a blob").c_str());
+      r = GIT_ENOTFOUND;
+    }
+  }
+  git_tree_entry_free(entry);
+  git_tree_free(root);
+  return r;
+}
+
+int GitReadBlob::runCommand() {
+  git_oid blobId;
+  git_blob* blob = NULL;
+
+  pp::VarDictionary arg;
+
+  error = resolveBlob(&blobId);
+  if (!error) {
+    error = git_blob_lookup(&blob, repo, &blobId);
+  }
+
+  if (!error) {
+    size_t size = (size_t) git_blob_rawsize(blob);
+    size_t begin = offset > 0 ? offset : 0;
+    if (begin > size) {
+      begin = size;
+    }
+    size_t count = size - begin;
+    if (length >= 0 && (size_t) length < count) {
+      count = length;
+    }
+
+    // The inflated object is copied once, straight into the buffer that is
+    // handed to JavaScript.
+    pp::VarArrayBuffer data(count);
+    if (count) {
+      memcpy(data.Map(), (const char*) git_blob_rawcontent(blob) + begin,
+          count);
+      data.Unmap();
+    }
+
+    arg.Set(kId, oidToString(&blobId));
+    arg.Set(kSize, (double) size);
+    arg.Set(kOffset, (double) begin);
+    arg.Set(kData, data);
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  setOutcome(error, arg);
+  git_blob_free(blob);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int GitResolve::parseArgs() {
+  pp::VarArray revArray;
+  if ((error = parseArray(_args, kRevs, revArray))) {
+  }
+
+  uint32_t length = revArray.GetLength();
+  for (uint32_t i = 0; i < length; ++i) {
+    revs.push_back(revArray.Get(i).AsString());
+  }
+  return 0;
+}
+
+namespace {
+// The revision cache is only invalidated by the refs. Index paths (":path",
+// ":0:path"), reflog entries ("@{1}", "@{yesterday}", "@{upstream}") and
+// prefetched refs, which the ref fingerprint leaves out, can change without
+// that, so they are always resolved afresh.
+bool IsCacheableSpec(const std::string& spec) {
+  return (spec.empty() || spec[0] != ':') &&
+      spec.find("@{") == std::string::npos &&
+      spec.find("refs/prefetch/") == std::string::npos;
+}
+}
+
+int GitResolve::resolve(const std::string& spec, ResolvedRevision* resolved) {
+  git_object* object = NULL;
+  git_odb* odb = NULL;
+  size_t size = 0;
+
+  int r = git_revparse_single(&object, repo, spec.c_str());
+  if (!r) {
+    git_oid_cpy(&resolved->id, git_object_id(object));
+    r = git_repository_odb(&odb, repo);
+  }
+  // Only the header is read, so sizing a large blob stays cheap.
+  if (!r) {
+    r = git_odb_read_header(&size, &resolved->type, odb, &resolved->id);
+    resolved->size = size;
+  }
+  git_odb_free(odb);
+  git_object_free(object);
+  return r;
+}
+
+int GitResolve::runCommand() {
+  RevisionCache* cache = _gitSalt->revisionCache();
+  RefState* refState = _gitSalt->refState();
+  refState->refresh(git_repository_path(repo));
+  cache->validate(refState->generation());
+
+  pp::VarArray ids;
+  pp::VarArray types;
+  pp::VarArray sizes;
+  for (size_t i = 0; i < revs.size(); ++i) {
+    ResolvedRevision resolved;
+    bool cacheable = IsCacheableSpec(revs[i]);
+    if (!cacheable || !cache->lookup(revs[i], &resolved)) {
+      if (resolve(revs[i], &resolved)) {
+        giterr_clear();
+        ids.Set(i, "");
+        types.Set(i, "");
+        sizes.Set(i, -1);
+        continue;
+      }
+      if (cacheable) {
+        cache->insert(revs[i], resolved);
+      }
+    }
+    ids.Set(i, oidToString(&resolved.id));
+    types.Set(i, git_object_type2string(resolved.type));
+    sizes.Set(i, (double) resolved.size);
+  }
+
+  pp::VarDictionary arg;
+  arg.Set(kIds, ids);
+  arg.Set(kTypes, types);
+  arg.Set(kSizes, sizes);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int GitSubscribe::parseArgs() {
+  if ((error = parseInt(_args, kInterval, &interval))) {
+  }
+  return 0;
+}
+
+int GitSubscribe::runCommand() {
+  _gitSalt->refWatcher()->start(git_repository_path(repo), subject,
+      interval);
+  return 0;
+}
+
+int GitUnsubscribe::parseArgs() {
+  return 0;
+}
+
+int GitUnsubscribe::runCommand() {
+  _gitSalt->refWatcher()->stop();
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, pp::VarDictionary());
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+namespace {
+const size_t kGrepChunkFiles = 32;
+// Longer matching lines are cut, so a minified file cannot flood the reply.
+const size_t kGrepMaxLineLength = 256;
+// Like git, a NUL in the first 8000 bytes marks a file as binary.
+const size_t kBinaryProbeBytes = 8000;
+const int kDefaultMaxResults = 1000;
+
+bool IsBinary(const std::string& data) {
+  return memchr(data.data(), 0, std::min(data.size(), kBinaryProbeBytes)) !=
+      NULL;
+}
+}
+
+GitGrep::GitGrep(GitSaltInstance* git_salt,
+                 const std::string& subject,
+                 const pp::VarDictionary& args,
+                 git_repository*& repo)
+    : GitCommand(git_salt, subject, args, repo), _count(0),
+      _filesSearched(0), _truncated(false), regex(false), ignoreCase(false),
+      cached(false), maxResults(kDefaultMaxResults) {
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+GitGrep::~GitGrep() {
+  pthread_mutex_destroy(&_mutex);
+}
+
+int GitGrep::parseArgs() {
+  if ((error = parseString(_args, kPattern, pattern))) {
+  }
+
+  if ((error = parseString(_args, kRev, rev))) {
+  }
+
+  if ((error = parseBool(_args, kRegex, &regex))) {
+  }
+
+  if ((error = parseBool(_args, kIgnoreCase, &ignoreCase))) {
+  }
+
+  if ((error = parseBool(_args, kCached, &cached))) {
+  }
+
+  if ((error = parseInt(_args, kMaxResults, &maxResults))) {
+  }
+  return 0;
+}
+
+int GitGrep::collectTreeEntry(const char* root, const git_tree_entry* entry,
+    void* payload) {
+  GitGrep* grep = static_cast<GitGrep*>(payload);
+  // Symlink targets are not searched; submodules are not blobs.
+  if (git_tree_entry_type(entry) != GIT_OBJ_BLOB ||
+      git_tree_entry_filemode(entry) == GIT_FILEMODE_LINK) {
+    return 0;
+  }
+  GrepFile file;
+  file.path = std::string(root) + git_tree_entry_name(entry);
+  git_oid_cpy(&file.id, git_tree_entry_id(entry));
+  file.onDisk = false;
+  grep->_files.push_back(file);
+  return 0;
+}
+
+int GitGrep::collectTreeFiles() {
+  git_tree* tree = NULL;
+  int r = lookupTree(rev, &tree);
+  if (!r) {
+    r = git_tree_walk(tree, GIT_TREEWALK_PRE, &GitGrep::collectTreeEntry,
+        this);
+  }
+  git_tree_free(tree);
+  return r;
+}
+
+int GitGrep::collectFiles(pp::VarDictionary& arg) {
+  return rev.empty() ? collectIndexFiles() : collectTreeFiles();
+}
+
+int GitGrep::collectIndexFiles() {
+  git_index* index = NULL;
+  int r = git_repository_index(&index, repo);
+  if (r) {
+    return r;
+  }
+
+  const char* workdir = git_repository_workdir(repo);
+  _workdir = workdir ? workdir : "";
+  size_t count = git_index_entrycount(index);
+  for (size_t i = 0; i < count; ++i) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    // A conflicted path has up to three stages but one working copy. Paths
+    // outside the sparse cone have none.
+    if ((!cached && !_files.empty() && _files.back().path == entry->path) ||
+        (cached && GIT_IDXENTRY_STAGE(entry) != 0) ||
+        (!cached && (entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE)) ||
+        entry->mode == GIT_FILEMODE_LINK ||
+        entry->mode == GIT_FILEMODE_COMMIT) {
+      continue;
+    }
+    GrepFile file;
+    file.path = entry->path;
+    git_oid_cpy(&file.id, &entry->id);
+    file.onDisk = !cached;
+    _files.push_back(file);
+  }
+  git_index_free(index);
+  return 0;
+}
+
+bool GitGrep::readFile(const GrepFile& file, std::string* data) {
+  if (!file.onDisk) {
+    git_blob* blob = NULL;
+    if (git_blob_lookup(&blob, repo, &file.id)) {
+      return false;
+    }
+    data->assign((const char*) git_blob_rawcontent(blob),
+        (size_t) git_blob_rawsize(blob));
+    git_blob_free(blob);
+    return true;
+  }
+
+  // Deleted or unreadable working files are skipped.
+  FILE* f = fopen((_workdir + file.path).c_str(), "rb");
+  if (f == NULL) {
+    return false;
+  }
+  char buffer[16384];
+  size_t read;
+  data->clear();
+  while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    data->append(buffer, read);
+  }
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+bool GitGrep::addMatch(size_t lineNumber, const char* line, size_t length,
+    void* payload) {
+  ChunkMatches* chunk = static_cast<ChunkMatches*>(payload);
+  if (length > 0 && line[length - 1] == '\r') {
+    length--;
+  }
+  GrepMatch match;
+  match.file = chunk->file;
+  match.line = lineNumber;
+  match.text.assign(line, std::min(length, kGrepMaxLineLength));
+  chunk->matches.push_back(match);
+  return chunk->matches.size() < chunk->limit;
+}
+
+void GitGrep::searchFiles(size_t index, void* payload) {
+  GitGrep* grep = static_cast<GitGrep*>(payload);
+  size_t begin = index * kGrepChunkFiles;
+  size_t end = std::min(begin + kGrepChunkFiles, grep->_files.size());
+
+  pthread_mutex_lock(&grep->_mutex);
+  bool truncated = grep->_truncated;
+  pthread_mutex_unlock(&grep->_mutex);
+  if (truncated) {
+    return;
+  }
+
+  // No chunk needs more lines than the whole reply may hold; one more shows
+  // that it was cut.
+  ChunkMatches chunk;
+  chunk.limit = grep->maxResults + 1;
+  size_t searched = 0;
+  std::string data;
+  for (size_t i = begin; i < end && chunk.matches.size() < chunk.limit; ++i) {
+    if (!grep->readFile(grep->_files[i], &data) || IsBinary(data)) {
+      continue;
+    }
+    chunk.file = i;
+    grep->_pattern.matchLines(data.data(), data.size(), &GitGrep::addMatch,
+        &chunk);
+    searched++;
+  }
+
+  pthread_mutex_lock(&grep->_mutex);
+  grep->_filesSearched += searched;
+  size_t room = grep->maxResults - grep->_count;
+  if (chunk.matches.size() > room) {
+    chunk.matches.resize(room);
+    grep->_truncated = true;
+  }
+  grep->_count += chunk.matches.size();
+  // Posted under the lock so batches never interleave with the final reply.
+  if (!chunk.matches.empty()) {
+    grep->postMatches(chunk.matches);
+  }
+  pthread_mutex_unlock(&grep->_mutex);
+}
+
+void GitGrep::postMatches(const std::vector<GrepMatch>& matches) {
+  pp::VarArray list;
+  for (size_t i = 0; i < matches.size(); ++i) {
+    pp::VarDictionary item;
+    item.Set(kPath, _files[matches[i].file].path);
+    item.Set(kLine, (int) matches[i].line);
+    item.Set(kText, matches[i].text);
+    list.Set(i, item);
+  }
+
+  pp::VarDictionary arg;
+  arg.Set(kMatches, list);
+  arg.Set(kDone, false);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+}
+
+int GitGrep::runCommand() {
+  double start = nowMs();
+  std::string message;
+  pp::VarDictionary arg;
+
+  error = 0;
+  if (maxResults <= 0) {
+    maxResults = kDefaultMaxResults;
+  }
+  if (!_pattern.compile(pattern, regex, ignoreCase, &message)) {
+    error = GIT_ERROR;
+  } else {
+    error = collectFiles(arg);
+  }
+
+  if (!error) {
+    size_t chunks = (_files.size() + kGrepChunkFiles - 1) / kGrepChunkFiles;
+    _gitSalt->workerPool()->parallelFor(chunks, &GitGrep::searchFiles, this);
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  if (!message.empty()) {
+    arg.Set(kMessage, message);
+  }
+  arg.Set(kMatches, pp::VarArray());
+  arg.Set(kCount, (int) _count);
+  arg.Set(kTruncated, _truncated);
+  arg.Set(kFilesSearched, (int) _filesSearched);
+  arg.Set(kElapsed, nowMs() - start);
+  arg.Set(kDone, true);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int GitSearch::parseArgs() {
+  GitGrep::parseArgs();
+  if (rev.empty()) {
+    rev = "HEAD";
+  }
+  return 0;
+}
+
+int GitSearch::collectFiles(pp::VarDictionary& arg) {
+  double start = nowMs();
+  TrigramIndex* index = _gitSalt->trigramIndex();
+  git_tree* tree = NULL;
+  int r = lookupTree(rev, &tree);
+  if (!r) {
+    r = index->update(repo, *git_tree_id(tree), _gitSalt->workerPool());
+  }
+  git_tree_free(tree);
+  if (r) {
+    return r;
+  }
+
+  std::vector<const TrigramIndex::File*> candidates;
+  index->candidates(regex ? "" : pattern, &candidates);
+  _files.resize(candidates.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    _files[i].path = candidates[i]->path;
+    git_oid_cpy(&_files[i].id, &candidates[i]->id);
+    _files[i].onDisk = false;
+  }
+
+  arg.Set(kBlobsIndexed, (int) index->lastIndexed());
+  arg.Set(kCandidates, (int) candidates.size());
+  arg.Set(kIndexMs, nowMs() - start);
+  return 0;
+}
+
+namespace {
+// Streamed archives are posted in chunks of this size.
+const size_t kArchiveChunkBytes = 1 << 20;
+}
+
+int GitArchive::parseArgs() {
+  if ((error = parseString(_args, kRev, rev))) {
+  }
+
+  if ((error = parseString(_args, kFormat, format))) {
+  }
+
+  if ((error = parseString(_args, kPrefix, prefix))) {
+  }
+
+  if ((error = parseString(_args, kPath, path))) {
+  }
+  return 0;
+}
+
+int GitArchive::writeData(const char* data, size_t size, void* payload) {
+  GitArchive* archive = static_cast<GitArchive*>(payload);
+  if (archive->_file != NULL) {
+    return fwrite(data, 1, size, archive->_file) == size ? 0 : GIT_ERROR;
+  }
+  archive->_chunk.append(data, size);
+  if (archive->_chunk.size() >= kArchiveChunkBytes) {
+    archive->postChunk();
+  }
+  return 0;
+}
+
+void GitArchive::postChunk() {
+  pp::VarArrayBuffer data(_chunk.size());
+  if (!_chunk.empty()) {
+    memcpy(data.Map(), _chunk.data(), _chunk.size());
+    data.Unmap();
+  }
+  _chunk.clear();
+
+  pp::VarDictionary arg;
+  arg.Set(kData, data);
+  arg.Set(kDone, false);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+}
+
+int GitArchive::runCommand() {
+  double start = nowMs();
+  git_commit* commit = NULL;
+  git_tree* tree = NULL;
+  std::string message;
+  ArchiveWriter::Format type = ArchiveWriter::kZip;
+
+  error = 0;
+  if (format == "tar") {
+    type = ArchiveWriter::kTar;
+  } else if (format != "zip") {
+    message = "unknown archive format: " + format;
+    error = GIT_ERROR;
+  }
+  if (!error) {
+    error = lookupCommit(rev, &commit);
+  }
+  if (!error) {
+    error = git_commit_tree(&tree, commit);
+  }
+  if (!error && !path.empty()) {
+    _gitSalt->EnsureMounted(path);
+    _file = fopen(path.c_str(), "wb");
+  }
+  if (!error && !path.empty() && _file == NULL) {
+    message = "cannot write " + path;
+    error = GIT_ERROR;
+  }
+
+  ArchiveWriter writer(type, _gitSalt->workerPool(), &GitArchive::writeData,
+      this);
+  if (!error) {
+    error = writer.write(repo, tree, prefix, git_commit_time(commit));
+  }
+  if (_file != NULL) {
+    if (fclose(_file) && !error) {
+      message = "cannot write " + path;
+      error = GIT_ERROR;
+    }
+    if (error) {
+      unlink(path.c_str());
+    }
+    _file = NULL;
+  } else if (!error && !_chunk.empty()) {
+    postChunk();
+  }
+  _chunk.clear();
+
+  git_tree_free(tree);
+  git_commit_free(commit);
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+    if (error && message.empty()) {
+      message = a->message;
+    }
+  }
+
+  pp::VarDictionary arg;
+  if (error) {
+    arg.Set(kMessage, message);
+  }
+  arg.Set(kFilesWritten, (int) writer.files());
+  arg.Set(kBytes, writer.bytesIn());
+  arg.Set(kSize, writer.bytesOut());
+  arg.Set(kElapsed, nowMs() - start);
+  arg.Set(kDone, true);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+namespace {
+// Adds up the files below |path| and their sizes.
+void CountFiles(const std::string& path, size_t* files, double* bytes) {
+  struct stat st;
+  if (stat(path.c_str(), &st)) {
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    (*files)++;
+    *bytes += st.st_size;
+    return;
+  }
+
+  DIR* dir = opendir(path.c_str());
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+      CountFiles(path + "/" + entry->d_name, files, bytes);
+    }
+  }
+  closedir(dir);
+}
+
+bool IsFanoutDir(const char* name) {
+  return strlen(name) == 2 && isxdigit(name[0]) && isxdigit(name[1]);
+}
+
+// Once there are this many packs, maintenance repacks everything reachable
+// into one so lookups don't have to search each of them.
+const size_t kMaxPacks = 8;
+}
+
+int GitMaintenance::parseArgs() {
+  if ((error = parseBool(_args, kIdle, &idle))) {
+  }
+  return 0;
+}
+
+void GitMaintenance::measure(size_t* files, double* bytes) {
+  *files = 0;
+  *bytes = 0;
+  CountFiles(_gitDir + "objects", files, bytes);
+  CountFiles(_gitDir + "refs", files, bytes);
+  CountFiles(_gitDir + "packed-refs", files, bytes);
+}
+
+void GitMaintenance::collectLooseObjects(std::vector<LooseObject>& objects) {
+  std::string objectsDir = _gitDir + "objects/";
+  DIR* dir = opendir(objectsDir.c_str());
+  if (dir == NULL) {
+    return;
+  }
+
+  struct dirent* fanout;
+  while ((fanout = readdir(dir)) != NULL) {
+    if (!IsFanoutDir(fanout->d_name)) {
+      continue;
+    }
+    std::string fanoutDir = objectsDir + fanout->d_name;
+    DIR* files = opendir(fanoutDir.c_str());
+    if (files == NULL) {
+      continue;
+    }
+    struct dirent* file;
+    while ((file = readdir(files)) != NULL) {
+      std::string hex = std::string(fanout->d_name) + file->d_name;
+      LooseObject object;
+      // Temporary files and anything else that is not an object is skipped.
+      if (hex.length() == GIT_OID_HEXSZ &&
+          !git_oid_fromstr(&object.id, hex.c_str())) {
+        object.path = fanoutDir + "/" + file->d_name;
+        objects.push_back(object);
+      }
+    }
+    closedir(files);
+  }
+  closedir(dir);
+}
+
+// Packs kept with a .keep file are left out, so they are never superseded.
+void GitMaintenance::listPacks(std::set<std::string>* packs) {
+  std::string packDir = _gitDir + "objects/pack/";
+  DIR* dir = opendir(packDir.c_str());
+  if (dir == NULL) {
+    return;
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name = entry->d_name;
+    if (name.compare(0, 5, "pack-") ||
+        name.length() < 10 ||
+        name.compare(name.length() - 5, 5, ".pack")) {
+      continue;
+    }
+    std::string base = packDir + name.substr(0, name.length() - 5);
+    struct stat st;
+    if (stat((base + ".keep").c_str(), &st)) {
+      packs->insert(base);
+    }
+  }
+  closedir(dir);
+}
+
+// Pushes the commits recorded in the reflog of |name|, so "HEAD@{1}",
+// "stash@{2}" and commits dropped by a reset or an amend survive a repack.
+// Entries whose commits are already gone are skipped.
+void GitMaintenance::pushReflog(git_revwalk* walk, const char* name) {
+  git_reflog* reflog = NULL;
+  if (git_reflog_read(&reflog, repo, name)) {
+    giterr_clear();
+    return;
+  }
+
+  size_t count = git_reflog_entrycount(reflog);
+  for (size_t i = 0; i < count; ++i) {
+    const git_reflog_entry* entry = git_reflog_entry_byindex(reflog, i);
+    const git_oid* ids[2] = {
+      git_reflog_entry_id_old(entry),
+      git_reflog_entry_id_new(entry)
+    };
+    for (size_t j = 0; j < 2; ++j) {
+      if (!git_oid_iszero(ids[j]) && git_revwalk_push(walk, ids[j])) {
+        giterr_clear();
+      }
+    }
+  }
+  git_reflog_free(reflog);
+}
+
+// Adds every object reachable from the refs, their reflogs, HEAD and the
+// index.
+int GitMaintenance::insertReachable(git_packbuilder* packbuilder) {
+  git_revwalk* walk = NULL;
+  git_reference_iterator* refs = NULL;
+  git_reference* ref = NULL;
+  git_index* index = NULL;
+
+  int r = git_revwalk_new(&walk, repo);
+  if (!r) {
+    r = git_reference_iterator_new(&refs, repo);
+  }
+  while (!r && !(r = git_reference_next(&ref, refs))) {
+    pushReflog(walk, git_reference_name(ref));
+    git_oid id;
+    git_otype type = GIT_OBJ_BAD;
+    if (git_reference_type(ref) == GIT_REF_OID) {
+      git_oid_cpy(&id, git_reference_target(ref));
+      git_object* object = NULL;
+      r = git_object_lookup(&object, repo, &id, GIT_OBJ_ANY);
+      if (!r) {
+        type = git_object_type(object);
+      }
+      git_object_free(object);
+    }
+    // Annotated tags go in along with whatever they point at.
+    while (!r && type == GIT_OBJ_TAG) {
+      git_tag* tag = NULL;
+      r = git_packbuilder_insert(packbuilder, &id, NULL);
+      if (!r) {
+        r = git_tag_lookup(&tag, repo, &id);
+      }
+      if (!r) {
+        git_oid_cpy(&id, git_tag_target_id(tag));
+        type = git_tag_target_type(tag);
+      }
+      git_tag_free(tag);
+    }
+    if (!r && type == GIT_OBJ_COMMIT) {
+      r = git_revwalk_push(walk, &id);
+    } else if (!r && type == GIT_OBJ_TREE) {
+      r = git_packbuilder_insert_tree(packbuilder, &id);
+    } else if (!r && type == GIT_OBJ_BLOB) {
+      r = git_packbuilder_insert(packbuilder, &id, NULL);
+    }
+    git_reference_free(ref);
+    ref = NULL;
+  }
+  if (r == GIT_ITEROVER) {
+    r = 0;
+    giterr_clear();
+  }
+
+  if (!r) {
+    pushReflog(walk, "HEAD");
+  }
+  if (!r && git_repository_head_detached(repo) == 1) {
+    r = git_revwalk_push_head(walk);
+  }
+  git_oid id;
+  while (!r && !(r = git_revwalk_next(&id, walk))) {
+    r = git_packbuilder_insert_commit(packbuilder, &id);
+  }
+  if (r == GIT_ITEROVER) {
+    r = 0;
+    giterr_clear();
+  }
+
+  // Staged content has no commit yet but must survive the repack.
+  if (!r && !git_repository_is_bare(repo)) {
+    r = git_repository_index(&index, repo);
+  }
+  size_t count = index != NULL ? git_index_entrycount(index) : 0;
+  for (size_t i = 0; !r && i < count; ++i) {
+    const git_index_entry* entry = git_index_get_byindex(index, i);
+    if (entry->mode != GIT_FILEMODE_COMMIT) {
+      r = git_packbuilder_insert(packbuilder, &entry->id, NULL);
+    }
+  }
+
+  git_index_free(index);
+  git_reference_iterator_free(refs);
+  git_revwalk_free(walk);
+  return r;
+}
+
+int GitMaintenance::packObjects(const std::vector<LooseObject>& objects,
+                                bool all) {
+  git_packbuilder* packbuilder = NULL;
+  int r = git_packbuilder_new(&packbuilder, repo);
+  if (!r) {
+    git_packbuilder_set_threads(packbuilder,
+        _gitSalt->workerPool()->size());
+  }
+  if (!r && all) {
+    r = insertReachable(packbuilder);
+  }
+  // Loose objects go in either way; unreachable ones stay until they are
+  // packed, as before.
+  for (size_t i = 0; !r && i < objects.size(); ++i) {
+    r = git_packbuilder_insert(packbuilder, &objects[i].id, NULL);
+  }
+  if (!r) {
+    std::string packDir = _gitDir + "objects/pack";
+    r = git_packbuilder_write(packbuilder, packDir.c_str(), 0,
+        &GitCommand::yieldProgress, this);
+  }
+  if (!r) {
+    objectsPacked = git_packbuilder_object_count(packbuilder);
+  }
+  git_packbuilder_free(packbuilder);
+  return r;
+}
+
+void GitMaintenance::pruneObjects(const std::vector<LooseObject>& objects) {
+  for (size_t i = 0; i < objects.size(); ++i) {
+    unlink(objects[i].path.c_str());
+  }
+  // Fan-out directories that are now empty go as well; rmdir leaves the
+  // others alone.
+  for (size_t i = 0; i < objects.size(); ++i) {
+    const std::string& path = objects[i].path;
+    rmdir(path.substr(0, path.rfind('/')).c_str());
+  }
+}
+
+// Removes the packs a full repack replaced. Nothing is removed unless the
+// repack produced a pack that was not there before.
+void GitMaintenance::prunePacks(const std::set<std::string>& superseded) {
+  std::set<std::string> packs;
+  listPacks(&packs);
+  bool written = false;
+  for (std::set<std::string>::const_iterator it = packs.begin();
+       it != packs.end(); ++it) {
+    written = written || !superseded.count(*it);
+  }
+  if (!written) {
+    return;
+  }
+
+  for (std::set<std::string>::const_iterator it = superseded.begin();
+       it != superseded.end(); ++it) {
+    // The index goes first so the pack is never found without its data.
+    unlink((*it + ".idx").c_str());
+    unlink((*it + ".pack").c_str());
+    packsRemoved++;
+  }
+}
+
+int GitMaintenance::runCommand() {
+  double start = nowMs();
+  git_odb* odb = NULL;
+  git_refdb* refdb = NULL;
+  _gitDir = git_repository_path(repo);
+
+  size_t filesBefore;
+  double bytesBefore;
+  measure(&filesBefore, &bytesBefore);
+
+  std::vector<LooseObject> objects;
+  collectLooseObjects(objects);
+  std::set<std::string> packs;
+  listPacks(&packs);
+  bool repack = packs.size() >= kMaxPacks;
+
+  error = 0;
+  if (!objects.empty() || repack) {
+    error = packObjects(objects, repack);
+    // Only drop the loose copies once the pack is complete and visible.
+    if (!error) {
+      error = git_repository_odb(&odb, repo);
+    }
+    if (!error) {
+      error = git_odb_refresh(odb);
+    }
+    if (!error) {
+      _gitSalt->scheduler()->yield();
+      pruneObjects(objects);
+      if (repack) {
+        prunePacks(packs);
+      }
+    }
+  }
+
+  if (!error) {
+    error = git_repository_refdb(&refdb, repo);
+  }
+  if (!error) {
+    error = git_refdb_compress(refdb);
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  size_t filesAfter;
+  double bytesAfter;
+  measure(&filesAfter, &bytesAfter);
+
+  git_refdb_free(refdb);
+  git_odb_free(odb);
+
+  pp::VarDictionary arg;
+  arg.Set(kObjectsPacked, (int) objectsPacked);
+  arg.Set(kPacksRemoved, (int) packsRemoved);
+  arg.Set(kFilesBefore, (int) filesBefore);
+  arg.Set(kFilesAfter, (int) filesAfter);
+  arg.Set(kBytesBefore, bytesBefore);
+  arg.Set(kBytesAfter, bytesAfter);
+  arg.Set(kElapsed, nowMs() - start);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+namespace {
+pp::VarDictionary CacheStats(size_t hits, size_t misses) {
+  pp::VarDictionary stats;
+  stats.Set(kHits, (double) hits);
+  stats.Set(kMisses, (double) misses);
+  return stats;
+}
+
+pp::VarDictionary QueueStats(const Scheduler::Stats& stats) {
+  pp::VarDictionary queue;
+  queue.Set(kDepth, (double) stats.depth);
+  queue.Set(kPeakDepth, (double) stats.peakDepth);
+  queue.Set(kCompleted, (double) stats.completed);
+  queue.Set(kWaitMs, stats.waitMs);
+  queue.Set(kMaxWaitMs, stats.maxWaitMs);
+  queue.Set(kYields, (double) stats.yields);
+  return queue;
+}
+}
+
+int GitPrefetch::parseArgs() {
+  if ((error = parseInt(_args, kInterval, &interval))) {
+  }
+  return 0;
+}
+
+int GitPrefetch::runCommand() {
+  Prefetcher* prefetcher = _gitSalt->prefetcher();
+  generation = prefetcher->configure(interval);
+
+  pp::VarDictionary arg;
+  arg.Set(kInterval, prefetcher->intervalMs());
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+int GitStats::parseArgs() {
+  return 0;
+}
+
+int GitStats::runCommand() {
+  RefSnapshot* refs = _gitSalt->refSnapshot();
+  RevisionCache* revisions = _gitSalt->revisionCache();
+  SimilarityCache* similarity = _gitSalt->similarityCache();
+
+  pp::VarDictionary arg;
+  arg.Set(kRefs, CacheStats(refs->hits, refs->misses));
+  arg.Set(kRevisions, CacheStats(revisions->hits, revisions->misses));
+  arg.Set(kSimilarity, CacheStats(similarity->hits, similarity->misses));
+
+  Scheduler* scheduler = _gitSalt->scheduler();
+  pp::VarDictionary queues;
+  queues.Set(kInteractive,
+      QueueStats(scheduler->stats(Scheduler::kInteractive)));
+  queues.Set(kNormal, QueueStats(scheduler->stats(Scheduler::kNormal)));
+  queues.Set(kBackground,
+      QueueStats(scheduler->stats(Scheduler::kBackground)));
+  arg.Set(kScheduler, queues);
+
+  Prefetcher* prefetcher = _gitSalt->prefetcher();
+  pp::VarDictionary prefetch;
+  prefetch.Set(kInterval, prefetcher->intervalMs());
+  prefetch.Set(kRuns, (double) prefetcher->runs);
+  prefetch.Set(kFailures, (double) prefetcher->failures);
+  prefetch.Set(kBackoff, (double) prefetcher->consecutiveFailures);
+  prefetch.Set(kObjects, (double) prefetcher->objectsReceived);
+  prefetch.Set(kBytes, prefetcher->bytesReceived);
+  arg.Set(kPrefetch, prefetch);
+
+  PackIndexStats* packs = _gitSalt->packIndexStats();
+  pp::VarDictionary indexing;
+  indexing.Set(kPacks, (double) packs->packs);
+  indexing.Set(kFallbacks, (double) packs->fallbacks);
+  indexing.Set(kObjects, (double) packs->objects);
+  indexing.Set(kDeltas, (double) packs->deltas);
+  indexing.Set(kThreads, (double) packs->threads);
+  indexing.Set(kReceiveMs, packs->receiveMs);
+  indexing.Set(kParseMs, packs->parseMs);
+  indexing.Set(kResolveMs, packs->resolveMs);
+  indexing.Set(kWriteMs, packs->writeMs);
+  indexing.Set(kCacheHits, (double) packs->cacheHits);
+  indexing.Set(kCacheMisses, (double) packs->cacheMisses);
+  arg.Set(kIndexing, indexing);
+
+  TrigramIndex* trigrams = _gitSalt->trigramIndex();
+  pp::VarDictionary search;
+  search.Set(kBlobs, (double) trigrams->blobCount());
+  search.Set(kTrigrams, (double) trigrams->trigramCount());
+  arg.Set(kSearch, search);
+
+  MountRegistry* mounts = _gitSalt->mountRegistry();
+  pp::VarDictionary mounted;
+  mounted.Set(kMounted, (double) mounts->mountCount());
+  mounted.Set(kIdle, (double) mounts->idleCount());
+  mounted.Set(kReused, (double) mounts->reused);
+  arg.Set(kMounts, mounted);
+
+  const std::vector<StartupTimer::Phase>& phases =
+      _gitSalt->startupTimer()->phases();
+  pp::VarDictionary startup;
+  for (size_t i = 0; i < phases.size(); ++i) {
+    pp::VarDictionary phase;
+    phase.Set(kMs, phases[i].ms);
+    phase.Set(kAt, phases[i].endMs);
+    startup.Set(phases[i].name, phase);
+  }
+  arg.Set(kStartup, startup);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+  return 0;
+}
+
+namespace {
+// Files are written in batches so progress can be reported in between.
+const size_t kCheckoutBatchSize = 256;
+}
+
+int GitCheckout::parseArgs() {
+  if ((error = parseString(_args, kRev, rev))) {
+  }
+
+  if ((error = parseString(_args, kBranch, branch))) {
+  }
+
+  if ((error = parseBool(_args, kForce, &force))) {
+  }
+  return 0;
+}
+
+bool GitCheckout::isDirty(git_index* index, git_tree* from, const char* path) {
+  const git_index_entry* staged = git_index_get_bypath(index, path, 0);
+  git_tree_entry* committed = NULL;
+  if (from != NULL && git_tree_entry_bypath(&committed, from, path)) {
+    giterr_clear();
+  }
+
+  // Staged changes.
+  bool dirty = (staged == NULL) != (committed == NULL) ||
+      (staged != NULL &&
+       !git_oid_equal(&staged->id, git_tree_entry_id(committed)));
+  git_tree_entry_free(committed);
+  if (dirty) {
+    return true;
+  }
+
+  // Changes in the working directory. A missing file loses nothing.
+  std::string fullPath = _workdir + path;
+  struct stat st;
+  if (stat(fullPath.c_str(), &st)) {
+    return false;
+  }
+  if (staged == NULL) {
+    // An untracked file is in the way.
+    return true;
+  }
+  // Like git's racy check: an entry stamped in the same second as the index
+  // was written proves nothing, so the file gets hashed.
+  if (st.st_size == staged->file_size &&
+      st.st_mtime == staged->mtime.seconds &&
+      staged->mtime.seconds < _indexMtime) {
+    return false;
+  }
+  git_oid id;
+  return git_odb_hashfile(&id, fullPath.c_str(), GIT_OBJ_BLOB) ||
+      !git_oid_equal(&id, &staged->id);
+}
+
+bool GitCheckout::isDeletion(const FileUpdate& update) {
+  return update.delta->status == GIT_DELTA_DELETED || update.evict;
+}
+
+void GitCheckout::applyUpdate(size_t index, void* payload) {
+  GitCheckout* checkout = static_cast<GitCheckout*>(payload);
+  FileUpdate& update = checkout->_updates[checkout->_batchStart + index];
+  const git_diff_delta* delta = update.delta;
+  update.error = 0;
+
+  if (isDeletion(update)) {
+    std::string path = checkout->_workdir + delta->old_file.path;
+    if (unlink(path.c_str()) && errno != ENOENT) {
+      update.error = -1;
+    }
+    update.applied = !update.error;
+    return;
+  }
+
+  std::string path = checkout->_workdir + delta->new_file.path;
+  bool executable = delta->new_file.mode == GIT_FILEMODE_BLOB_EXECUTABLE;
+
+  if (delta->status != GIT_DELTA_MODIFIED ||
+      !git_oid_equal(&delta->old_file.id, &delta->new_file.id)) {
+    git_blob* blob = NULL;
+    update.error = git_blob_lookup(&blob, checkout->repo, &delta->new_file.id);
+    if (!update.error) {
+      update.error =
+          MakeParentDirs(path, checkout->_workdir.length()) ||
+          WriteFile(path, git_blob_rawcontent(blob),
+              (size_t) git_blob_rawsize(blob));
+      git_blob_free(blob);
+    }
+  }
+
+  if (!update.error) {
+    chmod(path.c_str(), executable ? 0755 : 0644);
+    update.error = stat(path.c_str(), &update.st);
+  }
+  update.applied = !update.error;
+}
+
+int GitCheckout::runUpdates(size_t begin, size_t end, size_t* completed) {
+  int r = 0;
+  for (_batchStart = begin; _batchStart < end;
+       _batchStart += kCheckoutBatchSize) {
+    size_t count = std::min(kCheckoutBatchSize, end - _batchStart);
+    _gitSalt->workerPool()->parallelFor(count, &GitCheckout::applyUpdate, this);
+
+    for (size_t i = _batchStart; i < _batchStart + count; ++i) {
+      const git_diff_delta* delta = _updates[i].delta;
+      if (_updates[i].error) {
+        // Workers have errors of their own, so report the first path here.
+        if (!r) {
+          const char* path = isDeletion(_updates[i]) ?
+              delta->old_file.path : delta->new_file.path;
+          giterr_set_str(GITERR_OS,
+              (std::string("cannot update ") + path).c_str());
+        }
+        r = -1;
+      } else if (isDeletion(_updates[i])) {
+        filesDeleted++;
+      } else if (delta->status == GIT_DELTA_MODIFIED &&
+                 git_oid_equal(&delta->old_file.id, &delta->new_file.id)) {
+        filesChmodded++;
+      } else {
+        filesWritten++;
+      }
+    }
+    *completed += count;
+    postProgress(*completed, _updates.size());
+  }
+  return r;
+}
+
+void GitCheckout::removeEmptyDirs(const std::string& path) {
+  for (size_t i = path.rfind('/'); i != std::string::npos && i > 0;
+       i = path.rfind('/', i - 1)) {
+    if (rmdir((_workdir + path.substr(0, i)).c_str())) {
+      break;
+    }
+  }
+}
+
+// With |complete| unset only the updates that made it to disk are recorded,
+// so after a failure the index still describes the working tree.
+int GitCheckout::updateIndex(bool complete) {
+  git_index* index = NULL;
+  int r = git_repository_index(&index, repo);
+  if (r) {
+    return r;
+  }
+
+  for (size_t i = 0; !r && i < _updates.size(); ++i) {
+    const git_diff_delta* delta = _updates[i].delta;
+    if (!_updates[i].applied) {
+      continue;
+    }
+    if (delta->status == GIT_DELTA_DELETED) {
+      r = git_index_remove(index, delta->old_file.path, 0);
+      continue;
+    }
+
+    git_index_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    if (_updates[i].evict) {
+      entry.flags = GIT_IDXENTRY_EXTENDED;
+      entry.flags_extended = GIT_IDXENTRY_SKIP_WORKTREE;
+    } else {
+      // Record the stat data of the written file, so the next status does
+      // not have to hash it again.
+      const struct stat& st = _updates[i].st;
+      entry.ctime.seconds = st.st_ctime;
+      entry.mtime.seconds = st.st_mtime;
+      entry.dev = st.st_dev;
+      entry.ino = st.st_ino;
+      entry.uid = st.st_uid;
+      entry.gid = st.st_gid;
+      entry.file_size = st.st_size;
+    }
+    entry.mode = delta->new_file.mode;
+    git_oid_cpy(&entry.id, &delta->new_file.id);
+    entry.path = delta->new_file.path;
+    r = git_index_add(index, &entry);
+  }
+
+  for (size_t i = 0; !r && complete && i < _skipped.size(); ++i) {
+    const git_diff_delta* delta = _skipped[i];
+    if (delta->status == GIT_DELTA_DELETED) {
+      r = git_index_remove(index, delta->old_file.path, 0);
+      continue;
+    }
+
+    git_index_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.flags = GIT_IDXENTRY_EXTENDED;
+    entry.flags_extended = GIT_IDXENTRY_SKIP_WORKTREE;
+    entry.mode = delta->new_file.mode;
+    git_oid_cpy(&entry.id, &delta->new_file.id);
+    entry.path = delta->new_file.path;
+    r = git_index_add(index, &entry);
+  }
+
+  if (!r) {
+    r = git_index_write(index);
+  }
+  git_index_free(index);
+  return r;
+}
+
+int GitCheckout::checkoutTree(git_tree* from, git_tree* to) {
+  git_diff* diff = NULL;
+  git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+  int r = git_diff_tree_to_tree(&diff, repo, from, to, &options);
+  if (r) {
+    return r;
+  }
+
+  SparseCone cone;
+  r = cone.load(git_repository_path(repo));
+
+  size_t numDeltas = git_diff_num_deltas(diff);
+  for (size_t i = 0; !r && i < numDeltas; ++i) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, i);
+    const char* path = delta->status == GIT_DELTA_DELETED ?
+        delta->old_file.path : delta->new_file.path;
+    // Submodules are not checked out, added or removed.
+    if (delta->old_file.mode == GIT_FILEMODE_COMMIT ||
+        delta->new_file.mode == GIT_FILEMODE_COMMIT) {
+      continue;
+    } else if (cone.includes(path)) {
+      addUpdate(delta, false);
+    } else {
+      _skipped.push_back(delta);
+    }
+  }
+
+  if (!r) {
+    r = applyUpdates(from);
+  }
+  git_diff_free(diff);
+  return r;
+}
+
+void GitCheckout::addUpdate(const git_diff_delta* delta, bool evict) {
+  FileUpdate update;
+  update.delta = delta;
+  update.evict = evict;
+  update.error = 0;
+  update.applied = false;
+  _updates.push_back(update);
+}
+
+int GitCheckout::applyUpdates(git_tree* from) {
+  const char* workdir = git_repository_workdir(repo);
+  if (workdir == NULL) {
+    _updates.clear();
+    _skipped.clear();
+    giterr_set_str(GITERR_REPOSITORY, "repository has no working tree");
+    return GIT_ERROR;
+  }
+  _workdir = workdir;
+  int r = 0;
+
+  // Safe mode: refuse to touch paths with local modifications.
+  if (!force) {
+    struct stat st;
+    std::string indexPath = std::string(git_repository_path(repo)) + "index";
+    _indexMtime = stat(indexPath.c_str(), &st) ? 0 : st.st_mtime;
+    git_index* index = NULL;
+    r = git_repository_index(&index, repo);
+    for (size_t i = 0; !r && i < _updates.size(); ++i) {
+      const git_diff_delta* delta = _updates[i].delta;
+      const char* path = delta->status == GIT_DELTA_DELETED ?
+          delta->old_file.path : delta->new_file.path;
+      if (isDirty(index, from, path)) {
+        conflicts.push_back(path);
+      }
+    }
+    git_index_free(index);
+  }
+
+  if (!r && conflicts.empty()) {
+    // Deletions go first, so a file can replace a directory and vice versa.
+    size_t numDeletions = std::stable_partition(_updates.begin(),
+        _updates.end(), &GitCheckout::isDeletion) - _updates.begin();
+    size_t completed = 0;
+    r = runUpdates(0, numDeletions, &completed);
+    for (size_t i = 0; i < numDeletions; ++i) {
+      removeEmptyDirs(_updates[i].delta->old_file.path);
+    }
+    if (!r) {
+      r = runUpdates(numDeletions, _updates.size(), &completed);
+    }
+    if (!r) {
+      r = updateIndex(true);
+    } else {
+      // HEAD stays where it was, but the files already changed are staged,
+      // so status shows what is actually on disk. The first failure is
+      // what gets reported.
+      std::string message = giterr_last() ? giterr_last()->message : "";
+      updateIndex(false);
+      giterr_set_str(GITERR_CHECKOUT, message.c_str());
+    }
+  } else if (!r) {
+    giterr_set_str(GITERR_CHECKOUT,
+        "local changes would be overwritten; see conflicts");
+    r = GIT_ERROR;
+  }
+
+  _updates.clear();
+  _skipped.clear();
+  return r;
+}
+
+void GitCheckout::postProgress(size_t completed, size_t total) {
+  pp::VarDictionary arg;
+  arg.Set(kCompleted, (int) completed);
+  arg.Set(kTotal, (int) total);
+  arg.Set(kDone, false);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+}
+
+void GitCheckout::postResult(int error, double elapsed,
+    pp::VarDictionary arg) {
+  pp::VarArray conflictList;
+  for (size_t i = 0; i < conflicts.size(); ++i) {
+    conflictList.Set(i, conflicts[i]);
+  }
+
+  arg.Set(kFilesWritten, (int) filesWritten);
+  arg.Set(kFilesDeleted, (int) filesDeleted);
+  arg.Set(kFilesChmodded, (int) filesChmodded);
+  arg.Set(kConflicts, conflictList);
+  arg.Set(kElapsed, elapsed);
+  arg.Set(kDone, true);
+  setOutcome(error, arg);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _gitSalt->PostMessage(response);
+}
+
+int GitCheckout::runCommand() {
+  double start = nowMs();
+  git_commit* target = NULL;
+  git_tree* from = NULL;
+  git_tree* to = NULL;
+  std::string refName;
+
+  if (!branch.empty()) {
+    refName = "refs/heads/" + branch;
+    error = lookupCommit(refName, &target);
+  } else {
+    error = lookupCommit(rev, &target);
+  }
+
+  if (!error) {
+    // An unborn HEAD checks out everything.
+    if (lookupTree("HEAD", &from)) {
+      giterr_clear();
+    }
+    error = git_commit_tree(&to, target);
+  }
+
+  if (!error) {
+    error = checkoutTree(from, to);
+  }
+
+  if (!error) {
+    if (!refName.empty()) {
+      error = git_repository_set_head(repo, refName.c_str(), NULL, NULL);
+    } else {
+      error = git_repository_set_head_detached(repo, git_commit_id(target),
+          NULL, NULL);
+    }
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  git_tree_free(to);
+  git_tree_free(from);
+  git_commit_free(target);
+
+  postResult(error, nowMs() - start);
+  return 0;
+}
+
+int GitMerge::parseArgs() {
+  if ((error = GitCheckout::parseArgs())) {
+  }
+
+  if ((error = parseBool(_args, kPreview, &preview))) {
+  }
+
+  if ((error = parseBool(_args, kFastForwardOnly, &fastForwardOnly))) {
+  }
+
+  if ((error = parseString(_args, kUserName, userName))) {
+  }
+
+  if ((error = parseString(_args, kUserEmail, userEmail))) {
+  }
+
+  if ((error = parseString(_args, kCommitMessage, commitMsg))) {
+    commitMsg = "Merge " + rev;
+  }
+  return 0;
+}
+
+int GitMerge::mergeTrees(git_commit* ours, git_commit* theirs,
+    const git_oid* base, git_index** merged) {
+  git_commit* baseCommit = NULL;
+  git_tree* baseTree = NULL;
+  git_tree* ourTree = NULL;
+  git_tree* theirTree = NULL;
+
+  // Unrelated histories merge without a common ancestor.
+  int r = base != NULL ? git_commit_lookup(&baseCommit, repo, base) : 0;
+  if (!r && baseCommit != NULL) {
+    r = git_commit_tree(&baseTree, baseCommit);
+  }
+  if (!r) {
+    r = git_commit_tree(&ourTree, ours);
+  }
+  if (!r) {
+    r = git_commit_tree(&theirTree, theirs);
+  }
+  if (!r) {
+    r = git_merge_trees(merged, repo, baseTree, ourTree, theirTree, NULL);
+  }
+
+  if (!r && git_index_has_conflicts(*merged)) {
+    git_index_conflict_iterator* it = NULL;
+    r = git_index_conflict_iterator_new(&it, *merged);
+    const git_index_entry* ancestorEntry;
+    const git_index_entry* ourEntry;
+    const git_index_entry* theirEntry;
+    while (!r && !git_index_conflict_next(&ancestorEntry, &ourEntry,
+        &theirEntry, it)) {
+      MergeConflict conflict;
+      const git_index_entry* any = ourEntry != NULL ? ourEntry :
+          (theirEntry != NULL ? theirEntry : ancestorEntry);
+      conflict.path = any->path;
+      if (ancestorEntry != NULL) {
+        conflict.ancestor = oidToString(&ancestorEntry->id);
+      }
+      if (ourEntry != NULL) {
+        conflict.ours = oidToString(&ourEntry->id);
+      }
+      if (theirEntry != NULL) {
+        conflict.theirs = oidToString(&theirEntry->id);
+      }
+      _mergeConflicts.push_back(conflict);
+    }
+    git_index_conflict_iterator_free(it);
+  }
+
+  git_tree_free(theirTree);
+  git_tree_free(ourTree);
+  git_tree_free(baseTree);
+  git_commit_free(baseCommit);
+  return r;
+}
+
+int GitMerge::updateHead(const git_oid* id) {
+  git_reference* head = NULL;
+  git_reference* updated = NULL;
+  int r = git_reference_lookup(&head, repo, "HEAD");
+  if (!r) {
+    if (git_reference_type(head) == GIT_REF_SYMBOLIC) {
+      r = git_reference_create(&updated, repo,
+          git_reference_symbolic_target(head), id, 1, NULL, NULL);
+    } else {
+      r = git_repository_set_head_detached(repo, id, NULL, NULL);
+    }
+  }
+  git_reference_free(updated);
+  git_reference_free(head);
+  return r;
+}
+
+int GitMerge::runCommand() {
+  double start = nowMs();
+  git_commit* ours = NULL;
+  git_commit* theirs = NULL;
+  git_tree* from = NULL;
+  git_tree* to = NULL;
+  git_index* merged = NULL;
+  git_signature* sign = NULL;
+  git_oid base;
+  bool hasBase = false;
+  bool committed = false;
+
+  error = lookupCommit(rev, &theirs);
+
+  if (!error) {
+    if (lookupCommit("HEAD", &ours)) {
+      giterr_clear();
+      analysis = "unborn";
+    } else if (git_merge_base(&base, repo, git_commit_id(ours),
+        git_commit_id(theirs))) {
+      giterr_clear();
+      analysis = "normal";
+    } else {
+      hasBase = true;
+      if (git_oid_equal(&base, git_commit_id(theirs))) {
+        analysis = "upToDate";
+      } else if (git_oid_equal(&base, git_commit_id(ours))) {
+        analysis = "fastForward";
+      } else {
+        analysis = "normal";
+      }
+    }
+  }
+
+  if (!error && analysis == "normal") {
+    if (fastForwardOnly) {
+      giterr_set_str(GITERR_MERGE, ("cannot fast-forward to " + rev).c_str());
+      error = GIT_ENONFASTFORWARD;
+    } else {
+      error = mergeTrees(ours, theirs, hasBase ? &base : NULL, &merged);
+    }
+  }
+
+  if (!error && !preview && !_mergeConflicts.empty()) {
+    giterr_set_str(GITERR_MERGE,
+        "merge has conflicts; nothing was committed");
+    error = GIT_EMERGECONFLICT;
+  }
+
+  if (!error && !preview && analysis != "upToDate") {
+    if (ours != NULL) {
+      error = git_commit_tree(&from, ours);
+    }
+    if (!error) {
+      if (merged != NULL) {
+        git_oid treeId;
+        error = git_index_write_tree_to(&treeId, merged, repo);
+        if (!error) {
+          error = git_tree_lookup(&to, repo, &treeId);
+        }
+      } else {
+        error = git_commit_tree(&to, theirs);
+      }
+    }
+    if (!error) {
+      error = checkoutTree(from, to);
+    }
+
+    if (!error && merged != NULL) {
+      const git_commit* parents[] = {ours, theirs};
+      error = git_signature_now(&sign, userName.c_str(), userEmail.c_str());
+      if (!error) {
+        error = git_commit_create(&commitId, repo, "HEAD", sign, sign, NULL,
+            commitMsg.c_str(), to, 2, parents);
+      }
+    } else if (!error) {
+      git_oid_cpy(&commitId, git_commit_id(theirs));
+      error = updateHead(&commitId);
+    }
+    committed = !error;
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  pp::VarArray conflictList;
+  for (size_t i = 0; i < _mergeConflicts.size(); ++i) {
+    pp::VarDictionary conflict;
+    conflict.Set(kPath, _mergeConflicts[i].path);
+    conflict.Set(kAncestor, _mergeConflicts[i].ancestor);
+    conflict.Set(kOurs, _mergeConflicts[i].ours);
+    conflict.Set(kTheirs, _mergeConflicts[i].theirs);
+    conflictList.Set(i, conflict);
+  }
+
+  pp::VarDictionary arg;
+  arg.Set(kAnalysis, analysis);
+  arg.Set(kMergeConflicts, conflictList);
+  if (committed) {
+    arg.Set(kCommit, oidToString(&commitId));
+  }
+
+  git_signature_free(sign);
+  git_index_free(merged);
+  git_tree_free(to);
+  git_tree_free(from);
+  git_commit_free(theirs);
+  git_commit_free(ours);
+
+  postResult(error, nowMs() - start, arg);
+  return 0;
+}
+
+int GitSparseCheckout::parseArgs() {
+  if ((error = GitCheckout::parseArgs())) {
+  }
+
+  pp::VarArray directoryArray;
+  if ((error = parseArray(_args, kDirectories, directoryArray))) {
+  }
+
+  uint32_t length = directoryArray.GetLength();
+  for (uint32_t i = 0; i < length; ++i) {
+    directories.push_back(directoryArray.Get(i).AsString());
+  }
+  return 0;
+}
+
+int GitSparseCheckout::collectChanges(const char* root,
+                                      const git_tree_entry* entry,
+                                      void* payload) {
+  GitSparseCheckout* checkout = static_cast<GitSparseCheckout*>(payload);
+  if (git_tree_entry_type(entry) != GIT_OBJ_BLOB) {
+    return 0;
+  }
+
+  std::string path = std::string(root) + git_tree_entry_name(entry);
+  bool wasIncluded = checkout->_oldCone.includes(path.c_str());
+  if (wasIncluded == checkout->_newCone.includes(path.c_str())) {
+    return 0;
+  }
+
+  // The file is unchanged, only whether it is on disk changes.
+  checkout->_paths.push_back(path);
+  git_diff_delta delta;
+  memset(&delta, 0, sizeof(delta));
+  delta.status = GIT_DELTA_ADDED;
+  git_oid_cpy(&delta.new_file.id, git_tree_entry_id(entry));
+  delta.new_file.mode = git_tree_entry_filemode(entry);
+  delta.new_file.path = checkout->_paths.back().c_str();
+  delta.old_file = delta.new_file;
+  checkout->_deltas.push_back(delta);
+  checkout->addUpdate(&checkout->_deltas.back(), wasIncluded);
+  return 0;
+}
+
+int GitSparseCheckout::runCommand() {
+  double start = nowMs();
+  git_tree* head = NULL;
+  std::string gitDir = git_repository_path(repo);
+
+  error = _oldCone.load(gitDir);
+  _newCone.setDirectories(directories);
+
+  // With an unborn HEAD there is nothing to bring in line yet.
+  if (!error && lookupTree("HEAD", &head)) {
+    giterr_clear();
+  } else if (!error) {
+    error = git_tree_walk(head, GIT_TREEWALK_PRE,
+        &GitSparseCheckout::collectChanges, this);
+    if (!error) {
+      error = applyUpdates(head);
+    }
+  }
+
+  if (!error) {
+    error = _newCone.save(gitDir);
+  }
+
+  const git_error *a = giterr_last();
+
+  if (a != NULL) {
+    printf("giterror: %s\n", a->message);
+  }
+
+  git_tree_free(head);
+  postResult(error, nowMs() - start);
+  return 0;
+}
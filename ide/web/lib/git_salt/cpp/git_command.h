@@ -8,19 +8,34 @@
 #include <string>
 #include <cstring>
 #include <git2.h>
+#include <pthread.h>
 #include <sys/mount.h>
+#include <sys/stat.h>
 #include <stdio.h>
-#include<vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
 
 #include "ppapi/cpp/file_system.h"
+#include "ppapi/cpp/var_array_buffer.h"
 #include "ppapi/cpp/var_dictionary.h"
 
+#include "archive_writer.h"
+#include "blame_cache.h"
 #include "constants.h"
 #include "git_salt.h"
+#include "pack_indexer.h"
+#include "rename_detector.h"
+#include "revision_cache.h"
+#include "sha1.h"
+#include "sparse_cone.h"
+#include "text_pattern.h"
+#include "tree_cache.h"
 
 namespace {
 
-int parseString(pp::VarDictionary message, const char* name,
+int parseString(const pp::VarDictionary& message, const char* name,
     std::string& option) {
   pp::Var var_option = message.Get(name);
   if (!var_option.is_string()) {
@@ -31,7 +46,7 @@ int parseString(pp::VarDictionary message, const char* name,
   return 0;
 }
 
-int parseInt(pp::VarDictionary message, const char* name,
+int parseInt(const pp::VarDictionary& message, const char* name,
     int* option) {
   pp::Var var_option = message.Get(name);
   if (!var_option.is_int()) {
@@ -42,7 +57,18 @@ int parseInt(pp::VarDictionary message, const char* name,
   return 0;
 }
 
-int parseArray(pp::VarDictionary message, const char* name,
+int parseBool(const pp::VarDictionary& message, const char* name,
+    bool* option) {
+  pp::Var var_option = message.Get(name);
+  if (!var_option.is_bool()) {
+    //TODO(grv): return error code;
+    return 1;
+  }
+  *option = var_option.AsBool();
+  return 0;
+}
+
+int parseArray(const pp::VarDictionary& message, const char* name,
     pp::VarArray& option) {
   pp::Var var_option = message.Get(name);
   if (!var_option.is_array()) {
@@ -65,11 +91,40 @@ class GitCommand {
   GitSaltInstance* _gitSalt;
   pp::VarDictionary _args;
 
-  int parseFileSystem(pp::VarDictionary message, std::string name,
-      pp::FileSystem& fileSystem);
+  int parseFileSystem(const pp::VarDictionary& message,
+      const std::string& name, pp::FileSystem& fileSystem);
+
+  void parseRenameOptions(RenameOptions& options);
+
+  /**
+   * Resolves a revision spec to the tree it points at. The caller owns the
+   * returned tree.
+   */
+  int lookupTree(const std::string& spec, git_tree** tree);
+
+  /**
+   * Resolves a revision spec to a commit. The caller owns the returned
+   * commit.
+   */
+  int lookupCommit(const std::string& spec, git_commit** commit);
+
+  /**
+   * Transfer progress callback for background work: lets queued interactive
+   * commands run before carrying on. |payload| is the command.
+   */
+  static int yieldProgress(const git_transfer_progress* stats, void* payload);
+
+  /**
+   * Sets "success" in |arg| and, when |error| is set, the libgit2 error text
+   * as "message", so a failure cannot be taken for a command with nothing
+   * to do.
+   */
+  void setOutcome(int error, pp::VarDictionary& arg);
 
  public:
   pp::FileSystem fileSystem;
+  // The page's name for fileSystem, which stays the same across messages.
+  std::string fileSystemName;
   std::string fullPath;
   std::string url;
   std::string subject;
@@ -88,24 +143,59 @@ class GitCommand {
 
 class GitClone : public GitCommand {
 
+  /**
+   * Clones one branch at a time, tracking progress in the repository itself.
+   * Branches fetched before an interruption are kept, and the next attempt
+   * only asks the remote for what is still missing.
+   */
+  int resumableClone();
+
+  int fetchBranches(git_remote* remote, std::string* defaultBranch);
+
+  // Clones everything in one fetch, like git_clone.
+  int plainClone();
+
+  // Received packs are indexed in parallel from then on.
+  int installPackIndexer();
+
+  void postProgress(size_t completed, size_t total);
+
+ protected:
+  // Mount point of the working tree, set by openWorkdir.
+  std::string _workdir;
+  // Present in the git directory while a resumable clone is incomplete.
+  std::string _cloneStateFile;
+
+  /**
+   * Mounts the working tree through the mount registry and makes it the
+   * current one, closing the repository open before unless it lives there.
+   */
+  int openWorkdir();
+
  public:
+  bool resume;
+  // Sparse cone directories to check out; empty for the whole tree.
+  std::vector<std::string> sparse;
+  // Partial clone filter spec, e.g. "blob:none". Not supported yet.
+  std::string filter;
+
   GitClone(GitSaltInstance* git_salt,
-           std::string subject,
-           pp::VarDictionary args,
+           const std::string& subject,
+           const pp::VarDictionary& args,
            git_repository*& repo)
-      : GitCommand(git_salt, subject, args, repo) {}
+      : GitCommand(git_salt, subject, args, repo), resume(false) {}
 
-  int runCommand();
+  virtual int parseArgs();
 
-  void ChromefsInit();
+  int runCommand();
 };
 
 class GitInit : public GitClone {
 
  public:
   GitInit(GitSaltInstance* git_salt,
-           std::string subject,
-           pp::VarDictionary args,
+           const std::string& subject,
+           const pp::VarDictionary& args,
            git_repository*& repo)
       : GitClone(git_salt, subject, args, repo) {}
 
@@ -114,16 +204,39 @@ class GitInit : public GitClone {
 
 class GitCommit : public GitCommand {
 
+  struct WorkdirFile {
+    std::string path;
+    // The mapped buffer of the committed file.
+    const char* data;
+    size_t size;
+    int error;
+  };
+
+  std::vector<WorkdirFile> _workdirFiles;
+  size_t _workdirLength;
+
+  static void writeWorkdirFile(size_t index, void* payload);
+
+  // Writes the committed buffers to the working tree before returning.
+  void writeWorkdirFiles(const char* workdir);
+
  public:
   std::string userName;
   std::string userEmail;
   std::string commitMsg;
+  // File contents to commit instead of the on-disk index, keyed by path.
+  std::vector<std::pair<std::string, pp::VarArrayBuffer> > files;
+  bool writeWorkdir;
+  git_oid commitId;
+  // Files committed whose working tree copy could not be written.
+  std::vector<std::string> writeFailures;
 
   GitCommit(GitSaltInstance* git_salt,
-            std::string subject,
-            pp::VarDictionary args,
+            const std::string& subject,
+            const pp::VarDictionary& args,
             git_repository*& repo)
-      : GitCommand(git_salt, subject, args, repo) {}
+      : GitCommand(git_salt, subject, args, repo), _workdirLength(0),
+        writeWorkdir(false) {}
 
   git_commit* getLastCommit();
 
@@ -131,6 +244,15 @@ class GitCommit : public GitCommand {
 
   bool commitStage();
 
+  /**
+   * Commits |files| straight from memory: blobs are created from the
+   * buffers, the index entries are pointed at them and the tree and commit
+   * are written in one go. The working directory is only updated when
+   * writeWorkdir is set, in parallel but before the command completes.
+   * Paths must stay inside the working tree.
+   */
+  bool commitBuffers();
+
   int runCommand();
 };
 
@@ -138,8 +260,8 @@ class GitCurrentBranch : public GitCommand {
 
  public:
   GitCurrentBranch(GitSaltInstance* git_salt,
-                   std::string subject,
-                   pp::VarDictionary args,
+                   const std::string& subject,
+                   const pp::VarDictionary& args,
                    git_repository*& repo)
       : GitCommand(git_salt, subject, args, repo) {}
 
@@ -154,8 +276,8 @@ class GitGetBranches : public GitCommand {
   int flags;
 
   GitGetBranches(GitSaltInstance* git_salt,
-                 std::string subject,
-                 pp::VarDictionary args,
+                 const std::string& subject,
+                 const pp::VarDictionary& args,
                  git_repository*& repo)
       : GitCommand(git_salt, subject, args, repo) {}
 
@@ -164,16 +286,70 @@ class GitGetBranches : public GitCommand {
   int runCommand();
 };
 
+/**
+ * Lists branches with their tip, summary, commit time, upstream and
+ * ahead/behind counts in one response. Values are returned column-wise, one
+ * array per field indexed like names, so keys are not repeated per branch.
+ */
+class GitBranchOverview : public GitCommand {
+
+ public:
+  int flags;
+
+  GitBranchOverview(GitSaltInstance* git_salt,
+                    const std::string& subject,
+                    const pp::VarDictionary& args,
+                    git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), flags(GIT_BRANCH_LOCAL) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Stages files. Blob ids are computed up front, several files at a time in
+ * SHA-1 lanes on the worker pool, so content the object database already
+ * has is only recorded in the index instead of being hashed and written
+ * again by libgit2.
+ */
 class GitAdd : public GitCommand {
 
+  struct AddedFile {
+    std::string path;
+    struct stat st;
+    git_oid id;
+    int error;
+    // Too large to read whole: streamed into the object database instead.
+    bool large;
+    // Kept until the blob is written, so the file is only read once.
+    std::string content;
+  };
+
+  std::vector<AddedFile> _files;
+  // First file of the batch being hashed.
+  size_t _batchStart;
+  size_t _batchEnd;
+
+  // Reads and hashes the files of lane group |index| of the batch.
+  static void hashFiles(size_t index, void* payload);
+
+  // Writes the blob of |file| and points its index entry at it.
+  int addFile(git_index* index, git_odb* odb, bool fileMode,
+      const std::string& path, AddedFile& file);
+
  public:
   std::vector<std::string> entries;
+  size_t filesWritten;
+  double bytesStreamed;
+  double streamMs;
 
   GitAdd(GitSaltInstance* git_salt,
-         std::string subject,
-         pp::VarDictionary args,
+         const std::string& subject,
+         const pp::VarDictionary& args,
          git_repository*& repo)
-      : GitCommand(git_salt, subject, args, repo) {}
+      : GitCommand(git_salt, subject, args, repo), _batchStart(0),
+        _batchEnd(0), filesWritten(0), bytesStreamed(0), streamMs(0) {}
 
   virtual int parseArgs();
 
@@ -182,14 +358,54 @@ class GitAdd : public GitCommand {
 
 class GitStatus : public GitCommand {
 
+  /**
+   * Limits |pathspec| to the sparse cone. Returns false, leaving it alone,
+   * when sparse checkout is off. |specs| and |pointers| back the array.
+   */
+  bool sparsePathspec(git_index* index, std::vector<std::string>& specs,
+      std::vector<char*>& pointers, git_strarray* pathspec);
+
+  int statusWithRenames(pp::VarDictionary& statuses,
+                        pp::VarDictionary& renamed,
+                        pp::VarDictionary& copied);
+
+  void addStatuses(git_diff* diff,
+                   bool workdir,
+                   std::map<std::string, unsigned int>& statuses,
+                   pp::VarDictionary& renamed,
+                   pp::VarDictionary& copied);
+
  public:
   int flags;
+  bool renames;
+  RenameOptions renameOptions;
 
   GitStatus(GitSaltInstance* git_salt,
-            std::string subject,
-            pp::VarDictionary args,
+            const std::string& subject,
+            const pp::VarDictionary& args,
             git_repository*& repo)
-      : GitCommand(git_salt, subject, args, repo) {}
+      : GitCommand(git_salt, subject, args, repo), renames(false) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+class GitDiff : public GitCommand {
+
+ public:
+  std::string from;
+  std::string to;
+  bool renames;
+  RenameOptions renameOptions;
+
+  GitDiff(GitSaltInstance* git_salt,
+          const std::string& subject,
+          const pp::VarDictionary& args,
+          git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), renames(false) {}
+
+  virtual int parseArgs();
 
   int runCommand();
 };
@@ -203,11 +419,527 @@ class GitLsRemote : public GitCommand {
   virtual int parseArgs();
 
   GitLsRemote(GitSaltInstance* git_salt,
-              std::string subject,
-              pp::VarDictionary args,
+              const std::string& subject,
+              const pp::VarDictionary& args,
+              git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo) {}
+
+  int runCommand();
+};
+class GitBlame : public GitCommand {
+
+  int countLines(git_commit* commit, uint32_t* lineCount);
+
+  int blameRange(const git_oid& commitId, uint32_t first, uint32_t last,
+                 BlameCache::Entry* entry);
+
+  void postHunks(const std::vector<BlameHunk>& hunks, bool done,
+                 int error = 0);
+
+ public:
+  std::string path;
+  std::string commit;
+  int minLine;
+  int maxLine;
+  int chunkLines;
+
+  GitBlame(GitSaltInstance* git_salt,
+           const std::string& subject,
+           const pp::VarDictionary& args,
+           git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), commit("HEAD"),
+        minLine(1), maxLine(0), chunkLines(100) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+class GitLsTree : public GitCommand {
+
+  int resolveTree(git_oid* id);
+
+ public:
+  std::string rev;
+  std::string tree;
+  std::string path;
+  int offset;
+  int limit;
+
+  GitLsTree(GitSaltInstance* git_salt,
+            const std::string& subject,
+            const pp::VarDictionary& args,
+            git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), rev("HEAD"), offset(0),
+        limit(500) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+class GitReadBlob : public GitCommand {
+
+  int resolveBlob(git_oid* id);
+
+ public:
+  std::string id;
+  std::string rev;
+  std::string path;
+  int offset;
+  int length;
+
+  GitReadBlob(GitSaltInstance* git_salt,
+              const std::string& subject,
+              const pp::VarDictionary& args,
+              git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), rev("HEAD"), offset(0),
+        length(-1) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Resolves a batch of revspecs, including "<rev>:<path>" forms, to object
+ * ids, types and sizes in one round trip. Results are cached until the refs
+ * change.
+ */
+class GitResolve : public GitCommand {
+
+  int resolve(const std::string& spec, ResolvedRevision* resolved);
+
+ public:
+  std::vector<std::string> revs;
+
+  GitResolve(GitSaltInstance* git_salt,
+             const std::string& subject,
+             const pp::VarDictionary& args,
+             git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Subscribes to ref changes. Every change of HEAD, a branch, a tag or
+ * packed-refs is pushed as an event with done set to false; the stream ends
+ * on unsubscribe or when another subscription replaces it.
+ */
+class GitSubscribe : public GitCommand {
+
+ public:
+  int interval;
+
+  GitSubscribe(GitSaltInstance* git_salt,
+               const std::string& subject,
+               const pp::VarDictionary& args,
+               git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), interval(1000) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+class GitUnsubscribe : public GitCommand {
+
+ public:
+  GitUnsubscribe(GitSaltInstance* git_salt,
+                 const std::string& subject,
+                 const pp::VarDictionary& args,
+                 git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Searches the files of a revision, the index or the working tree for lines
+ * matching a literal or a regular expression. Files are searched in chunks
+ * on the worker pool, and each chunk's matches are streamed as soon as it is
+ * done, so results come in before the whole tree is searched. Binary files
+ * are skipped and at most maxResults lines are reported.
+ */
+class GitGrep : public GitCommand {
+
+  struct GrepMatch {
+    size_t file;
+    size_t line;
+    std::string text;
+  };
+
+  // What addMatch appends to while one file of a chunk is searched.
+  struct ChunkMatches {
+    size_t file;
+    size_t limit;
+    std::vector<GrepMatch> matches;
+  };
+
+  TextPattern _pattern;
+  std::string _workdir;
+  pthread_mutex_t _mutex;
+  size_t _count;
+  size_t _filesSearched;
+  bool _truncated;
+
+  static int collectTreeEntry(const char* root, const git_tree_entry* entry,
+      void* payload);
+
+  int collectTreeFiles();
+
+  int collectIndexFiles();
+
+  static bool addMatch(size_t lineNumber, const char* line, size_t length,
+      void* payload);
+
+  // Searches chunk |index| of the files and posts its matches.
+  static void searchFiles(size_t index, void* payload);
+
+  void postMatches(const std::vector<GrepMatch>& matches);
+
+ protected:
+  struct GrepFile {
+    std::string path;
+    git_oid id;
+    // Read from the working tree rather than the object database.
+    bool onDisk;
+  };
+
+  std::vector<GrepFile> _files;
+
+  /**
+   * Lists the files to search in _files. Anything worth reporting about the
+   * selection can be added to |arg|, which becomes the final response.
+   */
+  virtual int collectFiles(pp::VarDictionary& arg);
+
+  bool readFile(const GrepFile& file, std::string* data);
+
+ public:
+  std::string pattern;
+  std::string rev;
+  bool regex;
+  bool ignoreCase;
+  bool cached;
+  int maxResults;
+
+  GitGrep(GitSaltInstance* git_salt,
+          const std::string& subject,
+          const pp::VarDictionary& args,
+          git_repository*& repo);
+  ~GitGrep();
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Grep over a revision, HEAD by default, that only reads the files the
+ * trigram index says may match. The index is first moved to the revision,
+ * which reads just the blobs it has not indexed yet. A regular expression is
+ * not narrowed down and is matched against every text file.
+ */
+class GitSearch : public GitGrep {
+
+ protected:
+  virtual int collectFiles(pp::VarDictionary& arg);
+
+ public:
+  GitSearch(GitSaltInstance* git_salt,
+            const std::string& subject,
+            const pp::VarDictionary& args,
+            git_repository*& repo)
+      : GitGrep(git_salt, subject, args, repo) {}
+
+  virtual int parseArgs();
+};
+
+/**
+ * Exports the tree of a commit as a zip or tar archive, written either to
+ * a file (an absolute path in the module's file system) or streamed back as
+ * ArrayBuffer chunks in responses with done set to false. Files are dated
+ * with the commit time.
+ */
+class GitArchive : public GitCommand {
+
+  FILE* _file;
+  std::string _chunk;
+
+  static int writeData(const char* data, size_t size, void* payload);
+
+  void postChunk();
+
+ public:
+  std::string rev;
+  std::string format;
+  std::string prefix;
+  std::string path;
+
+  GitArchive(GitSaltInstance* git_salt,
+             const std::string& subject,
+             const pp::VarDictionary& args,
+             git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), _file(NULL), rev("HEAD"),
+        format("zip") {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Packs loose objects into a single pack, deletes the loose copies and moves
+ * loose refs into packed-refs. With idle set, the work waits until no other
+ * command has come in for a while. File counts and bytes of the object and
+ * ref storage are reported from before and after.
+ */
+class GitMaintenance : public GitCommand {
+
+  struct LooseObject {
+    git_oid id;
+    std::string path;
+  };
+
+  std::string _gitDir;
+
+  void measure(size_t* files, double* bytes);
+
+  void collectLooseObjects(std::vector<LooseObject>& objects);
+
+  void listPacks(std::set<std::string>* packs);
+
+  void pushReflog(git_revwalk* walk, const char* name);
+
+  int insertReachable(git_packbuilder* packbuilder);
+
+  int packObjects(const std::vector<LooseObject>& objects, bool all);
+
+  void pruneObjects(const std::vector<LooseObject>& objects);
+
+  void prunePacks(const std::set<std::string>& superseded);
+
+ public:
+  bool idle;
+  size_t objectsPacked;
+  size_t packsRemoved;
+
+  GitMaintenance(GitSaltInstance* git_salt,
+                 const std::string& subject,
+                 const pp::VarDictionary& args,
+                 git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), idle(false),
+        objectsPacked(0), packsRemoved(0) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Turns periodic background fetches into the refs/prefetch namespace on
+ * (interval in milliseconds) or off (interval 0). The passes themselves are
+ * scheduled by the instance at background priority; their counters are in
+ * stats.
+ */
+class GitPrefetch : public GitCommand {
+
+ public:
+  int interval;
+  unsigned generation;
+
+  GitPrefetch(GitSaltInstance* git_salt,
+              const std::string& subject,
+              const pp::VarDictionary& args,
               git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), interval(0),
+        generation(0) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Reports instrumentation counters, such as cache hits and misses, so their
+ * effect can be measured in the field.
+ */
+class GitStats : public GitCommand {
+
+ public:
+  GitStats(GitSaltInstance* git_salt,
+           const std::string& subject,
+           const pp::VarDictionary& args,
+           git_repository*& repo)
       : GitCommand(git_salt, subject, args, repo) {}
 
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Switches the working tree from one tree to another by applying their diff:
+ * only files that differ are deleted, written or chmod-ed, and the writes
+ * are spread over the worker pool. Other commands that move the working tree
+ * (merge, clone) reuse checkoutTree().
+ */
+class GitCheckout : public GitCommand {
+
+  struct FileUpdate {
+    const git_diff_delta* delta;
+    // Leaving the sparse cone: the file goes, its index entry stays.
+    bool evict;
+    int error;
+    // Set once the working tree change is on disk.
+    bool applied;
+    struct stat st;
+  };
+
+  std::string _workdir;
+  std::vector<FileUpdate> _updates;
+  // Changes outside the sparse cone, which only touch the index.
+  std::vector<const git_diff_delta*> _skipped;
+  size_t _batchStart;
+  // Entries recorded this late or later may hide a same-second edit.
+  time_t _indexMtime;
+
+  static bool isDeletion(const FileUpdate& update);
+
+  static void applyUpdate(size_t index, void* payload);
+
+  bool isDirty(git_index* index, git_tree* from, const char* path);
+
+  int runUpdates(size_t begin, size_t end, size_t* completed);
+
+  void removeEmptyDirs(const std::string& path);
+
+  int updateIndex(bool complete);
+
+  void postProgress(size_t completed, size_t total);
+
+ protected:
+  /**
+   * Posts the final response with the outcome of |error|. Checkout
+   * statistics are added to |arg|, so subclasses can pass their own results
+   * along.
+   */
+  void postResult(int error, double elapsed,
+      pp::VarDictionary arg = pp::VarDictionary());
+
+  // Queues a working tree update; |delta| must outlive applyUpdates().
+  void addUpdate(const git_diff_delta* delta, bool evict);
+
+  /**
+   * Applies the queued updates. Unless |force| is set, nothing is touched
+   * when one of them has local modifications against |from|.
+   */
+  int applyUpdates(git_tree* from);
+
+ public:
+  std::string rev;
+  std::string branch;
+  bool force;
+  size_t filesWritten;
+  size_t filesDeleted;
+  size_t filesChmodded;
+  std::vector<std::string> conflicts;
+
+  GitCheckout(GitSaltInstance* git_salt,
+              const std::string& subject,
+              const pp::VarDictionary& args,
+              git_repository*& repo)
+      : GitCommand(git_salt, subject, args, repo), _indexMtime(0),
+        force(false), filesWritten(0), filesDeleted(0), filesChmodded(0) {}
+
+  virtual int parseArgs();
+
+  /**
+   * Moves the working tree and index from |from| (NULL for the empty tree)
+   * to |to|. Unless |force| is set, nothing is touched when a file that has
+   * to change carries local modifications; those paths end up in conflicts.
+   * Files outside the sparse cone are only updated in the index.
+   */
+  int checkoutTree(git_tree* from, git_tree* to);
+
+  int runCommand();
+};
+
+/**
+ * Sets the sparse checkout cone and brings the working tree in line with it:
+ * files entering the cone are written, files leaving it are removed while
+ * their index entries are kept. An empty list of directories turns sparse
+ * checkout off.
+ */
+class GitSparseCheckout : public GitCheckout {
+
+  static int collectChanges(const char* root, const git_tree_entry* entry,
+      void* payload);
+
+  SparseCone _oldCone;
+  SparseCone _newCone;
+  std::deque<std::string> _paths;
+  std::deque<git_diff_delta> _deltas;
+
+ public:
+  std::vector<std::string> directories;
+
+  GitSparseCheckout(GitSaltInstance* git_salt,
+                    const std::string& subject,
+                    const pp::VarDictionary& args,
+                    git_repository*& repo)
+      : GitCheckout(git_salt, subject, args, repo) {}
+
+  virtual int parseArgs();
+
+  int runCommand();
+};
+
+/**
+ * Merges |rev| into HEAD. A fast-forward only moves the working tree and the
+ * current branch. A true merge is computed in memory with git_merge_trees
+ * and committed only if it has no conflicts. In preview mode nothing is
+ * written; the analysis and the conflicting paths are reported instead.
+ */
+class GitMerge : public GitCheckout {
+
+  struct MergeConflict {
+    std::string path;
+    std::string ancestor;
+    std::string ours;
+    std::string theirs;
+  };
+
+  std::vector<MergeConflict> _mergeConflicts;
+
+  int mergeTrees(git_commit* ours, git_commit* theirs, const git_oid* base,
+      git_index** merged);
+
+  int updateHead(const git_oid* id);
+
+ public:
+  bool preview;
+  bool fastForwardOnly;
+  std::string userName;
+  std::string userEmail;
+  std::string commitMsg;
+  std::string analysis;
+  git_oid commitId;
+
+  GitMerge(GitSaltInstance* git_salt,
+           const std::string& subject,
+           const pp::VarDictionary& args,
+           git_repository*& repo)
+      : GitCheckout(git_salt, subject, args, repo), preview(false),
+        fastForwardOnly(false) {}
+
+  virtual int parseArgs();
+
   int runCommand();
 };
 #endif  // GIT_SALT_GIT_COMMAND_H__
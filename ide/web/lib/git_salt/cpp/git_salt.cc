@@ -4,29 +4,80 @@
 
 #include "git_salt.h"
 
+#include "message_frame.h"
+#include "timing.h"
+
+namespace {
+const size_t kWorkerThreads = 4;
+const size_t kSimilarityCacheSize = 16384;
+const size_t kBlameCacheSize = 32;
+// Total number of tree entries kept across all cached listings.
+const size_t kTreeCacheSize = 65536;
+const size_t kAheadBehindCacheSize = 256;
+const size_t kRevisionCacheSize = 1024;
+// Working tree mounts kept once their repository is closed.
+const size_t kIdleMounts = 4;
+// Idle maintenance runs once no message has come in for this long.
+const int64_t kIdleDelayMs = 5000;
+
+// File systems mounted by EnsureMounted when a path in them is first used.
+struct DeferredMount {
+  const char* target;
+  const char* type;
+  const char* data;
+};
+
+const DeferredMount kDeferredMounts[] = {
+  {"/grvfs", "html5fs", "type=PERSISTENT,expected_size=1048576"},
+  // The source is empty, so URLs are relative to the module.
+  {"/http", "httpfs", ""}
+};
+}
+
 GitSaltInstance::GitSaltInstance(PP_Instance instance)
   : pp::Instance(instance),
   callback_factory_(this),
-  file_system_(this, PP_FILESYSTEMTYPE_LOCALPERSISTENT),
-  file_system_ready_(false),
-  file_thread_(this) {}
+  repo(NULL),
+  runtime_posted_(false),
+  mount_registry_(kIdleMounts),
+  file_thread_(this),
+  worker_pool_(kWorkerThreads),
+  similarity_cache_(kSimilarityCacheSize),
+  blame_cache_(kBlameCacheSize),
+  tree_cache_(kTreeCacheSize),
+  ahead_behind_cache_(kAheadBehindCacheSize),
+  last_message_ms_(0),
+  ref_snapshot_(&ref_state_),
+  revision_cache_(kRevisionCacheSize),
+  ref_watcher_(this) {
+  // Prefetches would otherwise flush the ref caches on every pass.
+  ref_state_.exclude("prefetch");
+  AddCommands();
+}
 
 GitSaltInstance::~GitSaltInstance() { file_thread_.Join(); }
 
 bool GitSaltInstance::Init(uint32_t /*argc*/,
     const char * /*argn*/ [],
     const char * /*argv*/ []) {
+  double start = nowMs();
   file_thread_.Start();
-  // Open the file system on the file_thread_. Since this is the first
-  // operation we perform there, and because we do everything on the
-  // file_thread_ synchronously, this ensures that the FileSystem is open
-  // before any FileIO operations execute.
-  file_thread_.message_loop().PostWork(
-      callback_factory_.NewCallback(&GitSaltInstance::OpenFileSystem));
+  scheduler_.start(file_thread_.message_loop());
+  startup_timer_.record(kPhaseInit, start);
+
+  // Everything else waits for the first command, so the page hears from us
+  // as early as possible.
+  PostMessage("READY|");
   return true;
 }
 
 void GitSaltInstance::HandleMessage(const pp::Var& var_message) {
+  last_message_ms_ = nowMs();
+
+  if (var_message.is_array_buffer()) {
+    HandleFrame(pp::VarArrayBuffer(var_message));
+    return;
+  }
 
   if (!var_message.is_dictionary()) {
     PostMessage("Error: Message was not a dictionary.");
@@ -47,81 +98,136 @@ void GitSaltInstance::HandleMessage(const pp::Var& var_message) {
 
   }
 
-  pp::VarDictionary var_dictionary_args(var_dictionary_message.Get(kArg));
+  DispatchCommand(cmd.data(), cmd.length(), subject,
+      pp::VarDictionary(var_dictionary_message.Get(kArg)));
+}
 
+void GitSaltInstance::HandleFrame(pp::VarArrayBuffer buffer) {
+  MessageFrame frame;
+  bool valid = frame.decode(static_cast<const char*>(buffer.Map()),
+      buffer.ByteLength());
+  // The name points into the buffer, so it stays mapped until dispatched.
+  if (valid) {
+    DispatchCommand(frame.name(), frame.nameLength(), frame.subject(),
+        frame.args());
+  }
+  buffer.Unmap();
 
-  if (!cmd.compare(kCmdClone)) {
-    if (repo != NULL) {
-      PostMessage("repository already exists.");
-      return;
-    }
+  if (!valid) {
+    PostMessage("Error: Malformed message frame.");
+  }
+}
 
-    GitClone* clone = new GitClone(this, subject, var_dictionary_args, repo);
-    clone->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::Clone, clone));
-  } else if (!cmd.compare(kCmdCommit)) {
-    if (repo == NULL) {
-      PostMessage("Git repository not initialized.");
-      return;
-    }
-    GitCommit* commit = new GitCommit(this, subject, var_dictionary_args, repo);
-    commit->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::Commit, commit));
-  } else if (!cmd.compare(kCmdCurrentBranch)) {
-    if (repo == NULL) {
-      PostMessage("Git repository not initialized.");
-      return;
-    }
-    GitCurrentBranch* branch = new GitCurrentBranch(
-      this, subject, var_dictionary_args, repo);
-    branch->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::CurrentBranch, branch));
-  } else if (!cmd.compare(kCmdGetBranches)) {
-    if (repo == NULL) {
-      PostMessage("Git repository not initialized.");
-      return;
-    }
-    GitGetBranches* getBranches = new GitGetBranches(
-      this, subject, var_dictionary_args, repo);
-    getBranches->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::GetBranches, getBranches));
-  } else if (!cmd.compare(kCmdAdd)) {
-    if (repo == NULL) {
-      PostMessage("Git repository not initialized.");
-      return;
-    }
-    GitAdd* add = new GitAdd(this, subject, var_dictionary_args, repo);
-    add->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::Add, add));
-  } else if (!cmd.compare(kCmdStatus)) {
-    if (repo == NULL) {
-      PostMessage("Git repository not initialized.");
-      return;
-    }
-    GitStatus* status = new GitStatus(this, subject, var_dictionary_args, repo);
-    status->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::Status, status));
-  } else if (!cmd.compare(kLsRemote)) {
-    if (repo == NULL) {
-      PostMessage("Git repository not initialized.");
-      return;
-    }
-    GitLsRemote* lsRemote = new GitLsRemote(this, subject, var_dictionary_args, repo);
-    lsRemote->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::LsRemote, lsRemote));
-  } else if (!cmd.compare(kCmdInit)) {
-    GitInit* init = new GitInit(this, subject, var_dictionary_args, repo);
-    init->parseArgs();
-    file_thread_.message_loop().PostWork(
-        callback_factory_.NewCallback(&GitSaltInstance::InitRepo, init));
+void GitSaltInstance::DispatchCommand(const char* name, size_t length,
+    const std::string& subject, const pp::VarDictionary& args) {
+  // Queued before the first command at the highest priority, so it runs
+  // before any command does.
+  if (!runtime_posted_) {
+    runtime_posted_ = true;
+    scheduler_.post(Scheduler::kInteractive,
+        callback_factory_.NewCallback(&GitSaltInstance::InitRuntime));
   }
+
+  int id = command_table_.find(name, length);
+  if (id < 0) {
+    return;
+  }
+
+  const CommandSpec& spec = commands_[id];
+  if (spec.needsRepo && repo == NULL) {
+    PostMessage("Git repository not initialized.");
+    return;
+  }
+  (this->*spec.post)(subject, args, spec.priority);
+}
+
+void GitSaltInstance::AddCommand(const char* name,
+    Scheduler::Priority priority, bool needsRepo, CommandPoster post) {
+  CommandSpec spec = { priority, needsRepo, post };
+  command_table_.add(name, commands_.size());
+  commands_.push_back(spec);
+}
+
+template <class Command, int (GitSaltInstance::*Handler)(int32_t, Command*)>
+void GitSaltInstance::PostCommand(const std::string& subject,
+    const pp::VarDictionary& args, Scheduler::Priority priority) {
+  Command* command = new Command(this, subject, args, repo);
+  command->parseArgs();
+  scheduler_.post(priority, callback_factory_.NewCallback(Handler, command));
+}
+
+void GitSaltInstance::PostMaintenance(const std::string& subject,
+    const pp::VarDictionary& args, Scheduler::Priority priority) {
+  GitMaintenance* maintenance = new GitMaintenance(this, subject, args, repo);
+  maintenance->parseArgs();
+  scheduler_.post(priority,
+      callback_factory_.NewCallback(&GitSaltInstance::Maintenance,
+          maintenance), maintenance->idle ? kIdleDelayMs : 0);
+}
+
+void GitSaltInstance::AddCommands() {
+  // Queries someone is waiting on go first; long jobs that nobody watches
+  // closely give way to everything else.
+  const Scheduler::Priority interactive = Scheduler::kInteractive;
+  const Scheduler::Priority normal = Scheduler::kNormal;
+  const Scheduler::Priority background = Scheduler::kBackground;
+
+  AddCommand(kCmdAdd, normal, true,
+      &GitSaltInstance::PostCommand<GitAdd, &GitSaltInstance::Add>);
+  AddCommand(kCmdArchive, normal, true,
+      &GitSaltInstance::PostCommand<GitArchive, &GitSaltInstance::Archive>);
+  AddCommand(kCmdBlame, interactive, true,
+      &GitSaltInstance::PostCommand<GitBlame, &GitSaltInstance::Blame>);
+  AddCommand(kCmdBranchOverview, interactive, true,
+      &GitSaltInstance::PostCommand<GitBranchOverview,
+          &GitSaltInstance::BranchOverview>);
+  AddCommand(kCmdCheckout, normal, true,
+      &GitSaltInstance::PostCommand<GitCheckout, &GitSaltInstance::Checkout>);
+  AddCommand(kCmdClone, background, false,
+      &GitSaltInstance::PostCommand<GitClone, &GitSaltInstance::Clone>);
+  AddCommand(kCmdCommit, normal, true,
+      &GitSaltInstance::PostCommand<GitCommit, &GitSaltInstance::Commit>);
+  AddCommand(kCmdCurrentBranch, interactive, true,
+      &GitSaltInstance::PostCommand<GitCurrentBranch,
+          &GitSaltInstance::CurrentBranch>);
+  AddCommand(kCmdDiff, interactive, true,
+      &GitSaltInstance::PostCommand<GitDiff, &GitSaltInstance::Diff>);
+  AddCommand(kCmdGetBranches, interactive, true,
+      &GitSaltInstance::PostCommand<GitGetBranches,
+          &GitSaltInstance::GetBranches>);
+  AddCommand(kCmdGrep, normal, true,
+      &GitSaltInstance::PostCommand<GitGrep, &GitSaltInstance::Grep>);
+  AddCommand(kCmdInit, normal, false,
+      &GitSaltInstance::PostCommand<GitInit, &GitSaltInstance::InitRepo>);
+  AddCommand(kLsRemote, normal, true,
+      &GitSaltInstance::PostCommand<GitLsRemote, &GitSaltInstance::LsRemote>);
+  AddCommand(kCmdLsTree, interactive, true,
+      &GitSaltInstance::PostCommand<GitLsTree, &GitSaltInstance::LsTree>);
+  AddCommand(kCmdMaintenance, background, true,
+      &GitSaltInstance::PostMaintenance);
+  AddCommand(kCmdMerge, normal, true,
+      &GitSaltInstance::PostCommand<GitMerge, &GitSaltInstance::Merge>);
+  AddCommand(kCmdPrefetch, normal, true,
+      &GitSaltInstance::PostCommand<GitPrefetch, &GitSaltInstance::Prefetch>);
+  AddCommand(kCmdReadBlob, interactive, true,
+      &GitSaltInstance::PostCommand<GitReadBlob, &GitSaltInstance::ReadBlob>);
+  AddCommand(kCmdResolve, interactive, true,
+      &GitSaltInstance::PostCommand<GitResolve, &GitSaltInstance::Resolve>);
+  AddCommand(kCmdSearch, normal, true,
+      &GitSaltInstance::PostCommand<GitSearch, &GitSaltInstance::Search>);
+  AddCommand(kCmdSparseCheckout, normal, true,
+      &GitSaltInstance::PostCommand<GitSparseCheckout,
+          &GitSaltInstance::SparseCheckout>);
+  AddCommand(kCmdStats, interactive, false,
+      &GitSaltInstance::PostCommand<GitStats, &GitSaltInstance::Stats>);
+  AddCommand(kCmdStatus, interactive, true,
+      &GitSaltInstance::PostCommand<GitStatus, &GitSaltInstance::Status>);
+  AddCommand(kCmdSubscribe, interactive, true,
+      &GitSaltInstance::PostCommand<GitSubscribe,
+          &GitSaltInstance::Subscribe>);
+  AddCommand(kCmdUnsubscribe, interactive, false,
+      &GitSaltInstance::PostCommand<GitUnsubscribe,
+          &GitSaltInstance::Unsubscribe>);
 }
 
 int GitSaltInstance::Clone(int32_t r, GitClone* clone) {
@@ -149,55 +255,191 @@ int GitSaltInstance::GetBranches(int32_t r, GitGetBranches* getBranches) {
   return 0;
 }
 
+int GitSaltInstance::BranchOverview(int32_t r, GitBranchOverview* overview) {
+  overview->runCommand();
+  return 0;
+}
+
 int GitSaltInstance::Add(int32_t r, GitAdd* add) {
   add->runCommand();
   return 0;
 }
 
+int GitSaltInstance::Archive(int32_t r, GitArchive* archive) {
+  archive->runCommand();
+  return 0;
+}
+
 int GitSaltInstance::Status(int32_t r, GitStatus* status) {
   status->runCommand();
   return 0;
 }
 
-int GitSaltInstance::LsRemote(int32_t r, GitLsRemote* lsRemote) {
-  lsRemote->runCommand();
+int GitSaltInstance::Diff(int32_t r, GitDiff* diff) {
+  diff->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Blame(int32_t r, GitBlame* blame) {
+  blame->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::LsTree(int32_t r, GitLsTree* lsTree) {
+  lsTree->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Grep(int32_t r, GitGrep* grep) {
+  grep->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::ReadBlob(int32_t r, GitReadBlob* readBlob) {
+  readBlob->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Resolve(int32_t r, GitResolve* resolve) {
+  resolve->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Search(int32_t r, GitSearch* search) {
+  search->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::SparseCheckout(int32_t r,
+                                    GitSparseCheckout* sparseCheckout) {
+  sparseCheckout->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Stats(int32_t r, GitStats* stats) {
+  stats->runCommand();
   return 0;
 }
 
-void GitSaltInstance::OpenFileSystem(int32_t /* result */) {
-  int32_t rv = file_system_.Open(1024 * 1024, pp::BlockUntilComplete());
-  if (rv == PP_OK) {
-    file_system_ready_ = true;
-    // Notify the user interface that we're ready
-    PostMessage("READY|");
-  } else {
-    ShowErrorMessage("Failed to open file system", rv);
+int GitSaltInstance::Subscribe(int32_t r, GitSubscribe* subscribe) {
+  subscribe->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Unsubscribe(int32_t r, GitUnsubscribe* unsubscribe) {
+  unsubscribe->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Checkout(int32_t r, GitCheckout* checkout) {
+  checkout->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::Maintenance(int32_t r, GitMaintenance* maintenance) {
+  // Idle work steps aside for as long as other messages keep coming.
+  double quiet = nowMs() - last_message_ms_;
+  if (maintenance->idle && quiet < kIdleDelayMs) {
+    scheduler_.post(Scheduler::kBackground,
+        callback_factory_.NewCallback(&GitSaltInstance::Maintenance,
+            maintenance), kIdleDelayMs - (int64_t) quiet);
+    return 0;
   }
-  NaclIoInit();
+  maintenance->runCommand();
+  return 0;
 }
 
-void GitSaltInstance::NaclIoInit() {
+int GitSaltInstance::Prefetch(int32_t r, GitPrefetch* prefetch) {
+  prefetch->runCommand();
+  if (prefetcher_.intervalMs()) {
+    scheduler_.post(Scheduler::kBackground,
+        callback_factory_.NewCallback(&GitSaltInstance::PrefetchPass,
+            prefetch->generation), prefetcher_.nextDelayMs());
+  }
+  return 0;
+}
+
+int GitSaltInstance::PrefetchPass(int32_t r, unsigned generation) {
+  // Prefetching was turned off or restarted since this pass was scheduled.
+  if (generation != prefetcher_.generation() || repo == NULL) {
+    return 0;
+  }
+
+  double quiet = nowMs() - last_message_ms_;
+  int64_t delay = kIdleDelayMs - (int64_t) quiet;
+  if (quiet >= kIdleDelayMs) {
+    if (prefetcher_.fetch(repo, &scheduler_)) {
+      const git_error *a = giterr_last();
+      if (a != NULL) {
+        printf("giterror: %s\n", a->message);
+      }
+    }
+    delay = prefetcher_.nextDelayMs();
+  }
+  scheduler_.post(Scheduler::kBackground,
+      callback_factory_.NewCallback(&GitSaltInstance::PrefetchPass,
+          generation), delay);
+  return 0;
+}
+
+int GitSaltInstance::Merge(int32_t r, GitMerge* merge) {
+  merge->runCommand();
+  return 0;
+}
+
+int GitSaltInstance::LsRemote(int32_t r, GitLsRemote* lsRemote) {
+  lsRemote->runCommand();
+  return 0;
+}
+
+void GitSaltInstance::InitRuntime(int32_t /* result */) {
+  double start = nowMs();
   nacl_io_init_ppapi(pp::Instance::pp_instance(),
       pp::Module::Get()->get_browser_interface());
 
   // By default, nacl_io mounts / to pass through to the original NaCl
   // filesystem (which doesn't do much). Let's remount it to a memfs
-  // filesystem.
+  // filesystem. The other file systems are mounted on first use.
   umount("/");
   mount("", "/", "memfs", 0, "");
+  startup_timer_.record(kPhaseNaclIo, start);
+
+  start = nowMs();
+  git_threads_init();
+  startup_timer_.record(kPhaseLibgit2, start);
+
+  start = nowMs();
+  worker_pool_.start();
+  startup_timer_.record(kPhaseWorkers, start);
+}
 
-  mount("",                                     /* source */
-      "/grvfs",                                 /* target */
-      "html5fs",                                /* filesystemtype */
-      0,                                        /* mountflags */
-      "type=PERSISTENT,expected_size=1048576"); /* data */
-
-  mount("",       /* source. Use relative URL */
-      "/http",  /* target */
-      "httpfs", /* filesystemtype */
-      0,        /* mountflags */
-      "");      /* data */
-  printf("mounted all filesystem!!\n");
+void GitSaltInstance::EnsureMounted(const std::string& path) {
+  for (size_t i = 0; i < sizeof(kDeferredMounts) / sizeof(*kDeferredMounts);
+       ++i) {
+    const DeferredMount& deferred = kDeferredMounts[i];
+    std::string target = deferred.target;
+    if (path.compare(0, target.length(), target) != 0 ||
+        (path.length() > target.length() && path[target.length()] != '/') ||
+        mounted_.count(target)) {
+      continue;
+    }
+    double start = nowMs();
+    if (!mount("", deferred.target, deferred.type, 0, deferred.data)) {
+      mounted_.insert(target);
+    }
+    startup_timer_.record(target, start);
+  }
+}
+
+void GitSaltInstance::CloseRepository() {
+  // A subscription is to the refs of the repository going away.
+  ref_watcher_.stop();
+  git_repository_free(repo);
+  repo = NULL;
+  if (!repo_mount_.empty()) {
+    mount_registry_.release(repo_mount_);
+    repo_mount_.clear();
+  }
 }
 
 void GitSaltInstance::ShowErrorMessage(const std::string& message, int32_t result) {
@@ -5,28 +5,64 @@
 #ifndef GIT_SALT_GIT_SALT_H__
 #define GIT_SALT_GIT_SALT_H__
 
+#include <set>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "ppapi/cpp/file_system.h"
 #include "ppapi/cpp/instance.h"
 #include "ppapi/cpp/message_loop.h"
 #include "ppapi/cpp/module.h"
+#include "ppapi/cpp/var_array_buffer.h"
 #include "ppapi/cpp/var_dictionary.h"
 #include "ppapi/utility/completion_callback_factory.h"
 #include "ppapi/utility/threading/simple_thread.h"
 #include "nacl_io/nacl_io.h"
 
+#include "ahead_behind_cache.h"
+#include "blame_cache.h"
+#include "command_table.h"
 #include "git_command.h"
+#include "mount_registry.h"
+#include "pack_indexer.h"
+#include "prefetcher.h"
+#include "ref_snapshot.h"
+#include "ref_state.h"
+#include "ref_watcher.h"
+#include "rename_detector.h"
+#include "revision_cache.h"
+#include "scheduler.h"
+#include "timing.h"
+#include "tree_cache.h"
+#include "trigram_index.h"
+#include "worker_pool.h"
 
 class GitAdd;
+class GitArchive;
+class GitBlame;
+class GitBranchOverview;
+class GitCheckout;
 class GitClone;
 class GitCommit;
 class GitCurrentBranch;
+class GitDiff;
 class GitGetBranches;
+class GitGrep;
 class GitInit;
 class GitLsRemote;
+class GitLsTree;
+class GitMaintenance;
+class GitMerge;
+class GitPrefetch;
+class GitReadBlob;
+class GitResolve;
+class GitSearch;
+class GitSparseCheckout;
+class GitStats;
 class GitStatus;
+class GitSubscribe;
+class GitUnsubscribe;
 
 /// The Instance class.  One of these exists for each instance of your NaCl
 /// module on the web page.  The browser will ask the Module object to create
@@ -43,26 +79,157 @@ class GitSaltInstance : public pp::Instance {
                     const char * /*argn*/ [],
                     const char * /*argv*/ []);
 
+  WorkerPool* workerPool() { return &worker_pool_; }
+
+  SimilarityCache* similarityCache() { return &similarity_cache_; }
+
+  BlameCache* blameCache() { return &blame_cache_; }
+
+  TreeCache* treeCache() { return &tree_cache_; }
+
+  AheadBehindCache* aheadBehindCache() { return &ahead_behind_cache_; }
+
+  RefState* refState() { return &ref_state_; }
+
+  RefSnapshot* refSnapshot() { return &ref_snapshot_; }
+
+  RevisionCache* revisionCache() { return &revision_cache_; }
+
+  RefWatcher* refWatcher() { return &ref_watcher_; }
+
+  Scheduler* scheduler() { return &scheduler_; }
+
+  Prefetcher* prefetcher() { return &prefetcher_; }
+
+  PackIndexStats* packIndexStats() { return &pack_index_stats_; }
+
+  TrigramIndex* trigramIndex() { return &trigram_index_; }
+
+  StartupTimer* startupTimer() { return &startup_timer_; }
+
+  MountRegistry* mountRegistry() { return &mount_registry_; }
+
+  // Mount point of the working tree of the open repository.
+  const std::string& repositoryMount() { return repo_mount_; }
+
+  void SetRepositoryMount(const std::string& mount) { repo_mount_ = mount; }
+
+  /**
+   * Frees the open repository and releases the mount of its working tree,
+   * so another one can be opened. Call on the file_thread_.
+   */
+  void CloseRepository();
+
+  /**
+   * Mounts the deferred file system that |path| lies in, if it has not been
+   * mounted yet. Call on the file_thread_ before touching |path|.
+   */
+  void EnsureMounted(const std::string& path);
+
  private:
+  // Created first, so phases are timed from the creation of the instance.
+  StartupTimer startup_timer_;
+
   pp::CompletionCallbackFactory<GitSaltInstance> callback_factory_;
-  pp::FileSystem file_system_;
   git_repository* repo;
 
-  // Indicates whether file_system_ was opened successfully. We only read/write
-  // this on the file_thread_.
-  bool file_system_ready_;
+  // Whether InitRuntime has been queued. Only used on the main thread.
+  bool runtime_posted_;
+
+  // Deferred mounts done so far. Only used on the file_thread_.
+  std::set<std::string> mounted_;
+
+  // Working tree mounts, kept for reuse when switching between projects.
+  MountRegistry mount_registry_;
+  std::string repo_mount_;
 
   // We do all our file operations on the file_thread_.
   pp::SimpleThread file_thread_;
 
+  // Commands reach the file_thread_ through this, most urgent first.
+  Scheduler scheduler_;
+
+  // Commands running on the file_thread_ fan CPU bound work out to this pool.
+  WorkerPool worker_pool_;
+
+  // Rename detection signatures, kept across status and diff calls.
+  SimilarityCache similarity_cache_;
+
+  // Blamed line ranges by (path, commit), so scrolling back is free.
+  BlameCache blame_cache_;
+
+  // Tree listings by tree OID for browsing at a revision.
+  TreeCache tree_cache_;
+
+  // Ahead/behind counts by (tip, upstream) for the branch overview.
+  AheadBehindCache ahead_behind_cache_;
+
+  // When the last message came in, so idle work can wait for a quiet spell.
+  double last_message_ms_;
+
+  // Stat fingerprint of the refs, used to invalidate ref dependent caches.
+  RefState ref_state_;
+
+  // Current branch and branch lists for as long as the refs are unchanged.
+  RefSnapshot ref_snapshot_;
+
+  // Resolved revspecs, valid for one refs generation.
+  RevisionCache revision_cache_;
+
+  // Pushes ref changes to the subscriber instead of being polled.
+  RefWatcher ref_watcher_;
+
+  // Keeps remote objects fetched ahead of a pull while the user is idle.
+  Prefetcher prefetcher_;
+
+  // Phase timings of the packs received by clones and fetches.
+  PackIndexStats pack_index_stats_;
+
+  // Trigram posting lists of the tree last searched, saved in the git dir.
+  TrigramIndex trigram_index_;
+
+  // Creates the command for a message, parses its arguments and queues it.
+  typedef void (GitSaltInstance::*CommandPoster)(const std::string& subject,
+      const pp::VarDictionary& args, Scheduler::Priority priority);
+
+  struct CommandSpec {
+    Scheduler::Priority priority;
+    // Refused until a repository is open.
+    bool needsRepo;
+    CommandPoster post;
+  };
+
+  // Command specs by the ids the table maps command names to.
+  CommandTable command_table_;
+  std::vector<CommandSpec> commands_;
+
   /// Handler for messages coming in from the browser via postMessage().  The
-  /// @a var_message is a json dictionary.
+  /// @a var_message is a json dictionary, or an ArrayBuffer holding a
+  /// MessageFrame.
   ///
   /// Here we use messages to communicate with the user interface
   ///
   /// @param[in] var_message The message posted by the browser.
   virtual void HandleMessage(const pp::Var& var_message);
 
+  void HandleFrame(pp::VarArrayBuffer buffer);
+
+  void DispatchCommand(const char* name, size_t length,
+      const std::string& subject, const pp::VarDictionary& args);
+
+  void AddCommands();
+
+  void AddCommand(const char* name, Scheduler::Priority priority,
+      bool needsRepo, CommandPoster post);
+
+  template <class Command, int (GitSaltInstance::*Handler)(int32_t, Command*)>
+  void PostCommand(const std::string& subject, const pp::VarDictionary& args,
+      Scheduler::Priority priority);
+
+  // Idle maintenance is queued with a delay.
+  void PostMaintenance(const std::string& subject,
+      const pp::VarDictionary& args, Scheduler::Priority priority);
+
   int Clone(int32_t r, GitClone* clone);
 
   int InitRepo(int32_t r, GitInit* init);
@@ -73,15 +240,51 @@ class GitSaltInstance : public pp::Instance {
 
   int GetBranches(int32_t r, GitGetBranches* getBranches);
 
+  int BranchOverview(int32_t r, GitBranchOverview* overview);
+
   int Add(int32_t, GitAdd* add);
 
+  int Archive(int32_t r, GitArchive* archive);
+
   int Status(int32_t r, GitStatus* status);
 
-  int LsRemote(int32_t r, GitLsRemote* lsRemote);
+  int Diff(int32_t r, GitDiff* diff);
 
-  void OpenFileSystem(int32_t /* result */);
+  int Blame(int32_t r, GitBlame* blame);
+
+  int LsTree(int32_t r, GitLsTree* lsTree);
+
+  int Checkout(int32_t r, GitCheckout* checkout);
+
+  int Merge(int32_t r, GitMerge* merge);
+
+  int Grep(int32_t r, GitGrep* grep);
+
+  int Maintenance(int32_t r, GitMaintenance* maintenance);
+
+  int Prefetch(int32_t r, GitPrefetch* prefetch);
+
+  int PrefetchPass(int32_t r, unsigned generation);
+
+  int ReadBlob(int32_t r, GitReadBlob* readBlob);
+
+  int Resolve(int32_t r, GitResolve* resolve);
+
+  int Search(int32_t r, GitSearch* search);
+
+  int SparseCheckout(int32_t r, GitSparseCheckout* sparseCheckout);
+
+  int Stats(int32_t r, GitStats* stats);
+
+  int Subscribe(int32_t r, GitSubscribe* subscribe);
+
+  int Unsubscribe(int32_t r, GitUnsubscribe* unsubscribe);
+
+  int LsRemote(int32_t r, GitLsRemote* lsRemote);
 
-  void NaclIoInit();
+  /// Sets up nacl_io, libgit2 and the worker pool. Queued ahead of the
+  /// first command rather than run at startup.
+  void InitRuntime(int32_t /* result */);
 
   /// Encapsulates our simple javascript communication protocol
   void ShowErrorMessage(const std::string& message, int32_t result);
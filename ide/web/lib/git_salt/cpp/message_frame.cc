@@ -0,0 +1,115 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "message_frame.h"
+
+#include "ppapi/cpp/var_array.h"
+
+namespace {
+const uint8_t kFrameVersion = 1;
+}
+
+MessageFrame::MessageFrame()
+    : _pos(NULL), _end(NULL), _name(NULL), _nameLength(0) {}
+
+bool MessageFrame::readVarint(uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && _pos < _end; shift += 7) {
+    uint8_t byte = *_pos++;
+    *value |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MessageFrame::readString(const char** data, size_t* length) {
+  uint64_t n;
+  if (!readVarint(&n) || n > (uint64_t) (_end - _pos)) {
+    return false;
+  }
+  *data = _pos;
+  *length = n;
+  _pos += n;
+  return true;
+}
+
+bool MessageFrame::readValue(uint8_t type, pp::Var* value) {
+  const char* data;
+  size_t length;
+  uint64_t n;
+
+  switch (type) {
+    case kFalse:
+    case kTrue:
+      *value = pp::Var(type == kTrue);
+      return true;
+    case kInt: {
+      if (!readVarint(&n)) {
+        return false;
+      }
+      int64_t i = (int64_t) (n >> 1) ^ -(int64_t) (n & 1);
+      // Numbers beyond an int arrive as doubles, as they would from script.
+      if (i == (int32_t) i) {
+        *value = pp::Var((int) i);
+      } else {
+        *value = pp::Var((double) i);
+      }
+      return true;
+    }
+    case kString:
+      if (!readString(&data, &length)) {
+        return false;
+      }
+      *value = pp::Var(std::string(data, length));
+      return true;
+    case kStrings: {
+      // Every string takes at least its length byte.
+      if (!readVarint(&n) || n > (uint64_t) (_end - _pos)) {
+        return false;
+      }
+      pp::VarArray strings;
+      strings.SetLength((uint32_t) n);
+      for (uint32_t i = 0; i < n; ++i) {
+        if (!readString(&data, &length)) {
+          return false;
+        }
+        strings.Set(i, pp::Var(std::string(data, length)));
+      }
+      *value = strings;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MessageFrame::decode(const char* data, size_t size) {
+  _pos = data;
+  _end = data + size;
+  if (_pos == _end || (uint8_t) *_pos++ != kFrameVersion) {
+    return false;
+  }
+
+  const char* subject;
+  size_t subjectLength;
+  uint64_t count;
+  if (!readString(&_name, &_nameLength) ||
+      !readString(&subject, &subjectLength) || !readVarint(&count)) {
+    return false;
+  }
+  _subject.assign(subject, subjectLength);
+
+  for (uint64_t i = 0; i < count; ++i) {
+    const char* key;
+    size_t keyLength;
+    pp::Var value;
+    if (!readString(&key, &keyLength) || _pos == _end ||
+        !readValue((uint8_t) *_pos++, &value)) {
+      return false;
+    }
+    _args.Set(pp::Var(std::string(key, keyLength)), value);
+  }
+  return _pos == _end;
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_MESSAGE_FRAME_H__
+#define GIT_SALT_MESSAGE_FRAME_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "ppapi/cpp/var.h"
+#include "ppapi/cpp/var_dictionary.h"
+
+/**
+ * A request posted as a single ArrayBuffer instead of a dictionary. The page
+ * encodes it without building nested objects, and the whole message crosses
+ * over as one buffer rather than as a structured clone of every value:
+ *
+ *   frame  := version:u8 name:string subject:string count:varint arg*
+ *   arg    := key:string type:u8 value
+ *   string := length:varint utf8
+ *
+ * Values are kFalse and kTrue (no bytes), kInt (zigzag varint), kString and
+ * kStrings (count:varint string*). File system resources cannot be framed,
+ * so commands taking one are always posted as dictionaries.
+ */
+class MessageFrame {
+ public:
+  enum Type {
+    kFalse,
+    kTrue,
+    kInt,
+    kString,
+    kStrings
+  };
+
+  MessageFrame();
+
+  // Decodes the frame in |data| in one pass. Returns false if malformed.
+  bool decode(const char* data, size_t size);
+
+  // The command name, pointing into the decoded data.
+  const char* name() const { return _name; }
+  size_t nameLength() const { return _nameLength; }
+
+  const std::string& subject() const { return _subject; }
+
+  const pp::VarDictionary& args() const { return _args; }
+
+ private:
+  bool readVarint(uint64_t* value);
+
+  bool readString(const char** data, size_t* length);
+
+  bool readValue(uint8_t type, pp::Var* value);
+
+  const char* _pos;
+  const char* _end;
+  const char* _name;
+  size_t _nameLength;
+  std::string _subject;
+  pp::VarDictionary _args;
+};
+
+#endif  // GIT_SALT_MESSAGE_FRAME_H__
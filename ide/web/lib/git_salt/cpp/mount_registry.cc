@@ -0,0 +1,103 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "mount_registry.h"
+
+#include <stdio.h>
+#include <sys/mount.h>
+
+namespace {
+const char* const kMountPrefix = "/chromefs";
+
+std::string MountPoint(size_t index) {
+  // The first keeps the path working trees were always mounted at.
+  if (index == 0) {
+    return kMountPrefix;
+  }
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "%u", (unsigned) index);
+  return std::string(kMountPrefix) + suffix;
+}
+}
+
+MountRegistry::MountRegistry(size_t idleLimit)
+    : reused(0), _idleLimit(idleLimit), _ticks(0) {}
+
+int MountRegistry::acquire(const std::string& identity, int32_t resource,
+                           const std::string& source, std::string* target) {
+  for (size_t i = 0; i < _mounts.size(); ++i) {
+    Mount& mount = _mounts[i];
+    if (mount.identity == identity && mount.source == source) {
+      mount.refs++;
+      reused++;
+      *target = mount.target;
+      return 0;
+    }
+  }
+
+  Mount added;
+  added.identity = identity;
+  added.source = source;
+  added.target = freeTarget();
+  added.refs = 1;
+  added.lastUsed = ++_ticks;
+
+  char data[64];
+  snprintf(data, sizeof(data), "filesystem_resource=%d", (int) resource);
+  int r = mount(source.c_str(), added.target.c_str(), "html5fs", 0, data);
+  if (r) {
+    return r;
+  }
+  _mounts.push_back(added);
+  *target = added.target;
+  return 0;
+}
+
+void MountRegistry::release(const std::string& target) {
+  for (size_t i = 0; i < _mounts.size(); ++i) {
+    if (_mounts[i].target == target && _mounts[i].refs > 0) {
+      _mounts[i].refs--;
+      _mounts[i].lastUsed = ++_ticks;
+      break;
+    }
+  }
+  unmountIdle();
+}
+
+size_t MountRegistry::idleCount() const {
+  size_t idle = 0;
+  for (size_t i = 0; i < _mounts.size(); ++i) {
+    if (!_mounts[i].refs) {
+      idle++;
+    }
+  }
+  return idle;
+}
+
+std::string MountRegistry::freeTarget() const {
+  for (size_t index = 0;; ++index) {
+    std::string target = MountPoint(index);
+    bool used = false;
+    for (size_t i = 0; i < _mounts.size() && !used; ++i) {
+      used = _mounts[i].target == target;
+    }
+    if (!used) {
+      return target;
+    }
+  }
+}
+
+void MountRegistry::unmountIdle() {
+  while (idleCount() > _idleLimit) {
+    size_t oldest = _mounts.size();
+    for (size_t i = 0; i < _mounts.size(); ++i) {
+      if (!_mounts[i].refs && (oldest == _mounts.size() ||
+          _mounts[i].lastUsed < _mounts[oldest].lastUsed)) {
+        oldest = i;
+      }
+    }
+    umount(_mounts[oldest].target.c_str());
+    _mounts.erase(_mounts.begin() + oldest);
+  }
+}
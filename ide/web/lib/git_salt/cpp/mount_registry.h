@@ -0,0 +1,61 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_MOUNT_REGISTRY_H__
+#define GIT_SALT_MOUNT_REGISTRY_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Gives each working tree its own html5fs mount point. Mounts are keyed by
+ * file system identity and path and reference counted; one nobody holds is
+ * kept around, so going back to a recent project reuses it, until more than
+ * a few are idle and the least recently used is unmounted.
+ * Only used from the file thread.
+ */
+class MountRegistry {
+ public:
+  explicit MountRegistry(size_t idleLimit);
+
+  /**
+   * Finds the mount of |source| in the file system named |identity|, or
+   * mounts it from |resource|, and takes a reference to it. Sets |target|
+   * to the mount point. Returns the error of mount() on failure.
+   */
+  int acquire(const std::string& identity, int32_t resource,
+      const std::string& source, std::string* target);
+
+  // Drops a reference taken by acquire.
+  void release(const std::string& target);
+
+  size_t mountCount() const { return _mounts.size(); }
+  size_t idleCount() const;
+
+  // Acquires served by an existing mount.
+  size_t reused;
+
+ private:
+  struct Mount {
+    std::string identity;
+    std::string source;
+    std::string target;
+    int refs;
+    // Ticks the mount was last released at, for picking the idle to drop.
+    uint64_t lastUsed;
+  };
+
+  // The lowest numbered mount point not in use.
+  std::string freeTarget() const;
+
+  void unmountIdle();
+
+  size_t _idleLimit;
+  uint64_t _ticks;
+  std::vector<Mount> _mounts;
+};
+
+#endif  // GIT_SALT_MOUNT_REGISTRY_H__
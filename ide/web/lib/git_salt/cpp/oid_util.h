@@ -0,0 +1,26 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_OID_UTIL_H__
+#define GIT_SALT_OID_UTIL_H__
+
+#include <git2.h>
+#include <string>
+
+/**
+ * Strict weak ordering on object ids, so they can key std::map based caches.
+ */
+struct OidLess {
+  bool operator()(const git_oid& a, const git_oid& b) const {
+    return git_oid_cmp(&a, &b) < 0;
+  }
+};
+
+inline std::string oidToString(const git_oid* oid) {
+  char hex[GIT_OID_HEXSZ + 1];
+  git_oid_tostr(hex, sizeof(hex), oid);
+  return std::string(hex);
+}
+
+#endif  // GIT_SALT_OID_UTIL_H__
@@ -0,0 +1,784 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "pack_indexer.h"
+
+#include <git2/sys/odb_backend.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+
+#include "file_util.h"
+#include "oid_util.h"
+#include "sha1.h"
+#include "timing.h"
+
+namespace {
+// Bytes of inflated delta bases each chain walk may keep around.
+const size_t kDeltaBaseCacheBytes = 16 * 1024 * 1024;
+// Above the loose (1) and packed (2) backends, so fetched packs come here.
+const int kBackendPriority = 3;
+// Packs are held in memory for the parallel indexer up to this size; larger
+// ones are streamed into libgit2's indexer as they arrive instead.
+const size_t kMaxBufferedPackBytes = 64 * 1024 * 1024;
+
+const int kOfsDelta = 6;
+const int kRefDelta = 7;
+
+inline uint32_t ReadBigEndian(const char* p) {
+  const unsigned char* u = (const unsigned char*) p;
+  return ((uint32_t) u[0] << 24) | ((uint32_t) u[1] << 16) |
+      ((uint32_t) u[2] << 8) | u[3];
+}
+
+void AppendBigEndian(std::string& out, uint32_t value) {
+  char bytes[4] = {
+    (char) (value >> 24), (char) (value >> 16), (char) (value >> 8),
+    (char) value
+  };
+  out.append(bytes, 4);
+}
+
+const char* TypeName(git_otype type) {
+  switch (type) {
+    case GIT_OBJ_COMMIT:
+      return "commit";
+    case GIT_OBJ_TREE:
+      return "tree";
+    case GIT_OBJ_BLOB:
+      return "blob";
+    default:
+      return "tag";
+  }
+}
+
+void HashObject(git_otype type, const std::string& data, git_oid* id) {
+  char header[64];
+  int length = snprintf(header, sizeof(header), "%s %lu", TypeName(type),
+      (unsigned long) data.size());
+  Sha1Message message;
+  message.prefix = (const unsigned char*) header;
+  message.prefixSize = length + 1;
+  message.data = (const unsigned char*) data.data();
+  message.size = data.size();
+  sha1Hash(&message);
+  git_oid_fromraw(id, message.digest);
+}
+
+bool ReadDeltaSize(const std::string& delta, size_t* pos, size_t* size) {
+  *size = 0;
+  unsigned char c;
+  int shift = 0;
+  do {
+    if (*pos >= delta.size() || shift > 56) {
+      return false;
+    }
+    c = delta[(*pos)++];
+    *size |= (size_t) (c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return true;
+}
+
+// Rebuilds an object from its |base| and a git delta.
+bool ApplyDelta(const std::string& base, const std::string& delta,
+                std::string* out) {
+  size_t pos = 0;
+  size_t baseSize, resultSize;
+  if (!ReadDeltaSize(delta, &pos, &baseSize) || baseSize != base.size() ||
+      !ReadDeltaSize(delta, &pos, &resultSize)) {
+    return false;
+  }
+
+  out->clear();
+  out->reserve(resultSize);
+  while (pos < delta.size()) {
+    unsigned char op = delta[pos++];
+    if (op & 0x80) {
+      // Copy from the base; the low bits say which offset and size bytes
+      // follow.
+      size_t offset = 0, size = 0;
+      for (int i = 0; i < 4; ++i) {
+        if (op & (1 << i)) {
+          if (pos >= delta.size()) {
+            return false;
+          }
+          offset |= (size_t) (unsigned char) delta[pos++] << (8 * i);
+        }
+      }
+      for (int i = 0; i < 3; ++i) {
+        if (op & (0x10 << i)) {
+          if (pos >= delta.size()) {
+            return false;
+          }
+          size |= (size_t) (unsigned char) delta[pos++] << (8 * i);
+        }
+      }
+      if (size == 0) {
+        size = 0x10000;
+      }
+      if (offset > base.size() || size > base.size() - offset) {
+        return false;
+      }
+      out->append(base, offset, size);
+    } else if (op) {
+      // Insert the next |op| bytes of the delta.
+      if (op > delta.size() - pos) {
+        return false;
+      }
+      out->append(delta, pos, op);
+      pos += op;
+    } else {
+      return false;
+    }
+  }
+  return out->size() == resultSize;
+}
+
+template <typename Entry>
+struct EntryIdLess {
+  const std::vector<Entry>* entries;
+
+  bool operator()(size_t a, size_t b) const {
+    return git_oid_cmp(&(*entries)[a].id, &(*entries)[b].id) < 0;
+  }
+};
+
+template <typename Entry>
+struct EntryOffsetLess {
+  bool operator()(const Entry& entry, size_t offset) const {
+    return entry.offset < offset;
+  }
+};
+}
+
+/**
+ * Inflated delta bases by entry, least recently used dropped first once
+ * they add up to more than the byte limit. Each chain walk has its own, so
+ * it needs no locking.
+ */
+class PackIndexer::BaseCache {
+ public:
+  explicit BaseCache(size_t maxBytes)
+      : hits(0), misses(0), _maxBytes(maxBytes), _bytes(0) {}
+
+  bool get(size_t index, std::string* out) {
+    std::map<size_t, std::list<Item>::iterator>::iterator it =
+        _index.find(index);
+    if (it == _index.end()) {
+      misses++;
+      return false;
+    }
+    hits++;
+    _items.splice(_items.begin(), _items, it->second);
+    *out = it->second->data;
+    return true;
+  }
+
+  void put(size_t index, const std::string& data) {
+    if (data.size() > _maxBytes || _index.count(index)) {
+      return;
+    }
+    _items.push_front(Item());
+    _items.front().index = index;
+    _items.front().data = data;
+    _index[index] = _items.begin();
+    _bytes += data.size();
+
+    while (_bytes > _maxBytes) {
+      Item& last = _items.back();
+      _bytes -= last.data.size();
+      _index.erase(last.index);
+      _items.pop_back();
+    }
+  }
+
+  size_t hits;
+  size_t misses;
+
+ private:
+  struct Item {
+    size_t index;
+    std::string data;
+  };
+
+  size_t _maxBytes;
+  size_t _bytes;
+  std::list<Item> _items;
+  std::map<size_t, std::list<Item>::iterator> _index;
+};
+
+PackIndexer::PackIndexer(WorkerPool* pool, size_t cacheBytes)
+    : _pool(pool), _cacheBytes(cacheBytes), _data(NULL), _deltas(0),
+      _cacheHits(0), _cacheMisses(0), _failed(false) {
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+PackIndexer::~PackIndexer() {
+  pthread_mutex_destroy(&_mutex);
+}
+
+bool PackIndexer::inflateEntry(const Entry& entry, std::string* out,
+                               size_t* end) {
+  const std::string& data = *_data;
+  size_t limit = data.size() - 20;
+
+  // One spare byte, so an object longer than its header says is caught.
+  out->resize(entry.size + 1);
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit(&stream) != Z_OK) {
+    return false;
+  }
+  stream.next_in = (Bytef*) data.data() + entry.dataOffset;
+  stream.avail_in = (uInt) (limit - entry.dataOffset);
+  stream.next_out = (Bytef*) &(*out)[0];
+  stream.avail_out = (uInt) out->size();
+
+  bool ok = ::inflate(&stream, Z_FINISH) == Z_STREAM_END &&
+      stream.total_out == entry.size;
+  if (end != NULL) {
+    *end = entry.dataOffset + stream.total_in;
+  }
+  inflateEnd(&stream);
+  out->resize(entry.size);
+  return ok;
+}
+
+bool PackIndexer::parseEntry(size_t index, size_t* pos, std::string* buffer) {
+  const std::string& data = *_data;
+  size_t limit = data.size() - 20;
+  Entry& entry = _entries[index];
+  entry.offset = *pos;
+  entry.base = kNone;
+
+  size_t p = *pos;
+  if (p >= limit) {
+    return false;
+  }
+  unsigned char c = data[p++];
+  entry.packType = (c >> 4) & 7;
+  entry.size = c & 15;
+  for (int shift = 4; c & 0x80; shift += 7) {
+    if (p >= limit || shift > 56) {
+      return false;
+    }
+    c = data[p++];
+    entry.size |= (size_t) (c & 0x7f) << shift;
+  }
+
+  if (entry.packType == kOfsDelta) {
+    // The base is this many bytes further back, in git's offset encoding.
+    if (p >= limit) {
+      return false;
+    }
+    c = data[p++];
+    size_t distance = c & 0x7f;
+    while (c & 0x80) {
+      if (p >= limit || distance > (entry.offset >> 7)) {
+        return false;
+      }
+      c = data[p++];
+      distance = ((distance + 1) << 7) | (c & 0x7f);
+    }
+    if (distance == 0 || distance > entry.offset) {
+      return false;
+    }
+    std::vector<Entry>::iterator end = _entries.begin() + index;
+    std::vector<Entry>::iterator base = std::lower_bound(_entries.begin(),
+        end, entry.offset - distance, EntryOffsetLess<Entry>());
+    if (base == end || base->offset != entry.offset - distance) {
+      return false;
+    }
+    entry.base = base - _entries.begin();
+  } else if (entry.packType == kRefDelta) {
+    if (limit - p < GIT_OID_RAWSZ) {
+      return false;
+    }
+    git_oid_fromraw(&entry.baseId, (const unsigned char*) &data[p]);
+    p += GIT_OID_RAWSZ;
+  } else if (entry.packType < GIT_OBJ_COMMIT ||
+             entry.packType > GIT_OBJ_TAG) {
+    return false;
+  }
+
+  entry.dataOffset = p;
+  if (!inflateEntry(entry, buffer, &entry.end)) {
+    return false;
+  }
+  entry.crc = crc32(0, (const Bytef*) data.data() + entry.offset,
+      (uInt) (entry.end - entry.offset));
+
+  // Whole objects are hashed right away, while they are inflated.
+  if (entry.packType <= GIT_OBJ_TAG) {
+    entry.type = (git_otype) entry.packType;
+    HashObject(entry.type, *buffer, &entry.id);
+    entry.resolved = true;
+  }
+  *pos = entry.end;
+  return true;
+}
+
+int PackIndexer::parse() {
+  const std::string& data = *_data;
+  if (data.size() < 32 || data.compare(0, 4, "PACK") != 0) {
+    giterr_set_str(GITERR_INDEXER, "not a pack");
+    return -1;
+  }
+  uint32_t version = ReadBigEndian(data.data() + 4);
+  uint32_t count = ReadBigEndian(data.data() + 8);
+  size_t limit = data.size() - 20;
+  if ((version != 2 && version != 3) || count > limit) {
+    giterr_set_str(GITERR_INDEXER, "unsupported pack");
+    return -1;
+  }
+
+  Sha1Message checksum;
+  checksum.prefix = NULL;
+  checksum.prefixSize = 0;
+  checksum.data = (const unsigned char*) data.data();
+  checksum.size = limit;
+  sha1Hash(&checksum);
+  if (memcmp(checksum.digest, data.data() + limit, 20)) {
+    giterr_set_str(GITERR_INDEXER, "pack checksum mismatch");
+    return -1;
+  }
+
+  _entries.resize(count);
+  std::string buffer;
+  size_t pos = 12;
+  size_t parsed = 0;
+  while (parsed < count && parseEntry(parsed, &pos, &buffer)) {
+    parsed++;
+  }
+
+  if (parsed != count || pos != limit) {
+    giterr_set_str(GITERR_INDEXER, "corrupt pack");
+    return -1;
+  }
+  return 0;
+}
+
+size_t PackIndexer::attachRefDeltas() {
+  std::map<git_oid, size_t, OidLess> ids;
+  for (size_t i = 0; i < _entries.size(); ++i) {
+    if (_entries[i].resolved) {
+      ids[_entries[i].id] = i;
+    }
+  }
+
+  size_t attached = 0;
+  for (size_t i = 0; i < _entries.size(); ++i) {
+    Entry& entry = _entries[i];
+    if (entry.packType != kRefDelta || entry.base != kNone) {
+      continue;
+    }
+    std::map<git_oid, size_t, OidLess>::iterator base =
+        ids.find(entry.baseId);
+    if (base != ids.end()) {
+      entry.base = base->second;
+      _children[entry.base].push_back(i);
+      attached++;
+    }
+  }
+  return attached;
+}
+
+bool PackIndexer::materialize(size_t index, BaseCache& cache,
+                              std::string* out) {
+  if (cache.get(index, out)) {
+    return true;
+  }
+
+  const Entry& entry = _entries[index];
+  bool ok;
+  if (entry.packType <= GIT_OBJ_TAG) {
+    ok = inflateEntry(entry, out);
+  } else {
+    // The base was evicted: rebuild it from further up the chain.
+    std::string base, delta;
+    ok = materialize(entry.base, cache, &base) &&
+        inflateEntry(entry, &delta) && ApplyDelta(base, delta, out);
+  }
+  if (ok) {
+    cache.put(index, *out);
+  }
+  return ok;
+}
+
+void PackIndexer::resolveFrom(size_t root, BaseCache& cache) {
+  std::vector<size_t> stack(1, root);
+  std::string base, delta, result;
+  size_t deltas = 0;
+  bool failed = false;
+
+  while (!stack.empty() && !failed) {
+    size_t index = stack.back();
+    stack.pop_back();
+    const std::vector<size_t>& children = _children[index];
+    bool loaded = false;
+
+    for (size_t i = 0; i < children.size() && !failed; ++i) {
+      Entry& child = _entries[children[i]];
+      if (child.resolved) {
+        continue;
+      }
+      if (!loaded) {
+        failed = !materialize(index, cache, &base);
+        loaded = true;
+      }
+      if (failed || !inflateEntry(child, &delta) ||
+          !ApplyDelta(base, delta, &result)) {
+        failed = true;
+        break;
+      }
+      child.type = _entries[index].type;
+      HashObject(child.type, result, &child.id);
+      child.resolved = true;
+      deltas++;
+
+      if (!_children[children[i]].empty()) {
+        cache.put(children[i], result);
+        stack.push_back(children[i]);
+      }
+    }
+  }
+
+  pthread_mutex_lock(&_mutex);
+  _deltas += deltas;
+  _cacheHits += cache.hits;
+  _cacheMisses += cache.misses;
+  _failed = _failed || failed;
+  pthread_mutex_unlock(&_mutex);
+}
+
+void PackIndexer::resolveRoot(size_t index, void* payload) {
+  PackIndexer* indexer = static_cast<PackIndexer*>(payload);
+  BaseCache cache(indexer->_cacheBytes);
+  indexer->resolveFrom(indexer->_roots[index], cache);
+}
+
+int PackIndexer::writeFiles(const std::string& packDir) {
+  const std::string& data = *_data;
+  size_t count = _entries.size();
+
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; ++i) {
+    order[i] = i;
+  }
+  EntryIdLess<Entry> less = {&_entries};
+  std::sort(order.begin(), order.end(), less);
+
+  std::string idx;
+  AppendBigEndian(idx, 0xff744f63);
+  AppendBigEndian(idx, 2);
+
+  uint32_t fanout[256] = {0};
+  for (size_t i = 0; i < count; ++i) {
+    fanout[_entries[i].id.id[0]]++;
+  }
+  uint32_t total = 0;
+  for (int i = 0; i < 256; ++i) {
+    total += fanout[i];
+    AppendBigEndian(idx, total);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    idx.append((const char*) _entries[order[i]].id.id, GIT_OID_RAWSZ);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    AppendBigEndian(idx, _entries[order[i]].crc);
+  }
+
+  // Offsets past 2GB go to a table of 64 bit offsets.
+  std::vector<uint64_t> largeOffsets;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t offset = _entries[order[i]].offset;
+    if (offset < 0x80000000u) {
+      AppendBigEndian(idx, (uint32_t) offset);
+    } else {
+      AppendBigEndian(idx, 0x80000000u | (uint32_t) largeOffsets.size());
+      largeOffsets.push_back(offset);
+    }
+  }
+  for (size_t i = 0; i < largeOffsets.size(); ++i) {
+    AppendBigEndian(idx, (uint32_t) (largeOffsets[i] >> 32));
+    AppendBigEndian(idx, (uint32_t) largeOffsets[i]);
+  }
+
+  idx.append(data, data.size() - 20, 20);
+  Sha1Message checksum;
+  checksum.prefix = NULL;
+  checksum.prefixSize = 0;
+  checksum.data = (const unsigned char*) idx.data();
+  checksum.size = idx.size();
+  sha1Hash(&checksum);
+  idx.append((const char*) checksum.digest, 20);
+
+  // The pack goes first: an index is only ever visible with its pack.
+  git_oid packId;
+  git_oid_fromraw(&packId, (const unsigned char*) &data[data.size() - 20]);
+  std::string name = packDir + "/pack-" + oidToString(&packId);
+  if (writeFileAtomically(name + ".pack", data) ||
+      writeFileAtomically(name + ".idx", idx)) {
+    giterr_set_str(GITERR_OS, "cannot write pack");
+    return -1;
+  }
+  return 0;
+}
+
+int PackIndexer::index(const std::string& data, const std::string& packDir,
+                       PackIndexStats* stats) {
+  double start = nowMs();
+  _data = &data;
+  _entries.clear();
+  _children.clear();
+  _deltas = 0;
+  _cacheHits = 0;
+  _cacheMisses = 0;
+  _failed = false;
+
+  int r = parse();
+  double parsed = nowMs();
+
+  if (!r) {
+    _children.resize(_entries.size());
+    for (size_t i = 0; i < _entries.size(); ++i) {
+      if (_entries[i].packType == kOfsDelta) {
+        _children[_entries[i].base].push_back(i);
+      }
+    }
+    attachRefDeltas();
+
+    // Every round resolves the chains below the objects known so far. Ref
+    // deltas on top of objects found in one round hang off them in the
+    // next.
+    for (;;) {
+      _roots.clear();
+      for (size_t i = 0; i < _entries.size(); ++i) {
+        const std::vector<size_t>& children = _children[i];
+        bool pending = false;
+        for (size_t j = 0; j < children.size() && !pending; ++j) {
+          pending = !_entries[children[j]].resolved;
+        }
+        if (_entries[i].resolved && pending) {
+          _roots.push_back(i);
+        }
+      }
+      if (_roots.empty()) {
+        break;
+      }
+      _pool->parallelFor(_roots.size(), &PackIndexer::resolveRoot, this);
+      if (_failed) {
+        giterr_set_str(GITERR_INDEXER, "corrupt delta");
+        r = -1;
+        break;
+      }
+      attachRefDeltas();
+    }
+  }
+
+  for (size_t i = 0; !r && i < _entries.size(); ++i) {
+    if (!_entries[i].resolved) {
+      giterr_set_str(GITERR_INDEXER, "delta base missing from pack");
+      r = GIT_ENOTFOUND;
+    }
+  }
+  double resolved = nowMs();
+
+  if (!r) {
+    r = writeFiles(packDir);
+  }
+
+  if (!r) {
+    stats->packs++;
+    stats->objects += _entries.size();
+    stats->deltas += _deltas;
+    stats->threads = _pool->size();
+    stats->parseMs = parsed - start;
+    stats->resolveMs = resolved - parsed;
+    stats->writeMs = nowMs() - resolved;
+    stats->cacheHits += _cacheHits;
+    stats->cacheMisses += _cacheMisses;
+  }
+  return r;
+}
+
+namespace {
+struct IndexerBackend : git_odb_backend {
+  WorkerPool* pool;
+  PackIndexStats* stats;
+  std::string packDir;
+};
+
+struct IndexerWritepack : git_odb_writepack {
+  git_odb* odb;
+  git_transfer_progress_cb progress;
+  void* payload;
+  double startMs;
+  std::string data;
+  // Set once the pack outgrew the buffer; it then gets everything.
+  git_indexer* streaming;
+};
+
+// Hands the pack over to libgit2's indexer, which writes it to disk as it
+// arrives, and frees what was buffered so far.
+int StartStreaming(IndexerWritepack* pack, git_transfer_progress* stats) {
+  IndexerBackend* backend = static_cast<IndexerBackend*>(pack->backend);
+  backend->stats->fallbacks++;
+  int r = git_indexer_new(&pack->streaming, backend->packDir.c_str(), 0,
+      pack->odb, pack->progress, pack->payload);
+  if (!r) {
+    r = git_indexer_append(pack->streaming, pack->data.data(),
+        pack->data.size(), stats);
+  }
+  std::string().swap(pack->data);
+  return r;
+}
+
+int WritepackAppend(git_odb_writepack* writepack, const void* data,
+                    size_t size, git_transfer_progress* stats) {
+  IndexerWritepack* pack = static_cast<IndexerWritepack*>(writepack);
+  if (pack->streaming == NULL &&
+      pack->data.size() + size > kMaxBufferedPackBytes) {
+    int r = StartStreaming(pack, stats);
+    if (r) {
+      return r;
+    }
+  }
+  if (pack->streaming != NULL) {
+    return git_indexer_append(pack->streaming, data, size, stats);
+  }
+
+  pack->data.append((const char*) data, size);
+  if (!stats->total_objects && pack->data.size() >= 12) {
+    stats->total_objects = ReadBigEndian(pack->data.data() + 8);
+  }
+  if (pack->progress != NULL && pack->progress(stats, pack->payload)) {
+    giterr_set_str(GITERR_INDEXER, "fetch cancelled");
+    return GIT_EUSER;
+  }
+  return 0;
+}
+
+int WritepackCommit(git_odb_writepack* writepack,
+                    git_transfer_progress* stats) {
+  IndexerWritepack* pack = static_cast<IndexerWritepack*>(writepack);
+  IndexerBackend* backend = static_cast<IndexerBackend*>(pack->backend);
+
+  if (pack->streaming != NULL) {
+    backend->stats->receiveMs = nowMs() - pack->startMs;
+    return git_indexer_commit(pack->streaming, stats);
+  }
+
+  // Header and trailer only: nothing new to store.
+  if (pack->data.size() <= 32) {
+    return 0;
+  }
+
+  backend->stats->receiveMs = nowMs() - pack->startMs;
+  PackIndexer indexer(backend->pool, kDeltaBaseCacheBytes);
+  int r = indexer.index(pack->data, backend->packDir, backend->stats);
+  if (!r) {
+    stats->received_objects = stats->total_objects;
+    stats->indexed_objects = stats->total_objects;
+    stats->total_deltas = indexer.deltas();
+    stats->indexed_deltas = indexer.deltas();
+    if (pack->progress != NULL) {
+      pack->progress(stats, pack->payload);
+    }
+    return 0;
+  }
+
+  // Thin packs need bases from the object database, and anything odd gets
+  // libgit2's own checks: both go to its indexer.
+  giterr_clear();
+  backend->stats->fallbacks++;
+  git_indexer* fallback = NULL;
+  r = git_indexer_new(&fallback, backend->packDir.c_str(), 0, pack->odb,
+      pack->progress, pack->payload);
+  if (!r) {
+    r = git_indexer_append(fallback, pack->data.data(), pack->data.size(),
+        stats);
+  }
+  if (!r) {
+    r = git_indexer_commit(fallback, stats);
+  }
+  git_indexer_free(fallback);
+  return r;
+}
+
+void WritepackFree(git_odb_writepack* writepack) {
+  IndexerWritepack* pack = static_cast<IndexerWritepack*>(writepack);
+  git_indexer_free(pack->streaming);
+  delete pack;
+}
+
+int BackendWritepack(git_odb_writepack** out, git_odb_backend* backend,
+                     git_odb* odb, git_transfer_progress_cb progress,
+                     void* payload) {
+  IndexerWritepack* pack = new IndexerWritepack();
+  pack->backend = backend;
+  pack->append = &WritepackAppend;
+  pack->commit = &WritepackCommit;
+  pack->free = &WritepackFree;
+  pack->odb = odb;
+  pack->progress = progress;
+  pack->payload = payload;
+  pack->startMs = nowMs();
+  pack->streaming = NULL;
+  *out = pack;
+  return 0;
+}
+
+// The backend stores nothing itself; the packs it writes are found by the
+// regular pack backend.
+int BackendExists(git_odb_backend* backend, const git_oid* id) {
+  return 0;
+}
+
+int BackendRefresh(git_odb_backend* backend) {
+  return 0;
+}
+
+int BackendForeach(git_odb_backend* backend, git_odb_foreach_cb cb,
+                   void* payload) {
+  return 0;
+}
+
+void BackendFree(git_odb_backend* backend) {
+  delete static_cast<IndexerBackend*>(backend);
+}
+}
+
+int PackIndexer::install(git_repository* repo, WorkerPool* pool,
+                         PackIndexStats* stats) {
+  git_odb* odb = NULL;
+  int r = git_repository_odb(&odb, repo);
+  if (r) {
+    return r;
+  }
+
+  IndexerBackend* backend = new IndexerBackend();
+  backend->version = GIT_ODB_BACKEND_VERSION;
+  backend->exists = &BackendExists;
+  backend->refresh = &BackendRefresh;
+  backend->foreach = &BackendForeach;
+  backend->writepack = &BackendWritepack;
+  backend->free = &BackendFree;
+  backend->pool = pool;
+  backend->stats = stats;
+  backend->packDir = std::string(git_repository_path(repo)) + "objects/pack";
+
+  r = git_odb_add_backend(odb, backend, kBackendPriority);
+  if (r) {
+    delete backend;
+  }
+  git_odb_free(odb);
+  return r;
+}
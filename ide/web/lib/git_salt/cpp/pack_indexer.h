@@ -0,0 +1,125 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_PACK_INDEXER_H__
+#define GIT_SALT_PACK_INDEXER_H__
+
+#include <git2.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "worker_pool.h"
+
+/**
+ * Counters of the packs indexed so far, with the phase timings of the most
+ * recent one.
+ */
+struct PackIndexStats {
+  size_t packs;
+  // Packs handed to the libgit2 indexer instead, such as thin packs and
+  // packs too large to hold in memory.
+  size_t fallbacks;
+  size_t objects;
+  size_t deltas;
+  size_t threads;
+  double receiveMs;
+  double parseMs;
+  double resolveMs;
+  double writeMs;
+  size_t cacheHits;
+  size_t cacheMisses;
+
+  PackIndexStats()
+      : packs(0), fallbacks(0), objects(0), deltas(0), threads(0),
+        receiveMs(0), parseMs(0), resolveMs(0), writeMs(0), cacheHits(0),
+        cacheMisses(0) {}
+};
+
+/**
+ * Indexes a received pack and writes its .idx (version 2). The objects are
+ * inflated and the whole objects hashed in one pass over the pack. The
+ * delta chains hanging off each whole object are then resolved in parallel
+ * on the worker pool, with a per-chain cache of inflated bases bounded in
+ * bytes.
+ */
+class PackIndexer {
+ public:
+  PackIndexer(WorkerPool* pool, size_t cacheBytes);
+  ~PackIndexer();
+
+  /**
+   * Indexes the pack in |data| and writes it and its index into |packDir|.
+   * Fails with GIT_ENOTFOUND for a thin pack, whose bases are not all in
+   * the pack itself.
+   */
+  int index(const std::string& data, const std::string& packDir,
+      PackIndexStats* stats);
+
+  /**
+   * Adds a backend to the object database of |repo| that takes the packs
+   * of fetches and clones and indexes them with a PackIndexer.
+   */
+  static int install(git_repository* repo, WorkerPool* pool,
+      PackIndexStats* stats);
+
+  // Deltas resolved in the last pack.
+  size_t deltas() const { return _deltas; }
+
+ private:
+  struct Entry {
+    // Offsets of the object header, its zlib stream and the end of it.
+    size_t offset;
+    size_t dataOffset;
+    size_t end;
+    int packType;
+    git_otype type;
+    size_t size;
+    // Entry of the delta base, or kNone while unknown.
+    size_t base;
+    git_oid baseId;
+    git_oid id;
+    uint32_t crc;
+    bool resolved;
+  };
+
+  class BaseCache;
+
+  static const size_t kNone = (size_t) -1;
+
+  static void resolveRoot(size_t index, void* payload);
+
+  int parse();
+
+  // Reads the entry at |pos| and moves |pos| past it. False if corrupt.
+  bool parseEntry(size_t index, size_t* pos, std::string* buffer);
+
+  // Attaches the ref deltas whose base is known by now. Returns how many.
+  size_t attachRefDeltas();
+
+  // Inflates the data of |entry|, optionally setting where its stream ends.
+  bool inflateEntry(const Entry& entry, std::string* out, size_t* end = NULL);
+
+  bool materialize(size_t index, BaseCache& cache, std::string* out);
+
+  void resolveFrom(size_t root, BaseCache& cache);
+
+  int writeFiles(const std::string& packDir);
+
+  WorkerPool* _pool;
+  size_t _cacheBytes;
+  const std::string* _data;
+  std::vector<Entry> _entries;
+  std::vector<std::vector<size_t> > _children;
+  std::vector<size_t> _roots;
+  pthread_mutex_t _mutex;
+  size_t _deltas;
+  size_t _cacheHits;
+  size_t _cacheMisses;
+  bool _failed;
+};
+
+#endif  // GIT_SALT_PACK_INDEXER_H__
@@ -0,0 +1,95 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "prefetcher.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+// Remotes are not asked more often than this, whatever the caller wants.
+const int kMinIntervalMs = 60 * 1000;
+const int64_t kMaxBackoffMs = 60 * 60 * 1000;
+}
+
+Prefetcher::Prefetcher()
+    : runs(0), failures(0), consecutiveFailures(0), objectsReceived(0),
+      bytesReceived(0), _generation(0), _intervalMs(0) {}
+
+unsigned Prefetcher::configure(int intervalMs) {
+  _intervalMs = intervalMs > 0 ? std::max(intervalMs, kMinIntervalMs) : 0;
+  consecutiveFailures = 0;
+  return ++_generation;
+}
+
+int64_t Prefetcher::nextDelayMs() {
+  int64_t delay = _intervalMs;
+  for (size_t i = 0; i < consecutiveFailures && delay < kMaxBackoffMs; ++i) {
+    delay *= 2;
+  }
+  return std::min(delay, kMaxBackoffMs);
+}
+
+int Prefetcher::yieldProgress(const git_transfer_progress* stats,
+                              void* payload) {
+  static_cast<Scheduler*>(payload)->yield();
+  return 0;
+}
+
+int Prefetcher::fetchRemote(git_repository* repo, const char* name,
+                            Scheduler* scheduler) {
+  git_remote* remote = NULL;
+  int r = git_remote_load(&remote, repo, name);
+
+  // Only the in-memory remote is changed; its saved refspecs stay as they
+  // are.
+  std::string refspec = "+refs/heads/*:refs/prefetch/" + std::string(name) +
+      "/*";
+  char* strings[] = {const_cast<char*>(refspec.c_str())};
+  git_strarray refspecs = {strings, 1};
+  if (!r) {
+    r = git_remote_set_fetch_refspecs(remote, &refspecs);
+  }
+
+  if (!r) {
+    git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+    callbacks.transfer_progress = &Prefetcher::yieldProgress;
+    callbacks.payload = scheduler;
+    git_remote_set_callbacks(remote, &callbacks);
+    git_remote_set_update_fetchhead(remote, 0);
+    r = git_remote_fetch(remote, NULL, "prefetch");
+  }
+
+  if (!r) {
+    const git_transfer_progress* stats = git_remote_stats(remote);
+    objectsReceived += stats->received_objects;
+    bytesReceived += stats->received_bytes;
+  }
+  git_remote_free(remote);
+  return r;
+}
+
+int Prefetcher::fetch(git_repository* repo, Scheduler* scheduler) {
+  git_strarray names = {NULL, 0};
+  int r = git_remote_list(&names, repo);
+
+  // One unreachable remote does not hold up the others.
+  int failed = 0;
+  for (size_t i = 0; !r && i < names.count; ++i) {
+    if (fetchRemote(repo, names.strings[i], scheduler)) {
+      failed = -1;
+    }
+  }
+  git_strarray_free(&names);
+
+  r = r ? r : failed;
+  runs++;
+  if (r) {
+    failures++;
+    consecutiveFailures++;
+  } else {
+    consecutiveFailures = 0;
+  }
+  return r;
+}
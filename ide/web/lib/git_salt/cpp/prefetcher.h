@@ -0,0 +1,58 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_PREFETCHER_H__
+#define GIT_SALT_PREFETCHER_H__
+
+#include <git2.h>
+#include <stdint.h>
+
+#include "scheduler.h"
+
+/**
+ * Periodically fetches every remote into refs/prefetch/<remote>/<branch>,
+ * leaving the remote tracking branches and FETCH_HEAD alone. A later pull
+ * then has the objects at hand and only moves refs. Failed passes back off
+ * exponentially. Only used from the file thread.
+ */
+class Prefetcher {
+ public:
+  Prefetcher();
+
+  /**
+   * Prefetches every |intervalMs|, or stops for 0. Returns a new generation;
+   * passes scheduled under an older one are dropped.
+   */
+  unsigned configure(int intervalMs);
+
+  unsigned generation() { return _generation; }
+
+  int intervalMs() { return _intervalMs; }
+
+  // Delay before the next pass, longer after consecutive failures.
+  int64_t nextDelayMs();
+
+  /**
+   * Fetches all remotes of |repo|, letting |scheduler| run interactive work
+   * at every progress report.
+   */
+  int fetch(git_repository* repo, Scheduler* scheduler);
+
+  size_t runs;
+  size_t failures;
+  size_t consecutiveFailures;
+  size_t objectsReceived;
+  double bytesReceived;
+
+ private:
+  static int yieldProgress(const git_transfer_progress* stats, void* payload);
+
+  int fetchRemote(git_repository* repo, const char* name,
+      Scheduler* scheduler);
+
+  unsigned _generation;
+  int _intervalMs;
+};
+
+#endif  // GIT_SALT_PREFETCHER_H__
@@ -0,0 +1,67 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "ref_snapshot.h"
+
+RefSnapshot::RefSnapshot(RefState* state)
+    : hits(0), misses(0), _state(state), _generation(0), _headValid(false),
+      _hasBranch(false) {}
+
+void RefSnapshot::validate(git_repository* repo) {
+  _state->refresh(git_repository_path(repo));
+  if (_state->generation() != _generation) {
+    _generation = _state->generation();
+    _headValid = false;
+    _branches.clear();
+  }
+}
+
+bool RefSnapshot::currentBranch(git_repository* repo, std::string* branch) {
+  validate(repo);
+  if (_headValid) {
+    hits++;
+    *branch = _branch;
+    return _hasBranch;
+  }
+
+  misses++;
+  git_reference* ref = NULL;
+  const char* name = NULL;
+  _hasBranch = !git_repository_head(&ref, repo) &&
+      !git_branch_name(&name, ref);
+  _branch = _hasBranch ? name : "";
+  git_reference_free(ref);
+  _headValid = true;
+
+  *branch = _branch;
+  return _hasBranch;
+}
+
+const std::vector<std::string>& RefSnapshot::branches(git_repository* repo,
+                                                      int flags) {
+  validate(repo);
+  std::map<int, std::vector<std::string> >::iterator it =
+      _branches.find(flags);
+  if (it != _branches.end()) {
+    hits++;
+    return it->second;
+  }
+
+  misses++;
+  std::vector<std::string>& names = _branches[flags];
+  git_branch_iterator* iter = NULL;
+  git_branch_t type = (git_branch_t) flags;
+  if (!git_branch_iterator_new(&iter, repo, type)) {
+    git_reference* ref = NULL;
+    while (!git_branch_next(&ref, &type, iter)) {
+      const char* name = NULL;
+      if (!git_branch_name(&name, ref)) {
+        names.push_back(name);
+      }
+      git_reference_free(ref);
+    }
+  }
+  git_branch_iterator_free(iter);
+  return names;
+}
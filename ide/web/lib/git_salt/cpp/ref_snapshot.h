@@ -0,0 +1,47 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_REF_SNAPSHOT_H__
+#define GIT_SALT_REF_SNAPSHOT_H__
+
+#include <git2.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ref_state.h"
+
+/**
+ * Parsed current branch and branch lists, kept for as long as the stat
+ * fingerprint of the refs (see RefState) does not change. In the common
+ * case a branch query is a handful of stat calls instead of a refdb walk.
+ * Only used from the file thread.
+ */
+class RefSnapshot {
+ public:
+  explicit RefSnapshot(RefState* state);
+
+  // Sets |branch| to the name of the checked out branch, or returns false
+  // when HEAD is detached or unborn.
+  bool currentBranch(git_repository* repo, std::string* branch);
+
+  // Names of the branches matching |flags| (a git_branch_t).
+  const std::vector<std::string>& branches(git_repository* repo, int flags);
+
+  size_t hits;
+  size_t misses;
+
+ private:
+  void validate(git_repository* repo);
+
+  RefState* _state;
+  unsigned _generation;
+  bool _headValid;
+  bool _hasBranch;
+  std::string _branch;
+  std::map<int, std::vector<std::string> > _branches;
+};
+
+#endif  // GIT_SALT_REF_SNAPSHOT_H__
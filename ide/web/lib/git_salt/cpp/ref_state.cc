@@ -0,0 +1,100 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "ref_state.h"
+
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace {
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t Mix(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+}
+
+RefState::RefState()
+    : _fingerprint(0), _current(0), _newest(0), _racy(true),
+      _generation(0) {}
+
+void RefState::exclude(const std::string& name) {
+  _excluded.push_back(name);
+  // Rebuilt for the new name on the next refresh.
+  _gitDir.clear();
+}
+
+void RefState::addPath(const std::string& path, bool recurse) {
+  struct stat st;
+  _current = Mix(_current, path.c_str(), path.length() + 1);
+  if (stat(path.c_str(), &st)) {
+    return;
+  }
+
+  int64_t mtime = st.st_mtime;
+  int64_t size = st.st_size;
+  int64_t ino = st.st_ino;
+  _current = Mix(_current, &mtime, sizeof(mtime));
+  _current = Mix(_current, &size, sizeof(size));
+  _current = Mix(_current, &ino, sizeof(ino));
+  if (st.st_mtime > _newest) {
+    _newest = st.st_mtime;
+  }
+
+  if (!recurse || !S_ISDIR(st.st_mode)) {
+    return;
+  }
+
+  DIR* dir = opendir(path.c_str());
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+      continue;
+    }
+    std::string child = path + "/" + entry->d_name;
+    if (!_skipped.count(child)) {
+      addPath(child, true);
+    }
+  }
+  closedir(dir);
+}
+
+bool RefState::refresh(const std::string& gitDir) {
+  time_t now = time(NULL);
+  std::string base = gitDir;
+  if (!base.empty() && base[base.length() - 1] == '/') {
+    base.erase(base.length() - 1);
+  }
+
+  if (base != _gitDir) {
+    _skipped.clear();
+    for (size_t i = 0; i < _excluded.size(); ++i) {
+      _skipped.insert(base + "/refs/" + _excluded[i]);
+    }
+  }
+
+  _current = kFnvOffset;
+  _newest = 0;
+  addPath(base + "/HEAD", false);
+  addPath(base + "/packed-refs", false);
+  addPath(base + "/refs", true);
+
+  bool changed = _racy || base != _gitDir || _current != _fingerprint;
+  _gitDir = base;
+  _fingerprint = _current;
+  _racy = _newest >= now;
+  if (changed) {
+    _generation++;
+  }
+  return changed;
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_REF_STATE_H__
+#define GIT_SALT_REF_STATE_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Stat based fingerprint of everything that makes up the refs of a
+ * repository: HEAD, packed-refs and every file and directory below refs/.
+ * Nothing is parsed, so checking for changes stays cheap enough to do before
+ * every ref query.
+ *
+ * Ref files are tiny and rewritten through renames, so size and mtime alone
+ * can miss an update made within the same second. Like git's racy index
+ * check, a fingerprint taken while any of the files was that fresh is not
+ * trusted and the next refresh reports a change.
+ */
+class RefState {
+ public:
+  RefState();
+
+  // Leaves refs/|name| out of the fingerprint, for namespaces such as
+  // refs/prefetch that are updated in the background and that nothing
+  // depending on the generation reads.
+  void exclude(const std::string& name);
+
+  // Re-stats the refs of the repository at |gitDir|. Returns true when they
+  // may have changed since the previous call.
+  bool refresh(const std::string& gitDir);
+
+  // Incremented whenever refresh() reports a change.
+  unsigned generation() const { return _generation; }
+
+ private:
+  void addPath(const std::string& path, bool recurse);
+
+  std::string _gitDir;
+  std::vector<std::string> _excluded;
+  // Full paths of the excluded directories below the current _gitDir.
+  std::set<std::string> _skipped;
+  uint64_t _fingerprint;
+  uint64_t _current;
+  time_t _newest;
+  bool _racy;
+  unsigned _generation;
+};
+
+#endif  // GIT_SALT_REF_STATE_H__
@@ -0,0 +1,136 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "ref_watcher.h"
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <algorithm>
+
+#include "ppapi/cpp/var_dictionary.h"
+
+#include "constants.h"
+
+namespace {
+const int kMinIntervalMs = 100;
+
+// Reads HEAD as it is on disk: "ref: refs/heads/<name>" or a commit id.
+std::string ReadHead(const std::string& gitDir) {
+  std::string head;
+  FILE* file = fopen((gitDir + "/HEAD").c_str(), "rb");
+  if (file == NULL) {
+    return head;
+  }
+  char buffer[256];
+  size_t size = fread(buffer, 1, sizeof(buffer), file);
+  fclose(file);
+  head.assign(buffer, size);
+  size_t end = head.find_last_not_of(" \r\n");
+  head.erase(end == std::string::npos ? 0 : end + 1);
+  if (head.compare(0, 5, "ref: ") == 0) {
+    head.erase(0, 5);
+  }
+  return head;
+}
+}
+
+RefWatcher::RefWatcher(pp::Instance* instance)
+    : _instance(instance), _running(false), _stopping(false),
+      _intervalMs(0) {
+  // Background prefetches and fetches of remote-tracking branches are not
+  // changes the subscriber needs to hear about.
+  _state.exclude("prefetch");
+  _state.exclude("remotes");
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_cond, NULL);
+}
+
+RefWatcher::~RefWatcher() {
+  join();
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_mutex);
+}
+
+void RefWatcher::start(const std::string& gitDir, const std::string& subject,
+                       int intervalMs) {
+  stop();
+
+  _gitDir = gitDir;
+  if (!_gitDir.empty() && _gitDir[_gitDir.length() - 1] == '/') {
+    _gitDir.erase(_gitDir.length() - 1);
+  }
+  _subject = subject;
+  _intervalMs = std::max(intervalMs, kMinIntervalMs);
+  _stopping = false;
+  // The subscriber already knows the current state; only report changes.
+  _state.refresh(_gitDir);
+
+  if (pthread_create(&_thread, NULL, &RefWatcher::threadMain, this) == 0) {
+    _running = true;
+  }
+}
+
+void RefWatcher::stop() {
+  if (join()) {
+    postEvent(true);
+  }
+}
+
+bool RefWatcher::join() {
+  if (!_running) {
+    return false;
+  }
+
+  pthread_mutex_lock(&_mutex);
+  _stopping = true;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+
+  pthread_join(_thread, NULL);
+  _running = false;
+  return true;
+}
+
+void* RefWatcher::threadMain(void* watcher) {
+  static_cast<RefWatcher*>(watcher)->run();
+  return NULL;
+}
+
+void RefWatcher::run() {
+  pthread_mutex_lock(&_mutex);
+  while (!_stopping) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    long nsec = now.tv_usec * 1000L + (_intervalMs % 1000) * 1000000L;
+    struct timespec deadline;
+    deadline.tv_sec = now.tv_sec + _intervalMs / 1000 + nsec / 1000000000L;
+    deadline.tv_nsec = nsec % 1000000000L;
+    pthread_cond_timedwait(&_cond, &_mutex, &deadline);
+    if (_stopping) {
+      break;
+    }
+
+    pthread_mutex_unlock(&_mutex);
+    if (_state.refresh(_gitDir)) {
+      postEvent(false);
+    }
+    pthread_mutex_lock(&_mutex);
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+void RefWatcher::postEvent(bool done) {
+  pp::VarDictionary arg;
+  arg.Set(kHead, ReadHead(_gitDir));
+  arg.Set(kGeneration, (int) _state.generation());
+  arg.Set(kDone, done);
+
+  pp::VarDictionary response;
+  response.Set(kRegarding, _subject);
+  response.Set(kArg, arg);
+  response.Set(kName, kResult);
+
+  _instance->PostMessage(response);
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_REF_WATCHER_H__
+#define GIT_SALT_REF_WATCHER_H__
+
+#include <pthread.h>
+
+#include <string>
+
+#include "ppapi/cpp/instance.h"
+
+#include "ref_state.h"
+
+/**
+ * Watches the refs of one repository from its own thread and pushes an
+ * event to the subscriber whenever they change. Each check only stats the
+ * ref files (see RefState), so a quiet repository costs a few stat calls per
+ * interval and no messages at all.
+ */
+class RefWatcher {
+ public:
+  explicit RefWatcher(pp::Instance* instance);
+  ~RefWatcher();
+
+  /**
+   * Starts watching |gitDir| every |intervalMs|, posting events regarding
+   * |subject|. A previous subscription is ended first.
+   */
+  void start(const std::string& gitDir, const std::string& subject,
+      int intervalMs);
+
+  // Ends the current subscription, if any, with a final done event.
+  void stop();
+
+ private:
+  static void* threadMain(void* watcher);
+
+  // Stops the thread. Returns false if it was not running.
+  bool join();
+
+  void run();
+
+  void postEvent(bool done);
+
+  pp::Instance* _instance;
+  pthread_mutex_t _mutex;
+  pthread_cond_t _cond;
+  pthread_t _thread;
+  bool _running;
+  bool _stopping;
+  std::string _gitDir;
+  std::string _subject;
+  int _intervalMs;
+  RefState _state;
+};
+
+#endif  // GIT_SALT_REF_WATCHER_H__
@@ -0,0 +1,434 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "rename_detector.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+#include "worker_pool.h"
+
+namespace {
+// Files larger than this are never fingerprinted, only matched exactly.
+const size_t kMaxSignatureSize = 8 * 1024 * 1024;
+const size_t kMaxChunkLength = 64;
+// Number of best scoring sources remembered per target.
+const size_t kScoresPerTarget = 4;
+
+bool compareScores(const std::pair<int, size_t>& a,
+                   const std::pair<int, size_t>& b) {
+  return a.first > b.first;
+}
+
+struct ScoredPair {
+  int score;
+  size_t source;
+  size_t target;
+
+  bool operator<(const ScoredPair& other) const {
+    if (score != other.score) {
+      return score > other.score;
+    }
+    return target < other.target;
+  }
+};
+}
+
+void SimilaritySignature::compute(const char* data, size_t length) {
+  std::vector<std::pair<uint32_t, uint32_t> > raw;
+  uint32_t hash = 2166136261u;
+  uint32_t chunkLength = 0;
+
+  for (size_t i = 0; i < length; ++i) {
+    unsigned char c = data[i];
+    hash = (hash ^ c) * 16777619u;
+    if (++chunkLength == kMaxChunkLength || c == '\n') {
+      raw.push_back(std::make_pair(hash, chunkLength));
+      hash = 2166136261u;
+      chunkLength = 0;
+    }
+  }
+  if (chunkLength) {
+    raw.push_back(std::make_pair(hash, chunkLength));
+  }
+
+  std::sort(raw.begin(), raw.end());
+  chunks.clear();
+  for (size_t i = 0; i < raw.size(); ++i) {
+    if (!chunks.empty() && chunks.back().first == raw[i].first) {
+      chunks.back().second += raw[i].second;
+    } else {
+      chunks.push_back(raw[i]);
+    }
+  }
+  size = length;
+}
+
+int SimilaritySignature::score(const SimilaritySignature& other) const {
+  size_t maxSize = std::max(size, other.size);
+  if (maxSize == 0) {
+    return 100;
+  }
+
+  uint64_t common = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < chunks.size() && j < other.chunks.size()) {
+    if (chunks[i].first < other.chunks[j].first) {
+      ++i;
+    } else if (chunks[i].first > other.chunks[j].first) {
+      ++j;
+    } else {
+      common += std::min(chunks[i].second, other.chunks[j].second);
+      ++i;
+      ++j;
+    }
+  }
+  return (int) (common * 100 / maxSize);
+}
+
+SimilarityCache::SimilarityCache(size_t maxEntries)
+    : hits(0), misses(0), _maxEntries(maxEntries) {
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+SimilarityCache::~SimilarityCache() {
+  for (SignatureMap::iterator it = _signatures.begin();
+       it != _signatures.end(); ++it) {
+    delete it->second;
+  }
+  pthread_mutex_destroy(&_mutex);
+}
+
+const SimilaritySignature* SimilarityCache::lookup(const git_oid& oid) {
+  const SimilaritySignature* signature = NULL;
+  pthread_mutex_lock(&_mutex);
+  SignatureMap::iterator it = _signatures.find(oid);
+  if (it != _signatures.end()) {
+    signature = it->second;
+    hits++;
+  } else {
+    misses++;
+  }
+  pthread_mutex_unlock(&_mutex);
+  return signature;
+}
+
+const SimilaritySignature* SimilarityCache::insert(
+    const git_oid& oid, SimilaritySignature* signature) {
+  pthread_mutex_lock(&_mutex);
+  std::pair<SignatureMap::iterator, bool> result =
+      _signatures.insert(std::make_pair(oid, signature));
+  if (result.second) {
+    _order.push_back(oid);
+  } else {
+    // Another worker got there first.
+    delete signature;
+  }
+  const SimilaritySignature* cached = result.first->second;
+  pthread_mutex_unlock(&_mutex);
+  return cached;
+}
+
+void SimilarityCache::trim() {
+  pthread_mutex_lock(&_mutex);
+  while (_order.size() > _maxEntries) {
+    SignatureMap::iterator it = _signatures.find(_order.front());
+    delete it->second;
+    _signatures.erase(it);
+    _order.pop_front();
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+RenameDetector::RenameDetector(git_repository* repo, WorkerPool* pool,
+                               SimilarityCache* cache)
+    : _repo(repo), _pool(pool), _cache(cache) {}
+
+RenameDetector::~RenameDetector() {
+  for (size_t i = 0; i < _sources.size(); ++i) {
+    delete _sources[i].owned;
+  }
+  for (size_t i = 0; i < _targets.size(); ++i) {
+    delete _targets[i].owned;
+  }
+}
+
+int RenameDetector::detect(git_diff* diff, const RenameOptions& options,
+                           std::vector<RenameMatch>& matches) {
+  _options = options;
+  _cache->trim();
+
+  size_t numDeltas = git_diff_num_deltas(diff);
+  for (size_t i = 0; i < numDeltas; ++i) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, i);
+    Candidate candidate;
+    candidate.delta = i;
+    candidate.signature = NULL;
+    candidate.owned = NULL;
+
+    if (delta->status == GIT_DELTA_DELETED ||
+        (options.findCopies && delta->status == GIT_DELTA_MODIFIED)) {
+      candidate.file = &delta->old_file;
+    } else if (delta->status == GIT_DELTA_ADDED ||
+               delta->status == GIT_DELTA_UNTRACKED) {
+      candidate.file = &delta->new_file;
+    } else {
+      continue;
+    }
+
+    candidate.hasId = (candidate.file->flags & GIT_DIFF_FLAG_VALID_ID) &&
+        !git_oid_iszero(&candidate.file->id);
+    if (candidate.hasId) {
+      git_oid_cpy(&candidate.id, &candidate.file->id);
+    }
+
+    if (candidate.file == &delta->old_file) {
+      _sources.push_back(candidate);
+    } else {
+      _targets.push_back(candidate);
+    }
+  }
+
+  if (_sources.empty() || _targets.empty()) {
+    return 0;
+  }
+
+  // Untracked files have no id yet; hash them so moves that were not staged
+  // are still found by the exact pass below.
+  for (size_t i = 0; i < _targets.size(); ++i) {
+    if (!_targets[i].hasId) {
+      _work.push_back(&_targets[i]);
+    }
+  }
+  _pool->parallelFor(_work.size(), &RenameDetector::hashCandidate, this);
+  _work.clear();
+
+  // Exact matches.
+  std::map<git_oid, std::vector<size_t>, OidLess> sourcesById;
+  for (size_t i = 0; i < _sources.size(); ++i) {
+    if (_sources[i].hasId) {
+      sourcesById[_sources[i].id].push_back(i);
+    }
+  }
+
+  std::vector<bool> sourceRenamed(_sources.size(), false);
+  std::vector<bool> targetMatched(_targets.size(), false);
+
+  for (size_t t = 0; t < _targets.size(); ++t) {
+    if (!_targets[t].hasId) {
+      continue;
+    }
+    std::map<git_oid, std::vector<size_t>, OidLess>::iterator it =
+        sourcesById.find(_targets[t].id);
+    if (it == sourcesById.end()) {
+      continue;
+    }
+    RenameMatch match;
+    match.target = _targets[t].delta;
+    match.similarity = 100;
+    match.copy = true;
+    for (size_t k = 0; k < it->second.size(); ++k) {
+      size_t s = it->second[k];
+      const git_diff_delta* source = git_diff_get_delta(diff, _sources[s].delta);
+      if (source->status == GIT_DELTA_DELETED && !sourceRenamed[s]) {
+        sourceRenamed[s] = true;
+        match.source = _sources[s].delta;
+        match.copy = false;
+        break;
+      }
+    }
+    if (match.copy) {
+      if (!options.findCopies) {
+        continue;
+      }
+      match.source = _sources[it->second[0]].delta;
+    }
+    targetMatched[t] = true;
+    matches.push_back(match);
+  }
+
+  // Inexact matches, bounded by the rename limit.
+  for (size_t s = 0; s < _sources.size(); ++s) {
+    if (!sourceRenamed[s] || options.findCopies) {
+      _pendingSources.push_back(&_sources[s]);
+    }
+  }
+  for (size_t t = 0; t < _targets.size(); ++t) {
+    if (!targetMatched[t]) {
+      _pendingTargets.push_back(&_targets[t]);
+    }
+  }
+
+  if (_pendingSources.empty() || _pendingTargets.empty() ||
+      options.threshold > 100 ||
+      (uint64_t) _pendingSources.size() * _pendingTargets.size() >
+          (uint64_t) options.limit * options.limit) {
+    return 0;
+  }
+
+  std::vector<Candidate*> all(_pendingSources);
+  all.insert(all.end(), _pendingTargets.begin(), _pendingTargets.end());
+  for (size_t i = 0; i < all.size(); ++i) {
+    if (all[i]->hasId) {
+      all[i]->signature = _cache->lookup(all[i]->id);
+    }
+    if (all[i]->signature == NULL) {
+      _work.push_back(all[i]);
+    }
+  }
+  _pool->parallelFor(_work.size(), &RenameDetector::signCandidate, this);
+  _work.clear();
+
+  _pool->parallelFor(_pendingTargets.size(), &RenameDetector::scoreTarget,
+                     this);
+
+  std::vector<ScoredPair> scored;
+  for (size_t t = 0; t < _pendingTargets.size(); ++t) {
+    Candidate* target = _pendingTargets[t];
+    for (size_t k = 0; k < target->scores.size(); ++k) {
+      ScoredPair pair;
+      pair.score = target->scores[k].first;
+      pair.source = target->scores[k].second;
+      pair.target = t;
+      scored.push_back(pair);
+    }
+  }
+  std::sort(scored.begin(), scored.end());
+
+  std::vector<bool> pendingRenamed(_pendingSources.size(), false);
+  std::vector<bool> pendingMatched(_pendingTargets.size(), false);
+  for (size_t i = 0; i < scored.size(); ++i) {
+    const ScoredPair& pair = scored[i];
+    if (pendingMatched[pair.target]) {
+      continue;
+    }
+    Candidate* source = _pendingSources[pair.source];
+    const git_diff_delta* delta = git_diff_get_delta(diff, source->delta);
+    size_t s = source - &_sources[0];
+
+    RenameMatch match;
+    match.source = source->delta;
+    match.target = _pendingTargets[pair.target]->delta;
+    match.similarity = pair.score;
+    if (delta->status == GIT_DELTA_DELETED && !sourceRenamed[s] &&
+        !pendingRenamed[pair.source]) {
+      pendingRenamed[pair.source] = true;
+      match.copy = false;
+    } else if (options.findCopies) {
+      match.copy = true;
+    } else {
+      continue;
+    }
+    pendingMatched[pair.target] = true;
+    matches.push_back(match);
+  }
+  return 0;
+}
+
+void RenameDetector::hashCandidate(size_t index, void* payload) {
+  RenameDetector* detector = static_cast<RenameDetector*>(payload);
+  Candidate* candidate = detector->_work[index];
+  std::vector<char> content;
+  if (detector->readContent(*candidate, content) &&
+      git_odb_hash(&candidate->id, content.empty() ? "" : &content[0],
+                   content.size(), GIT_OBJ_BLOB) == 0) {
+    candidate->hasId = true;
+  }
+}
+
+void RenameDetector::signCandidate(size_t index, void* payload) {
+  RenameDetector* detector = static_cast<RenameDetector*>(payload);
+  Candidate* candidate = detector->_work[index];
+  std::vector<char> content;
+  if (!detector->readContent(*candidate, content)) {
+    return;
+  }
+
+  SimilaritySignature* signature = new SimilaritySignature();
+  signature->compute(content.empty() ? "" : &content[0], content.size());
+  if (candidate->hasId) {
+    candidate->signature = detector->_cache->insert(candidate->id, signature);
+  } else {
+    candidate->owned = signature;
+    candidate->signature = signature;
+  }
+}
+
+void RenameDetector::scoreTarget(size_t index, void* payload) {
+  RenameDetector* detector = static_cast<RenameDetector*>(payload);
+  Candidate* target = detector->_pendingTargets[index];
+  const std::vector<Candidate*>& sources = detector->_pendingSources;
+  int threshold = detector->_options.threshold;
+
+  if (target->signature == NULL) {
+    return;
+  }
+  size_t targetSize = target->signature->size;
+
+  for (size_t s = 0; s < sources.size(); ++s) {
+    const SimilaritySignature* signature = sources[s]->signature;
+    if (signature == NULL) {
+      continue;
+    }
+    // Files of very different sizes cannot reach the threshold.
+    size_t smaller = std::min(targetSize, signature->size);
+    size_t larger = std::max(targetSize, signature->size);
+    if ((uint64_t) smaller * 100 < (uint64_t) larger * threshold) {
+      continue;
+    }
+
+    int score = target->signature->score(*signature);
+    if (score < threshold) {
+      continue;
+    }
+    target->scores.push_back(std::make_pair(score, s));
+    if (target->scores.size() > kScoresPerTarget) {
+      std::sort(target->scores.begin(), target->scores.end(), compareScores);
+      target->scores.pop_back();
+    }
+  }
+}
+
+bool RenameDetector::readContent(const Candidate& candidate,
+                                 std::vector<char>& content) {
+  if (candidate.hasId) {
+    git_blob* blob = NULL;
+    if (git_blob_lookup(&blob, _repo, &candidate.id) == 0) {
+      size_t size = (size_t) git_blob_rawsize(blob);
+      bool fits = size <= kMaxSignatureSize;
+      if (fits) {
+        const char* data = (const char*) git_blob_rawcontent(blob);
+        content.assign(data, data + size);
+      }
+      git_blob_free(blob);
+      return fits;
+    }
+  }
+
+  const char* workdir = git_repository_workdir(_repo);
+  if (workdir == NULL) {
+    return false;
+  }
+  std::string path = std::string(workdir) + candidate.file->path;
+
+  struct stat st;
+  if (stat(path.c_str(), &st) || !S_ISREG(st.st_mode) ||
+      (size_t) st.st_size > kMaxSignatureSize) {
+    return false;
+  }
+
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  content.resize(st.st_size);
+  size_t read = content.empty() ? 0 : fread(&content[0], 1, content.size(), file);
+  fclose(file);
+  content.resize(read);
+  return true;
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_RENAME_DETECTOR_H__
+#define GIT_SALT_RENAME_DETECTOR_H__
+
+#include <git2.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "oid_util.h"
+
+class WorkerPool;
+
+/**
+ * Content fingerprint used to score how similar two files are. The content
+ * is cut into chunks at newlines (or every 64 bytes), and the number of bytes
+ * that fall into each chunk hash is recorded, sorted by hash.
+ */
+struct SimilaritySignature {
+  std::vector<std::pair<uint32_t, uint32_t> > chunks;
+  size_t size;
+
+  SimilaritySignature() : size(0) {}
+
+  void compute(const char* data, size_t length);
+
+  // Returns a similarity score in [0, 100].
+  int score(const SimilaritySignature& other) const;
+};
+
+/**
+ * Similarity signatures keyed by blob OID. Blobs never change, so an entry
+ * stays valid across status and diff calls for as long as it is cached.
+ */
+class SimilarityCache {
+ public:
+  explicit SimilarityCache(size_t maxEntries);
+  ~SimilarityCache();
+
+  // Returns the signature cached for |oid|, or NULL.
+  const SimilaritySignature* lookup(const git_oid& oid);
+
+  // Takes ownership of |signature| and returns the cached entry for |oid|.
+  const SimilaritySignature* insert(const git_oid& oid,
+                                    SimilaritySignature* signature);
+
+  // Evicts the oldest entries beyond the size limit. Signatures handed out
+  // earlier may be freed, so only call this between operations.
+  void trim();
+
+  size_t hits;
+  size_t misses;
+
+ private:
+  typedef std::map<git_oid, SimilaritySignature*, OidLess> SignatureMap;
+
+  pthread_mutex_t _mutex;
+  SignatureMap _signatures;
+  std::deque<git_oid> _order;
+  size_t _maxEntries;
+};
+
+struct RenameOptions {
+  // Inexact matching is skipped when sources * targets exceeds limit^2.
+  size_t limit;
+  // Minimum similarity score (0-100) for a rename or copy.
+  int threshold;
+  bool findCopies;
+
+  RenameOptions() : limit(200), threshold(50), findCopies(false) {}
+};
+
+struct RenameMatch {
+  // Indices of the deltas in the diff.
+  size_t source;
+  size_t target;
+  int similarity;
+  bool copy;
+};
+
+/**
+ * Pairs deleted (and, for copies, modified) files of a diff with added or
+ * untracked ones. Exact matches are found by OID in linear time. Only the
+ * remaining files are fingerprinted and scored, in parallel on the worker
+ * pool, and only when their number stays within the rename limit. A
+ * detector is meant to be used for a single diff.
+ */
+class RenameDetector {
+ public:
+  RenameDetector(git_repository* repo, WorkerPool* pool,
+                 SimilarityCache* cache);
+  ~RenameDetector();
+
+  int detect(git_diff* diff, const RenameOptions& options,
+             std::vector<RenameMatch>& matches);
+
+ private:
+  struct Candidate {
+    size_t delta;
+    const git_diff_file* file;
+    bool hasId;
+    git_oid id;
+    const SimilaritySignature* signature;
+    SimilaritySignature* owned;
+    // Best scoring sources, only used for targets.
+    std::vector<std::pair<int, size_t> > scores;
+  };
+
+  static void hashCandidate(size_t index, void* payload);
+  static void signCandidate(size_t index, void* payload);
+  static void scoreTarget(size_t index, void* payload);
+
+  bool readContent(const Candidate& candidate, std::vector<char>& content);
+
+  git_repository* _repo;
+  WorkerPool* _pool;
+  SimilarityCache* _cache;
+  RenameOptions _options;
+
+  std::vector<Candidate> _sources;
+  std::vector<Candidate> _targets;
+  // Candidates to hash or fingerprint in the current parallel pass.
+  std::vector<Candidate*> _work;
+  // Candidates left for inexact matching.
+  std::vector<Candidate*> _pendingSources;
+  std::vector<Candidate*> _pendingTargets;
+};
+
+#endif  // GIT_SALT_RENAME_DETECTOR_H__
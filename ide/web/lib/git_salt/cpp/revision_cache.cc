@@ -0,0 +1,41 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "revision_cache.h"
+
+RevisionCache::RevisionCache(size_t maxEntries)
+    : hits(0), misses(0), _maxEntries(maxEntries), _refsGeneration(0) {}
+
+void RevisionCache::validate(unsigned refsGeneration) {
+  if (refsGeneration != _refsGeneration) {
+    _revisions.clear();
+    _order.clear();
+    _refsGeneration = refsGeneration;
+  }
+}
+
+bool RevisionCache::lookup(const std::string& spec,
+                           ResolvedRevision* resolved) {
+  RevisionMap::const_iterator it = _revisions.find(spec);
+  if (it == _revisions.end()) {
+    misses++;
+    return false;
+  }
+  hits++;
+  *resolved = it->second;
+  return true;
+}
+
+void RevisionCache::insert(const std::string& spec,
+                           const ResolvedRevision& resolved) {
+  if (_revisions.count(spec)) {
+    return;
+  }
+  if (_order.size() >= _maxEntries) {
+    _revisions.erase(_order.front());
+    _order.pop_front();
+  }
+  _revisions[spec] = resolved;
+  _order.push_back(spec);
+}
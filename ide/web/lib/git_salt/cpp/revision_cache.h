@@ -0,0 +1,51 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_REVISION_CACHE_H__
+#define GIT_SALT_REVISION_CACHE_H__
+
+#include <git2.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+struct ResolvedRevision {
+  git_oid id;
+  git_otype type;
+  int64_t size;
+};
+
+/**
+ * Revspecs ("HEAD", "v1.0", "master~3", "HEAD:src/main.dart") resolved to
+ * objects. A resolution depends on the refs, so the whole cache is dropped
+ * when the refs generation it was filled under goes stale. Specs that also
+ * depend on the index or the reflogs are not to be cached. Only used from
+ * the file thread.
+ */
+class RevisionCache {
+ public:
+  explicit RevisionCache(size_t maxEntries);
+
+  // Forgets everything when |refsGeneration| differs from the last one seen.
+  void validate(unsigned refsGeneration);
+
+  bool lookup(const std::string& spec, ResolvedRevision* resolved);
+
+  void insert(const std::string& spec, const ResolvedRevision& resolved);
+
+  size_t hits;
+  size_t misses;
+
+ private:
+  typedef std::map<std::string, ResolvedRevision> RevisionMap;
+
+  RevisionMap _revisions;
+  std::deque<std::string> _order;
+  size_t _maxEntries;
+  unsigned _refsGeneration;
+};
+
+#endif  // GIT_SALT_REVISION_CACHE_H__
@@ -0,0 +1,122 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "scheduler.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "timing.h"
+
+Scheduler::Scheduler() : _running(kInteractive) {
+  pthread_mutex_init(&_mutex, NULL);
+  memset(_stats, 0, sizeof(_stats));
+}
+
+Scheduler::~Scheduler() {
+  for (int i = 0; i < kPriorityCount; ++i) {
+    for (size_t j = 0; j < _queues[i].size(); ++j) {
+      delete _queues[i][j];
+    }
+  }
+  pthread_mutex_destroy(&_mutex);
+}
+
+void Scheduler::start(const pp::MessageLoop& loop) {
+  _loop = loop;
+}
+
+void Scheduler::post(Priority priority, const pp::CompletionCallback& callback,
+                     int64_t delayMs) {
+  Task* task = new Task();
+  task->scheduler = this;
+  task->priority = priority;
+  task->callback = callback;
+  if (delayMs > 0) {
+    _loop.PostWork(pp::CompletionCallback(&Scheduler::enqueueLater, task),
+        delayMs);
+  } else {
+    enqueue(task);
+  }
+}
+
+void Scheduler::enqueueLater(void* task, int32_t result) {
+  Task* t = static_cast<Task*>(task);
+  t->scheduler->enqueue(t);
+}
+
+void Scheduler::enqueue(Task* task) {
+  pthread_mutex_lock(&_mutex);
+  task->queuedMs = nowMs();
+  _queues[task->priority].push_back(task);
+  Stats& stats = _stats[task->priority];
+  stats.depth = _queues[task->priority].size();
+  stats.peakDepth = std::max(stats.peakDepth, stats.depth);
+  pthread_mutex_unlock(&_mutex);
+
+  // One turn of the loop per task. A turn finds nothing to do if yield()
+  // already ran its task.
+  _loop.PostWork(pp::CompletionCallback(&Scheduler::runNext, this));
+}
+
+void Scheduler::runNext(void* scheduler, int32_t result) {
+  static_cast<Scheduler*>(scheduler)->runTask(kBackground);
+}
+
+bool Scheduler::runTask(Priority priority) {
+  Task* task = NULL;
+  pthread_mutex_lock(&_mutex);
+  for (int i = 0; i <= priority && task == NULL; ++i) {
+    if (!_queues[i].empty()) {
+      task = _queues[i].front();
+      _queues[i].pop_front();
+      Stats& stats = _stats[i];
+      double wait = nowMs() - task->queuedMs;
+      stats.depth = _queues[i].size();
+      stats.waitMs += wait;
+      stats.maxWaitMs = std::max(stats.maxWaitMs, wait);
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  if (task == NULL) {
+    return false;
+  }
+
+  Priority previous = _running;
+  _running = task->priority;
+  task->callback.Run(PP_OK);
+  _running = previous;
+
+  pthread_mutex_lock(&_mutex);
+  _stats[task->priority].completed++;
+  pthread_mutex_unlock(&_mutex);
+  delete task;
+  return true;
+}
+
+bool Scheduler::yield() {
+  if (_running == kInteractive) {
+    return false;
+  }
+  Priority running = _running;
+  bool ran = false;
+  while (runTask(kInteractive)) {
+    ran = true;
+  }
+  if (ran) {
+    pthread_mutex_lock(&_mutex);
+    _stats[running].yields++;
+    pthread_mutex_unlock(&_mutex);
+  }
+  return ran;
+}
+
+Scheduler::Stats Scheduler::stats(Priority priority) {
+  pthread_mutex_lock(&_mutex);
+  Stats stats = _stats[priority];
+  pthread_mutex_unlock(&_mutex);
+  return stats;
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_SCHEDULER_H__
+#define GIT_SALT_SCHEDULER_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+
+#include "ppapi/cpp/completion_callback.h"
+#include "ppapi/cpp/message_loop.h"
+
+/**
+ * Orders the commands that run on the file thread by priority. Posted work
+ * is queued per class and every turn of the message loop runs the most
+ * urgent task waiting. Background tasks call yield() at their progress
+ * checkpoints, which runs any interactive work that has queued up in the
+ * meantime before the background task carries on.
+ */
+class Scheduler {
+ public:
+  enum Priority {
+    kInteractive,
+    kNormal,
+    kBackground,
+    kPriorityCount
+  };
+
+  struct Stats {
+    // Tasks waiting right now and the most that ever waited at once.
+    size_t depth;
+    size_t peakDepth;
+    size_t completed;
+    double waitMs;
+    double maxWaitMs;
+    // Times a running task of this class stepped aside for interactive work.
+    size_t yields;
+  };
+
+  Scheduler();
+  ~Scheduler();
+
+  // Sets the loop that runs the tasks. Must be called before post().
+  void start(const pp::MessageLoop& loop);
+
+  /**
+   * Queues |callback| at |priority|. With |delayMs| the task joins its queue
+   * only once the delay has passed. May be called from any thread.
+   */
+  void post(Priority priority, const pp::CompletionCallback& callback,
+      int64_t delayMs = 0);
+
+  /**
+   * Runs the interactive tasks that are waiting. Only the running task's
+   * thread may call this, and it does nothing from interactive tasks.
+   * Returns true if any task ran.
+   */
+  bool yield();
+
+  Stats stats(Priority priority);
+
+ private:
+  struct Task {
+    Scheduler* scheduler;
+    Priority priority;
+    pp::CompletionCallback callback;
+    double queuedMs;
+  };
+
+  static void enqueueLater(void* task, int32_t result);
+
+  static void runNext(void* scheduler, int32_t result);
+
+  void enqueue(Task* task);
+
+  // Runs the first task at |priority| or more urgent. False if none waits.
+  bool runTask(Priority priority);
+
+  pp::MessageLoop _loop;
+  pthread_mutex_t _mutex;
+  std::deque<Task*> _queues[kPriorityCount];
+  Stats _stats[kPriorityCount];
+  Priority _running;
+};
+
+#endif  // GIT_SALT_SCHEDULER_H__
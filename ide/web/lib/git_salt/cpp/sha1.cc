@@ -0,0 +1,213 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "sha1.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace {
+// Four 32 bit lanes, one per message. Supported by both gcc and the PNaCl
+// clang, which lower it to SSE2 or NEON where available.
+typedef uint32_t Lanes __attribute__((vector_size(16)));
+
+union LaneWords {
+  Lanes v;
+  uint32_t u[kSha1Lanes];
+};
+
+const uint32_t kInit[5] = {
+  0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+template <typename T>
+inline T Rotl(T x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+template <typename T>
+inline T Schedule(T* w, int t) {
+  w[t & 15] = Rotl<T>(w[(t + 13) & 15] ^ w[(t + 8) & 15] ^ w[(t + 2) & 15] ^
+      w[t & 15], 1);
+  return w[t & 15];
+}
+
+/**
+ * One block of the compression function. Written once for both the scalar
+ * words and the vector lanes; |w| is overwritten by the message schedule.
+ */
+template <typename T>
+void Compress(T* h, T* w) {
+  T a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+  for (int t = 0; t < 80; ++t) {
+    T f, wt = t < 16 ? w[t] : Schedule<T>(w, t);
+    if (t < 20) {
+      f = ((b & c) | (~b & d)) + 0x5a827999;
+    } else if (t < 40) {
+      f = (b ^ c ^ d) + 0x6ed9eba1;
+    } else if (t < 60) {
+      f = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+    } else {
+      f = (b ^ c ^ d) + 0xca62c1d6;
+    }
+    T temp = Rotl<T>(a, 5) + f + e + wt;
+    e = d;
+    d = c;
+    c = Rotl<T>(b, 30);
+    b = a;
+    a = temp;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+size_t BlockCount(const Sha1Message& m) {
+  // Room for the 0x80 marker and the 64 bit length.
+  return (m.prefixSize + m.size + 8) / 64 + 1;
+}
+
+inline uint32_t LoadBigEndian(const unsigned char* p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+      ((uint32_t) p[2] << 8) | p[3];
+}
+
+// Reads block |block| of the padded message into |w|.
+void LoadBlock(const Sha1Message& m, size_t block, uint32_t* w) {
+  size_t total = m.prefixSize + m.size;
+  size_t pos = block * 64;
+  const unsigned char* src;
+  unsigned char buffer[64];
+
+  if (pos >= m.prefixSize && pos + 64 <= total) {
+    src = m.data + (pos - m.prefixSize);
+  } else {
+    // The blocks that hold the prefix or the padding.
+    for (size_t i = 0; i < 64; ++i) {
+      size_t p = pos + i;
+      if (p < m.prefixSize) {
+        buffer[i] = m.prefix[p];
+      } else if (p < total) {
+        buffer[i] = m.data[p - m.prefixSize];
+      } else {
+        buffer[i] = p == total ? 0x80 : 0;
+      }
+    }
+    if (block == BlockCount(m) - 1) {
+      uint64_t bits = (uint64_t) total * 8;
+      for (int i = 0; i < 8; ++i) {
+        buffer[63 - i] = (unsigned char) (bits >> (8 * i));
+      }
+    }
+    src = buffer;
+  }
+
+  for (int i = 0; i < 16; ++i) {
+    w[i] = LoadBigEndian(src + 4 * i);
+  }
+}
+
+void StoreDigest(const uint32_t* h, unsigned char* digest) {
+  for (int i = 0; i < 5; ++i) {
+    digest[4 * i] = (unsigned char) (h[i] >> 24);
+    digest[4 * i + 1] = (unsigned char) (h[i] >> 16);
+    digest[4 * i + 2] = (unsigned char) (h[i] >> 8);
+    digest[4 * i + 3] = (unsigned char) h[i];
+  }
+}
+
+// Finishes |m| with the scalar rounds, starting at |block| from state |h|.
+void FinishScalar(Sha1Message* m, size_t block, uint32_t* h) {
+  uint32_t w[16];
+  for (size_t blocks = BlockCount(*m); block < blocks; ++block) {
+    LoadBlock(*m, block, w);
+    Compress<uint32_t>(h, w);
+  }
+  StoreDigest(h, m->digest);
+}
+}
+
+void sha1Hash(Sha1Message* message) {
+  uint32_t h[5];
+  memcpy(h, kInit, sizeof(h));
+  FinishScalar(message, 0, h);
+}
+
+void sha1HashLanes(Sha1Message* messages, size_t count) {
+  Sha1Message* lane[kSha1Lanes] = {NULL};
+  size_t block[kSha1Lanes] = {0};
+  size_t blocks[kSha1Lanes] = {0};
+  LaneWords h[5];
+  size_t next = 0;
+
+  for (;;) {
+    size_t active = 0;
+    for (size_t i = 0; i < kSha1Lanes; ++i) {
+      if (lane[i] == NULL && next < count) {
+        lane[i] = &messages[next++];
+        block[i] = 0;
+        blocks[i] = BlockCount(*lane[i]);
+        for (int j = 0; j < 5; ++j) {
+          h[j].u[i] = kInit[j];
+        }
+      }
+      active += lane[i] != NULL;
+    }
+
+    // A lone lane is cheaper on the scalar rounds.
+    if (active <= 1) {
+      break;
+    }
+
+    uint32_t words[kSha1Lanes][16];
+    for (size_t i = 0; i < kSha1Lanes; ++i) {
+      if (lane[i] != NULL) {
+        LoadBlock(*lane[i], block[i], words[i]);
+      } else {
+        memset(words[i], 0, sizeof(words[i]));
+      }
+    }
+    LaneWords w[16];
+    for (int t = 0; t < 16; ++t) {
+      for (size_t i = 0; i < kSha1Lanes; ++i) {
+        w[t].u[i] = words[i][t];
+      }
+    }
+
+    Lanes state[5], schedule[16];
+    for (int j = 0; j < 5; ++j) {
+      state[j] = h[j].v;
+    }
+    for (int t = 0; t < 16; ++t) {
+      schedule[t] = w[t].v;
+    }
+    Compress<Lanes>(state, schedule);
+    for (int j = 0; j < 5; ++j) {
+      h[j].v = state[j];
+    }
+
+    for (size_t i = 0; i < kSha1Lanes; ++i) {
+      if (lane[i] != NULL && ++block[i] == blocks[i]) {
+        uint32_t digest[5];
+        for (int j = 0; j < 5; ++j) {
+          digest[j] = h[j].u[i];
+        }
+        StoreDigest(digest, lane[i]->digest);
+        lane[i] = NULL;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < kSha1Lanes; ++i) {
+    if (lane[i] != NULL) {
+      uint32_t state[5];
+      for (int j = 0; j < 5; ++j) {
+        state[j] = h[j].u[i];
+      }
+      FinishScalar(lane[i], block[i], state);
+    }
+  }
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_SHA1_H__
+#define GIT_SALT_SHA1_H__
+
+#include <stddef.h>
+
+/**
+ * A message to hash: |prefix| followed by |data|, so a git object header
+ * and its content can be hashed without joining them first.
+ */
+struct Sha1Message {
+  const unsigned char* prefix;
+  size_t prefixSize;
+  const unsigned char* data;
+  size_t size;
+  unsigned char digest[20];
+};
+
+// Number of messages sha1HashLanes() compresses side by side.
+const size_t kSha1Lanes = 4;
+
+// Hashes one message with the plain scalar rounds.
+void sha1Hash(Sha1Message* message);
+
+/**
+ * Hashes |count| messages, kSha1Lanes at a time, with every round computed
+ * for all lanes in one vector operation. A lane that finishes takes up the
+ * next message, so messages of different lengths keep the lanes busy. Suits
+ * many small messages; a single large one gains nothing.
+ */
+void sha1HashLanes(Sha1Message* messages, size_t count);
+
+#endif  // GIT_SALT_SHA1_H__
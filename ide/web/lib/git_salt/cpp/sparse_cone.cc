@@ -0,0 +1,195 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "sparse_cone.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+std::string SparseFile(const std::string& gitDir) {
+  std::string dir = gitDir;
+  if (!dir.empty() && dir[dir.length() - 1] != '/') {
+    dir += '/';
+  }
+  return dir + "info/sparse-checkout";
+}
+
+std::string DirName(const std::string& path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? "" : path.substr(0, slash);
+}
+
+std::string TrimSlashes(const std::string& path) {
+  size_t begin = path.find_first_not_of('/');
+  size_t end = path.find_last_not_of('/');
+  return begin == std::string::npos ? "" : path.substr(begin, end - begin + 1);
+}
+}
+
+SparseCone::SparseCone() : _enabled(false) {}
+
+void SparseCone::setCone(const std::set<std::string>& directories) {
+  _directories.clear();
+  _parents.clear();
+  // Directories below another cone directory are already included.
+  for (std::set<std::string>::const_iterator it = directories.begin();
+       it != directories.end(); ++it) {
+    bool nested = false;
+    for (size_t i = it->find('/'); !nested && i != std::string::npos;
+         i = it->find('/', i + 1)) {
+      nested = _directories.count(it->substr(0, i)) > 0;
+    }
+    if (!it->empty() && !nested) {
+      _directories.insert(*it);
+    }
+  }
+
+  for (std::set<std::string>::iterator it = _directories.begin();
+       it != _directories.end(); ++it) {
+    _parents.insert("");
+    for (size_t i = it->find('/'); i != std::string::npos;
+         i = it->find('/', i + 1)) {
+      _parents.insert(it->substr(0, i));
+    }
+  }
+  _enabled = !_directories.empty();
+}
+
+void SparseCone::setDirectories(const std::vector<std::string>& directories) {
+  std::set<std::string> cone;
+  for (size_t i = 0; i < directories.size(); ++i) {
+    cone.insert(TrimSlashes(directories[i]));
+  }
+  setCone(cone);
+}
+
+int SparseCone::load(const std::string& gitDir) {
+  _directories.clear();
+  _parents.clear();
+  _enabled = false;
+
+  FILE* file = fopen(SparseFile(gitDir).c_str(), "rb");
+  if (file == NULL) {
+    return errno == ENOENT ? 0 : -1;
+  }
+
+  // Cone mode lists "/dir/" for every included directory and "!/dir/*/" for
+  // the ones that only include their direct children.
+  std::set<std::string> listed;
+  std::set<std::string> shallow;
+  char line[4096];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    std::string pattern(line);
+    pattern.erase(pattern.find_last_not_of("\r\n") + 1);
+    if (pattern == "/*" || pattern == "!/*/") {
+      continue;
+    }
+    if (pattern.compare(0, 2, "!/") == 0 && pattern.length() > 4 &&
+        pattern.compare(pattern.length() - 3, 3, "/*/") == 0) {
+      shallow.insert(TrimSlashes(pattern.substr(1, pattern.length() - 3)));
+    } else if (pattern.compare(0, 1, "/") == 0) {
+      listed.insert(TrimSlashes(pattern));
+    }
+  }
+  fclose(file);
+
+  std::set<std::string> cone;
+  for (std::set<std::string>::iterator it = listed.begin();
+       it != listed.end(); ++it) {
+    if (!shallow.count(*it)) {
+      cone.insert(*it);
+    }
+  }
+  setCone(cone);
+  return 0;
+}
+
+int SparseCone::save(const std::string& gitDir) const {
+  std::string path = SparseFile(gitDir);
+  if (!_enabled) {
+    return unlink(path.c_str()) && errno != ENOENT ? -1 : 0;
+  }
+
+  std::string infoDir = path.substr(0, path.rfind('/'));
+  if (mkdir(infoDir.c_str(), 0755) && errno != EEXIST) {
+    return -1;
+  }
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == NULL) {
+    return -1;
+  }
+  fputs("/*\n!/*/\n", file);
+  for (std::set<std::string>::const_iterator it = _parents.begin();
+       it != _parents.end(); ++it) {
+    if (!it->empty()) {
+      fprintf(file, "/%s/\n!/%s/*/\n", it->c_str(), it->c_str());
+    }
+  }
+  for (std::set<std::string>::const_iterator it = _directories.begin();
+       it != _directories.end(); ++it) {
+    fprintf(file, "/%s/\n", it->c_str());
+  }
+  return fclose(file);
+}
+
+bool SparseCone::includes(const char* path) const {
+  if (!_enabled) {
+    return true;
+  }
+
+  std::string file(path);
+  if (_parents.count(DirName(file))) {
+    return true;
+  }
+  for (size_t i = file.find('/'); i != std::string::npos;
+       i = file.find('/', i + 1)) {
+    if (_directories.count(file.substr(0, i))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SparseCone::pathspecs(git_index* index, const char* workdir,
+                           std::vector<std::string>* specs) const {
+  std::set<std::string> files;
+  size_t count = git_index_entrycount(index);
+  for (size_t i = 0; i < count; ++i) {
+    const char* path = git_index_get_byindex(index, i)->path;
+    if (_parents.count(DirName(path))) {
+      files.insert(path);
+    }
+  }
+
+  // Parents are listed one level deep, so files that are not tracked yet
+  // show up without walking the directories outside the cone.
+  for (std::set<std::string>::const_iterator it = _parents.begin();
+       workdir != NULL && it != _parents.end(); ++it) {
+    std::string prefix = it->empty() ? "" : *it + "/";
+    DIR* dir = opendir((workdir + prefix).c_str());
+    if (dir == NULL) {
+      continue;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+      std::string name = entry->d_name;
+      struct stat st;
+      if (name == "." || name == ".." || (it->empty() && name == ".git") ||
+          stat((workdir + prefix + name).c_str(), &st) ||
+          S_ISDIR(st.st_mode)) {
+        continue;
+      }
+      files.insert(prefix + name);
+    }
+    closedir(dir);
+  }
+
+  specs->insert(specs->end(), _directories.begin(), _directories.end());
+  specs->insert(specs->end(), files.begin(), files.end());
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_SPARSE_CONE_H__
+#define GIT_SALT_SPARSE_CONE_H__
+
+#include <git2.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Cone mode sparse checkout patterns, stored in info/sparse-checkout in the
+ * same format git uses. A cone directory includes everything below it; the
+ * files directly in the root and in the parents of cone directories are
+ * included as well. Without the file everything is included.
+ */
+class SparseCone {
+ public:
+  SparseCone();
+
+  int load(const std::string& gitDir);
+
+  // Writes the patterns, or removes the file when the cone is disabled.
+  int save(const std::string& gitDir) const;
+
+  // Restricts the checkout to |directories|; an empty list disables it.
+  void setDirectories(const std::vector<std::string>& directories);
+
+  bool enabled() const { return _enabled; }
+
+  const std::set<std::string>& directories() const { return _directories; }
+
+  bool includes(const char* path) const;
+
+  /**
+   * Appends literal pathspecs covering the cone, for use with
+   * DISABLE_PATHSPEC_MATCH: the cone directories, plus the files directly
+   * in one of their parents, tracked in |index| or present in |workdir|.
+   */
+  void pathspecs(git_index* index, const char* workdir,
+      std::vector<std::string>* specs) const;
+
+ private:
+  void setCone(const std::set<std::string>& directories);
+
+  bool _enabled;
+  std::set<std::string> _directories;
+  // Directories whose direct children are included: "" and every parent.
+  std::set<std::string> _parents;
+};
+
+#endif  // GIT_SALT_SPARSE_CONE_H__
@@ -0,0 +1,165 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "text_pattern.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+typedef char Bytes __attribute__((vector_size(16)));
+
+Bytes Broadcast(char c) {
+  Bytes bytes;
+  for (int i = 0; i < 16; ++i) {
+    bytes[i] = c;
+  }
+  return bytes;
+}
+
+inline bool AnySet(Bytes bytes) {
+  uint64_t halves[2];
+  memcpy(halves, &bytes, sizeof(halves));
+  return (halves[0] | halves[1]) != 0;
+}
+
+std::string ToLower(const char* data, size_t size) {
+  std::string lower(data, size);
+  for (size_t i = 0; i < size; ++i) {
+    lower[i] = tolower((unsigned char) lower[i]);
+  }
+  return lower;
+}
+}
+
+TextPattern::TextPattern() : _ignoreCase(false), _isRegex(false) {}
+
+TextPattern::~TextPattern() {
+  if (_isRegex) {
+    regfree(&_regex);
+  }
+}
+
+bool TextPattern::compile(const std::string& pattern, bool regex,
+                          bool ignoreCase, std::string* error) {
+  _ignoreCase = ignoreCase;
+  if (!regex) {
+    _literal = ignoreCase ? ToLower(pattern.data(), pattern.size()) : pattern;
+    return true;
+  }
+
+  int flags = REG_EXTENDED | REG_NOSUB | (ignoreCase ? REG_ICASE : 0);
+  int r = regcomp(&_regex, pattern.c_str(), flags);
+  if (r) {
+    char message[256];
+    regerror(r, &_regex, message, sizeof(message));
+    *error = message;
+    return false;
+  }
+  _isRegex = true;
+  return true;
+}
+
+const char* TextPattern::findLiteral(const char* begin,
+                                     const char* end) const {
+  size_t n = _literal.size();
+  if ((size_t) (end - begin) < n) {
+    return NULL;
+  }
+  const char* literal = _literal.data();
+  const char* p = begin;
+
+  Bytes first = Broadcast(literal[0]);
+  Bytes last = Broadcast(literal[n - 1]);
+  for (; end - (p + n - 1) >= 16; p += 16) {
+    Bytes head, tail;
+    memcpy(&head, p, 16);
+    memcpy(&tail, p + n - 1, 16);
+    Bytes candidates = (head == first) & (tail == last);
+    if (!AnySet(candidates)) {
+      continue;
+    }
+    for (int i = 0; i < 16; ++i) {
+      if (candidates[i] && !memcmp(p + i, literal, n)) {
+        return p + i;
+      }
+    }
+  }
+
+  for (; p + n <= end; ++p) {
+    if (*p == literal[0] && !memcmp(p, literal, n)) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+void TextPattern::matchLiteral(const char* data, size_t size, LineFn fn,
+                               void* payload) const {
+  // Searches a lower case copy; the lines reported are the original ones.
+  std::string lower;
+  const char* text = data;
+  if (_ignoreCase) {
+    lower = ToLower(data, size);
+    text = lower.data();
+  }
+  const char* end = text + size;
+
+  size_t lineNumber = 1;
+  const char* counted = text;
+  // |p| is always at the start of a line.
+  for (const char* p = text; p < end;) {
+    const char* match = _literal.empty() ? p : findLiteral(p, end);
+    if (match == NULL) {
+      break;
+    }
+    lineNumber += std::count(counted, match, '\n');
+    counted = match;
+
+    const char* lineStart = match;
+    while (lineStart > p && lineStart[-1] != '\n') {
+      lineStart--;
+    }
+    const char* lineEnd = (const char*) memchr(match, '\n', end - match);
+    if (lineEnd == NULL) {
+      lineEnd = end;
+    }
+    if (!fn(lineNumber, data + (lineStart - text), lineEnd - lineStart,
+            payload)) {
+      return;
+    }
+    // One report per line: carry on after it.
+    p = lineEnd + 1;
+  }
+}
+
+void TextPattern::matchRegex(const char* data, size_t size, LineFn fn,
+                             void* payload) const {
+  std::string line;
+  size_t lineNumber = 1;
+  for (const char* p = data; p < data + size; ++lineNumber) {
+    const char* lineEnd = (const char*) memchr(p, '\n', data + size - p);
+    if (lineEnd == NULL) {
+      lineEnd = data + size;
+    }
+    line.assign(p, lineEnd);
+    if (!regexec(&_regex, line.c_str(), 0, NULL, 0) &&
+        !fn(lineNumber, p, lineEnd - p, payload)) {
+      return;
+    }
+    p = lineEnd + 1;
+  }
+}
+
+void TextPattern::matchLines(const char* data, size_t size, LineFn fn,
+                             void* payload) const {
+  if (_isRegex) {
+    matchRegex(data, size, fn, payload);
+  } else {
+    matchLiteral(data, size, fn, payload);
+  }
+}
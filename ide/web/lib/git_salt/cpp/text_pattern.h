@@ -0,0 +1,53 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_TEXT_PATTERN_H__
+#define GIT_SALT_TEXT_PATTERN_H__
+
+#include <regex.h>
+#include <stddef.h>
+
+#include <string>
+
+/**
+ * A literal or POSIX extended regular expression, matched against the
+ * lines of a buffer. Literals are found with a 16 byte vector scan that
+ * compares the first and last byte of the pattern at 16 positions at once
+ * and only checks the rest where both agree. Once compiled, a pattern may
+ * be used from several threads at a time.
+ */
+class TextPattern {
+ public:
+  // Called for every matching line; returning false stops the search.
+  typedef bool (*LineFn)(size_t lineNumber, const char* line, size_t length,
+      void* payload);
+
+  TextPattern();
+  ~TextPattern();
+
+  // Returns false, with |error| set, for a regex that does not compile.
+  bool compile(const std::string& pattern, bool regex, bool ignoreCase,
+      std::string* error);
+
+  // Calls |fn| for each line of [data, data + size) that matches.
+  void matchLines(const char* data, size_t size, LineFn fn,
+      void* payload) const;
+
+ private:
+  // First occurrence of the literal in [begin, end), or NULL.
+  const char* findLiteral(const char* begin, const char* end) const;
+
+  void matchLiteral(const char* data, size_t size, LineFn fn,
+      void* payload) const;
+
+  void matchRegex(const char* data, size_t size, LineFn fn,
+      void* payload) const;
+
+  std::string _literal;
+  bool _ignoreCase;
+  bool _isRegex;
+  regex_t _regex;
+};
+
+#endif  // GIT_SALT_TEXT_PATTERN_H__
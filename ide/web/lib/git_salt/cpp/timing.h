@@ -0,0 +1,51 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_TIMING_H__
+#define GIT_SALT_TIMING_H__
+
+#include <stddef.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+// Wall clock time in milliseconds, for reporting how long phases take.
+inline double nowMs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/**
+ * How long each startup phase took and when it ended, counted from the
+ * creation of the timer. Phases are recorded in order: the first on the
+ * main thread before the file thread gets any work, the rest on the file
+ * thread.
+ */
+class StartupTimer {
+ public:
+  struct Phase {
+    std::string name;
+    double ms;
+    double endMs;
+  };
+
+  StartupTimer() : _createdMs(nowMs()) {}
+
+  // Records phase |name| as having run from |startMs| until now.
+  void record(const std::string& name, double startMs) {
+    double now = nowMs();
+    Phase phase = {name, now - startMs, now - _createdMs};
+    _phases.push_back(phase);
+  }
+
+  const std::vector<Phase>& phases() const { return _phases; }
+
+ private:
+  double _createdMs;
+  std::vector<Phase> _phases;
+};
+
+#endif  // GIT_SALT_TIMING_H__
@@ -0,0 +1,47 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "tree_cache.h"
+
+TreeCache::TreeCache(size_t maxEntries)
+    : _numEntries(0), _maxEntries(maxEntries) {}
+
+TreeListing* TreeCache::get(git_repository* repo, const git_oid& id,
+                            int* error) {
+  ListingMap::iterator it = _listings.find(id);
+  if (it != _listings.end()) {
+    *error = 0;
+    return &it->second;
+  }
+
+  git_tree* tree = NULL;
+  if ((*error = git_tree_lookup(&tree, repo, &id))) {
+    return NULL;
+  }
+
+  size_t count = git_tree_entrycount(tree);
+  while (!_order.empty() && _numEntries + count > _maxEntries) {
+    ListingMap::iterator oldest = _listings.find(_order.front());
+    _numEntries -= oldest->second.size();
+    _listings.erase(oldest);
+    _order.pop_front();
+  }
+
+  TreeListing& listing = _listings[id];
+  listing.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    const git_tree_entry* source = git_tree_entry_byindex(tree, i);
+    TreeListingEntry& entry = listing[i];
+    entry.name = git_tree_entry_name(source);
+    entry.mode = git_tree_entry_filemode(source);
+    entry.type = git_tree_entry_type(source);
+    git_oid_cpy(&entry.id, git_tree_entry_id(source));
+    entry.size = -1;
+  }
+  git_tree_free(tree);
+
+  _order.push_back(id);
+  _numEntries += count;
+  return &listing;
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_TREE_CACHE_H__
+#define GIT_SALT_TREE_CACHE_H__
+
+#include <git2.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "oid_util.h"
+
+struct TreeListingEntry {
+  std::string name;
+  git_filemode_t mode;
+  git_otype type;
+  git_oid id;
+  // Object size, or -1 until it has been asked for.
+  int64_t size;
+};
+
+typedef std::vector<TreeListingEntry> TreeListing;
+
+/**
+ * One level listings of trees, keyed by tree OID. Trees are immutable, so a
+ * listing never has to be invalidated; old ones are simply dropped once the
+ * cache holds more than its limit of entries. Only used from the file thread.
+ */
+class TreeCache {
+ public:
+  explicit TreeCache(size_t maxEntries);
+
+  // Returns the listing of |id|, reading the tree on a miss.
+  TreeListing* get(git_repository* repo, const git_oid& id, int* error);
+
+ private:
+  typedef std::map<git_oid, TreeListing, OidLess> ListingMap;
+
+  ListingMap _listings;
+  std::deque<git_oid> _order;
+  size_t _numEntries;
+  size_t _maxEntries;
+};
+
+#endif  // GIT_SALT_TREE_CACHE_H__
@@ -0,0 +1,368 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "trigram_index.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+
+#include "file_util.h"
+
+namespace {
+const char* const kIndexFile = "salt_trigrams";
+const char kMagic[4] = {'S', 'T', 'R', 'G'};
+const unsigned char kVersion = 1;
+// Larger text blobs are kept out of the posting lists and always searched.
+const size_t kMaxIndexedSize = 1 << 20;
+// Like git, a NUL in the first 8000 bytes marks a blob as binary.
+const size_t kBinaryProbeBytes = 8000;
+
+// Appends the distinct trigrams of |data|, case folded. Trigrams spanning a
+// line break are left out, as searches match within a line.
+void ExtractTrigrams(const char* data, size_t size,
+    std::vector<uint32_t>* out) {
+  uint32_t window = 0;
+  size_t run = 0;
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char c = data[i];
+    if (c == '\n') {
+      run = 0;
+      continue;
+    }
+    window = ((window << 8) | tolower(c)) & 0xffffff;
+    if (++run >= 3) {
+      out->push_back(window);
+    }
+  }
+  std::sort(out->begin(), out->end());
+  out->erase(std::unique(out->begin(), out->end()), out->end());
+}
+
+void PutVarint(std::string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back((char) (value | 0x80));
+    value >>= 7;
+  }
+  out->push_back((char) value);
+}
+
+bool GetVarint(const std::string& in, size_t* pos, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *pos < in.size(); shift += 7) {
+    unsigned char byte = in[(*pos)++];
+    *value |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadFile(const std::string& path, std::string* data) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char buffer[65536];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data->append(buffer, read);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+}
+
+TrigramIndex::TrigramIndex()
+    : _hasTree(false), _lastIndexed(0), _repo(NULL) {}
+
+void TrigramIndex::reset() {
+  _hasTree = false;
+  _blobs.clear();
+  _blobIds.clear();
+  _postings.clear();
+  _files.clear();
+}
+
+int TrigramIndex::collectEntry(const char* root, const git_tree_entry* entry,
+    void* payload) {
+  if (git_tree_entry_type(entry) != GIT_OBJ_BLOB ||
+      git_tree_entry_filemode(entry) == GIT_FILEMODE_LINK) {
+    return 0;
+  }
+  std::vector<File>* files = static_cast<std::vector<File>*>(payload);
+  File file;
+  file.path = std::string(root) + git_tree_entry_name(entry);
+  git_oid_cpy(&file.id, git_tree_entry_id(entry));
+  file.blob = 0;
+  files->push_back(file);
+  return 0;
+}
+
+void TrigramIndex::indexBlob(size_t index, void* payload) {
+  TrigramIndex* trigrams = static_cast<TrigramIndex*>(payload);
+  PendingBlob& pending = trigrams->_pending[index];
+  git_blob* blob = NULL;
+  pending.kind = kUnindexed;
+  if (git_blob_lookup(&blob, trigrams->_repo, &pending.id)) {
+    return;
+  }
+  const char* data = (const char*) git_blob_rawcontent(blob);
+  size_t size = (size_t) git_blob_rawsize(blob);
+  if (memchr(data, 0, std::min(size, kBinaryProbeBytes)) != NULL) {
+    pending.kind = kBinary;
+  } else if (size <= kMaxIndexedSize) {
+    ExtractTrigrams(data, size, &pending.trigrams);
+    pending.kind = kIndexed;
+  }
+  git_blob_free(blob);
+}
+
+int TrigramIndex::update(git_repository* repo, const git_oid& treeId,
+    WorkerPool* pool) {
+  std::string path = std::string(git_repository_path(repo)) + kIndexFile;
+  // Another repository has an index of its own.
+  if (path != _path && !load(path)) {
+    reset();
+  }
+  _path = path;
+  _lastIndexed = 0;
+  if (_hasTree && !git_oid_cmp(&_tree, &treeId) && !_files.empty()) {
+    return 0;
+  }
+
+  git_tree* tree = NULL;
+  std::vector<File> files;
+  int r = git_tree_lookup(&tree, repo, &treeId);
+  if (!r) {
+    r = git_tree_walk(tree, GIT_TREEWALK_PRE, &TrigramIndex::collectEntry,
+        &files);
+  }
+  git_tree_free(tree);
+  if (r) {
+    return r;
+  }
+
+  std::map<git_oid, uint32_t, OidLess> pendingIds;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!_blobIds.count(files[i].id) && !pendingIds.count(files[i].id)) {
+      pendingIds[files[i].id] = _pending.size();
+      _pending.push_back(PendingBlob());
+      git_oid_cpy(&_pending.back().id, &files[i].id);
+    }
+  }
+
+  _repo = repo;
+  pool->parallelFor(_pending.size(), &TrigramIndex::indexBlob, this);
+  _repo = NULL;
+
+  // New blobs get the highest numbers, which keeps every list sorted.
+  for (size_t i = 0; i < _pending.size(); ++i) {
+    uint32_t id = _blobs.size();
+    Blob blob;
+    git_oid_cpy(&blob.id, &_pending[i].id);
+    blob.kind = _pending[i].kind;
+    _blobs.push_back(blob);
+    _blobIds[blob.id] = id;
+    const std::vector<uint32_t>& trigrams = _pending[i].trigrams;
+    for (size_t j = 0; j < trigrams.size(); ++j) {
+      _postings[trigrams[j]].push_back(id);
+    }
+  }
+  _lastIndexed = _pending.size();
+  _pending.clear();
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    files[i].blob = _blobIds[files[i].id];
+  }
+  _files.swap(files);
+  bool moved = !_hasTree || git_oid_cmp(&_tree, &treeId);
+  git_oid_cpy(&_tree, &treeId);
+  _hasTree = true;
+
+  size_t blobs = _blobs.size();
+  compact();
+  if (_lastIndexed || moved || blobs != _blobs.size()) {
+    // The index is only an accelerator: failing to save it is not an error.
+    save(path);
+  }
+  return 0;
+}
+
+void TrigramIndex::compact() {
+  std::vector<bool> live(_blobs.size(), false);
+  size_t liveCount = 0;
+  for (size_t i = 0; i < _files.size(); ++i) {
+    if (!live[_files[i].blob]) {
+      live[_files[i].blob] = true;
+      liveCount++;
+    }
+  }
+  if (_blobs.size() - liveCount <= liveCount) {
+    return;
+  }
+
+  std::vector<uint32_t> remap(_blobs.size());
+  std::vector<Blob> blobs;
+  _blobIds.clear();
+  for (size_t i = 0; i < _blobs.size(); ++i) {
+    if (live[i]) {
+      remap[i] = blobs.size();
+      _blobIds[_blobs[i].id] = blobs.size();
+      blobs.push_back(_blobs[i]);
+    }
+  }
+  _blobs.swap(blobs);
+
+  for (PostingMap::iterator it = _postings.begin(); it != _postings.end();) {
+    std::vector<uint32_t>& list = it->second;
+    size_t kept = 0;
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (live[list[i]]) {
+        list[kept++] = remap[list[i]];
+      }
+    }
+    list.resize(kept);
+    if (list.empty()) {
+      _postings.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+
+  for (size_t i = 0; i < _files.size(); ++i) {
+    _files[i].blob = remap[_files[i].blob];
+  }
+}
+
+void TrigramIndex::candidates(const std::string& literal,
+    std::vector<const File*>* out) const {
+  std::vector<uint32_t> trigrams;
+  ExtractTrigrams(literal.data(), literal.size(), &trigrams);
+
+  // Intersects the shortest lists first.
+  std::vector<const std::vector<uint32_t>*> lists;
+  for (size_t i = 0; i < trigrams.size(); ++i) {
+    PostingMap::const_iterator it = _postings.find(trigrams[i]);
+    if (it == _postings.end()) {
+      lists.clear();
+      break;
+    }
+    lists.push_back(&it->second);
+  }
+  std::vector<uint32_t> hits;
+  if (!lists.empty()) {
+    for (size_t i = 1; i < lists.size(); ++i) {
+      for (size_t j = i; j > 0 && lists[j]->size() < lists[j - 1]->size();
+           --j) {
+        std::swap(lists[j], lists[j - 1]);
+      }
+    }
+    hits = *lists[0];
+    for (size_t i = 1; i < lists.size() && !hits.empty(); ++i) {
+      std::vector<uint32_t> both;
+      std::set_intersection(hits.begin(), hits.end(), lists[i]->begin(),
+          lists[i]->end(), std::back_inserter(both));
+      hits.swap(both);
+    }
+  }
+
+  std::vector<bool> candidate(_blobs.size(), false);
+  for (size_t i = 0; i < _blobs.size(); ++i) {
+    candidate[i] = _blobs[i].kind == kUnindexed ||
+        (trigrams.empty() && _blobs[i].kind == kIndexed);
+  }
+  for (size_t i = 0; i < hits.size(); ++i) {
+    candidate[hits[i]] = true;
+  }
+  for (size_t i = 0; i < _files.size(); ++i) {
+    if (candidate[_files[i].blob]) {
+      out->push_back(&_files[i]);
+    }
+  }
+}
+
+bool TrigramIndex::load(const std::string& path) {
+  std::string data;
+  if (!ReadFile(path, &data) || data.size() < 5 + GIT_OID_RAWSZ ||
+      memcmp(data.data(), kMagic, 4) || (unsigned char) data[4] != kVersion) {
+    return false;
+  }
+  reset();
+  size_t pos = 5;
+  git_oid_fromraw(&_tree, (const unsigned char*) data.data() + pos);
+  pos += GIT_OID_RAWSZ;
+
+  // The files of the tree are listed again by the next update.
+  uint64_t count;
+  if (!GetVarint(data, &pos, &count) ||
+      count > (data.size() - pos) / (GIT_OID_RAWSZ + 1)) {
+    return false;
+  }
+  _blobs.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    git_oid_fromraw(&_blobs[i].id, (const unsigned char*) data.data() + pos);
+    _blobs[i].kind = data[pos + GIT_OID_RAWSZ];
+    _blobIds[_blobs[i].id] = i;
+    pos += GIT_OID_RAWSZ + 1;
+  }
+
+  uint64_t trigrams;
+  if (!GetVarint(data, &pos, &trigrams)) {
+    return false;
+  }
+  uint64_t trigram = 0;
+  for (uint64_t i = 0; i < trigrams; ++i) {
+    uint64_t delta, length;
+    if (!GetVarint(data, &pos, &delta) || !GetVarint(data, &pos, &length) ||
+        length > data.size() - pos) {
+      return false;
+    }
+    trigram += delta;
+    std::vector<uint32_t>& list = _postings[(uint32_t) trigram];
+    list.resize(length);
+    uint64_t blob = 0;
+    for (uint64_t j = 0; j < length; ++j) {
+      if (!GetVarint(data, &pos, &delta) || (blob += delta) >= count) {
+        return false;
+      }
+      list[j] = blob;
+    }
+  }
+  _hasTree = true;
+  return pos == data.size();
+}
+
+int TrigramIndex::save(const std::string& path) const {
+  // Blob numbers and trigrams are stored as deltas from the previous one.
+  std::string data(kMagic, 4);
+  data.push_back(kVersion);
+  data.append((const char*) _tree.id, GIT_OID_RAWSZ);
+  PutVarint(&data, _blobs.size());
+  for (size_t i = 0; i < _blobs.size(); ++i) {
+    data.append((const char*) _blobs[i].id.id, GIT_OID_RAWSZ);
+    data.push_back(_blobs[i].kind);
+  }
+
+  PutVarint(&data, _postings.size());
+  uint32_t trigram = 0;
+  for (PostingMap::const_iterator it = _postings.begin();
+       it != _postings.end(); ++it) {
+    PutVarint(&data, it->first - trigram);
+    trigram = it->first;
+    const std::vector<uint32_t>& list = it->second;
+    PutVarint(&data, list.size());
+    uint32_t blob = 0;
+    for (size_t i = 0; i < list.size(); ++i) {
+      PutVarint(&data, list[i] - blob);
+      blob = list[i];
+    }
+  }
+  return writeFileAtomically(path, data);
+}
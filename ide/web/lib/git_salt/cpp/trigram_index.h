@@ -0,0 +1,107 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_TRIGRAM_INDEX_H__
+#define GIT_SALT_TRIGRAM_INDEX_H__
+
+#include <git2.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "oid_util.h"
+#include "worker_pool.h"
+
+/**
+ * Posting lists of the case folded trigrams of every text blob of a tree,
+ * keyed by blob OID and saved in the git directory. Blobs are immutable, so
+ * moving the index to another tree only reads the blobs it has not seen; the
+ * ones no longer referenced are dropped once they outnumber the live ones.
+ * Only used from the file thread.
+ */
+class TrigramIndex {
+ public:
+  // A file of the indexed tree.
+  struct File {
+    std::string path;
+    git_oid id;
+    uint32_t blob;
+  };
+
+  TrigramIndex();
+
+  /**
+   * Brings the index to the tree |treeId|. The saved index is read the
+   * first time, and the index is saved again whenever it changed.
+   */
+  int update(git_repository* repo, const git_oid& treeId, WorkerPool* pool);
+
+  /**
+   * Files of the indexed tree that may contain |literal|, ignoring case:
+   * those with all of its trigrams, plus the text files too large to index.
+   * A literal shorter than a trigram rules nothing out.
+   */
+  void candidates(const std::string& literal,
+      std::vector<const File*>* out) const;
+
+  size_t blobCount() const { return _blobs.size(); }
+  size_t trigramCount() const { return _postings.size(); }
+  // Blobs read by the last update.
+  size_t lastIndexed() const { return _lastIndexed; }
+
+ private:
+  enum BlobKind {
+    kIndexed,
+    // Text too large to index; always a candidate.
+    kUnindexed,
+    // Never a candidate, as grep skips binary files too.
+    kBinary
+  };
+
+  struct Blob {
+    git_oid id;
+    uint8_t kind;
+  };
+
+  struct PendingBlob {
+    git_oid id;
+    uint8_t kind;
+    std::vector<uint32_t> trigrams;
+  };
+
+  typedef std::map<uint32_t, std::vector<uint32_t> > PostingMap;
+
+  static int collectEntry(const char* root, const git_tree_entry* entry,
+      void* payload);
+
+  // Reads pending blob |index| and extracts its trigrams.
+  static void indexBlob(size_t index, void* payload);
+
+  // Drops the blobs no files refer to, renumbering the rest.
+  void compact();
+
+  void reset();
+
+  bool load(const std::string& path);
+
+  int save(const std::string& path) const;
+
+  // Where the index in memory was loaded from.
+  std::string _path;
+  bool _hasTree;
+  git_oid _tree;
+  std::vector<Blob> _blobs;
+  std::map<git_oid, uint32_t, OidLess> _blobIds;
+  PostingMap _postings;
+  std::vector<File> _files;
+  size_t _lastIndexed;
+
+  // Only valid during update.
+  git_repository* _repo;
+  std::vector<PendingBlob> _pending;
+};
+
+#endif  // GIT_SALT_TRIGRAM_INDEX_H__
@@ -0,0 +1,131 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(size_t numThreads)
+    : _numThreads(numThreads), _stopping(false) {
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_workCond, NULL);
+  pthread_cond_init(&_doneCond, NULL);
+}
+
+WorkerPool::~WorkerPool() {
+  pthread_mutex_lock(&_mutex);
+  _stopping = true;
+  pthread_cond_broadcast(&_workCond);
+  pthread_mutex_unlock(&_mutex);
+
+  for (size_t i = 0; i < _threads.size(); ++i) {
+    pthread_join(_threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&_doneCond);
+  pthread_cond_destroy(&_workCond);
+  pthread_mutex_destroy(&_mutex);
+}
+
+void WorkerPool::start() {
+  for (size_t i = 0; i < _numThreads; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &WorkerPool::threadMain, this) == 0) {
+      _threads.push_back(thread);
+    }
+  }
+  _numThreads = _threads.size();
+}
+
+void WorkerPool::parallelFor(size_t count, WorkFn fn, void* payload) {
+  if (count == 0) {
+    return;
+  }
+
+  Batch batch;
+  batch.fn = fn;
+  batch.payload = payload;
+  batch.count = count;
+  batch.next = 0;
+  batch.done = 0;
+  batch.detached = false;
+
+  pthread_mutex_lock(&_mutex);
+  _batches.push_back(&batch);
+  pthread_cond_broadcast(&_workCond);
+
+  // Help out until our own batch has no unclaimed indices left.
+  while (batch.next < batch.count) {
+    size_t index;
+    Batch* current = claim(&index);
+    pthread_mutex_unlock(&_mutex);
+    current->fn(index, current->payload);
+    pthread_mutex_lock(&_mutex);
+    finish(current);
+  }
+
+  while (batch.done < batch.count) {
+    pthread_cond_wait(&_doneCond, &_mutex);
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+void WorkerPool::post(WorkFn fn, void* payload) {
+  if (_threads.empty()) {
+    fn(0, payload);
+    return;
+  }
+
+  Batch* batch = new Batch();
+  batch->fn = fn;
+  batch->payload = payload;
+  batch->count = 1;
+  batch->next = 0;
+  batch->done = 0;
+  batch->detached = true;
+
+  pthread_mutex_lock(&_mutex);
+  _batches.push_back(batch);
+  pthread_cond_signal(&_workCond);
+  pthread_mutex_unlock(&_mutex);
+}
+
+void* WorkerPool::threadMain(void* arg) {
+  WorkerPool* pool = static_cast<WorkerPool*>(arg);
+
+  pthread_mutex_lock(&pool->_mutex);
+  while (true) {
+    while (pool->_batches.empty() && !pool->_stopping) {
+      pthread_cond_wait(&pool->_workCond, &pool->_mutex);
+    }
+    if (pool->_stopping) {
+      break;
+    }
+    size_t index;
+    Batch* batch = pool->claim(&index);
+    pthread_mutex_unlock(&pool->_mutex);
+    batch->fn(index, batch->payload);
+    pthread_mutex_lock(&pool->_mutex);
+    pool->finish(batch);
+  }
+  pthread_mutex_unlock(&pool->_mutex);
+  return NULL;
+}
+
+WorkerPool::Batch* WorkerPool::claim(size_t* index) {
+  Batch* batch = _batches.front();
+  *index = batch->next++;
+  if (batch->next == batch->count) {
+    _batches.pop_front();
+  }
+  return batch;
+}
+
+void WorkerPool::finish(Batch* batch) {
+  if (++batch->done == batch->count) {
+    if (batch->detached) {
+      delete batch;
+    } else {
+      pthread_cond_broadcast(&_doneCond);
+    }
+  }
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2014, Google Inc. Please see the AUTHORS file for details.
+// All rights reserved. Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GIT_SALT_WORKER_POOL_H__
+#define GIT_SALT_WORKER_POOL_H__
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include <deque>
+#include <vector>
+
+/**
+ * A fixed set of threads used to spread CPU bound work (hashing, scoring,
+ * inflating) of a single git command over all cores. Commands still run one
+ * at a time on the file thread; they fan out to the pool and wait for it.
+ */
+class WorkerPool {
+ public:
+  typedef void (*WorkFn)(size_t index, void* payload);
+
+  explicit WorkerPool(size_t numThreads);
+  ~WorkerPool();
+
+  void start();
+
+  /**
+   * Calls fn(i, payload) for every i in [0, count). The calling thread takes
+   * part in the work, and the call returns once every index has completed.
+   */
+  void parallelFor(size_t count, WorkFn fn, void* payload);
+
+  /**
+   * Queues fn(0, payload) to run on a pool thread and returns immediately.
+   * The payload must stay valid until fn has run; fn usually frees it.
+   */
+  void post(WorkFn fn, void* payload);
+
+  size_t size() const { return _numThreads + 1; }
+
+ private:
+  struct Batch {
+    WorkFn fn;
+    void* payload;
+    size_t count;
+    size_t next;
+    size_t done;
+    // Posted batches are freed by the thread that completes them.
+    bool detached;
+  };
+
+  static void* threadMain(void* pool);
+
+  // Claims the next index of the front batch. Called with _mutex held.
+  Batch* claim(size_t* index);
+  void finish(Batch* batch);
+
+  size_t _numThreads;
+  bool _stopping;
+  pthread_mutex_t _mutex;
+  pthread_cond_t _workCond;
+  pthread_cond_t _doneCond;
+  std::deque<Batch*> _batches;
+  std::vector<pthread_t> _threads;
+};
+
+#endif  // GIT_SALT_WORKER_POOL_H__
@@ -8,7 +8,9 @@ library spark.gitsalt;
 import 'package:chrome/chrome_app.dart' as chrome;
 
 import 'dart:async';
+import 'dart:convert';
 import 'dart:js' as js;
+import 'dart:typed_data';
 
 import 'constants.dart';
 
@@ -77,15 +79,26 @@ class GitSalt {
 
   bool get isActive => _completer != null;
 
-  Future clone(entry, String url) {
+  /**
+   * Clones [url] into [entry]. With [resume] the clone is fetched one branch
+   * at a time and can be continued by calling clone again after it was
+   * interrupted; [onProgress] then receives the "fetch" and "checkout"
+   * progress. With [sparse] only those directories, and the files in their
+   * parents, are checked out (see [sparseCheckout]); this implies [resume].
+   */
+  Future clone(entry, String url, {bool resume: false, List<String> sparse,
+      void onProgress(String phase, int completed, int total)}) {
 
     root = entry;
 
     var arg = new js.JsObject.jsify({
       "entry": entry.toJs(),
       "filesystem": entry.filesystem.toJs(),
+      "filesystemName": entry.filesystem.name,
       "fullPath": entry.fullPath,
-      "url": url
+      "url": url,
+      "resume": resume,
+      "sparse": sparse != null ? sparse : []
     });
 
     var message = new js.JsObject.jsify({
@@ -94,7 +107,18 @@ class GitSalt {
       "arg": arg
     });
 
-    _jsGitSalt.callMethod('postMessage', [message, cloneCb]);
+    Function cb = (result) {
+      if (result["done"] == false) {
+        if (onProgress != null) {
+          String phase = result["phase"] != null ? result["phase"] : "checkout";
+          onProgress(phase, result["completed"], result["total"]);
+        }
+        return;
+      }
+      cloneCb(result);
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
     _completer = new Completer();
     return _completer.future;
   }
@@ -106,6 +130,7 @@ class GitSalt {
     var arg = new js.JsObject.jsify({
       "entry": entry.toJs(),
       "filesystem": entry.filesystem.toJs(),
+      "filesystemName": entry.filesystem.name,
       "fullPath": entry.fullPath,
       "url": ""
     });
@@ -147,18 +172,36 @@ class GitSalt {
     return completer.future;
   }
 
-  Future<String> getCurrentBranch() {
-
+  /**
+   * Commits the given file contents, keyed by repository relative path,
+   * without writing them to the filesystem first. When [writeWorkdir] is set
+   * the working copy is updated too, before the result comes back. The
+   * result has "success", the new "commit" id, the "message" of a failure
+   * and, with [writeWorkdir], the paths in "writeFailures" whose working copy
+   * could not be written. Paths must stay inside the working tree.
+   */
+  Future<Map> commitBuffers(Map<String, ByteBuffer> files, String userName,
+      String userEmail, String commitMessage, {bool writeWorkdir: false}) {
     var message = new js.JsObject.jsify({
       "subject" : genMessageId(),
-      "name" : "currentBranch",
-      "arg": {}
+      "name" : "commit",
+      "arg": new js.JsObject.jsify({
+        "files" : files,
+        "userName" : userName,
+        "userEmail" : userEmail,
+        "commitMessage" : commitMessage,
+        "writeWorkdir" : writeWorkdir
+      })
     });
 
     Completer completer = new Completer();
 
     Function cb = (result) {
-      completer.complete(result["branch"]);
+      Map map = toDartMap(result);
+      if (map["writeFailures"] != null) {
+        map["writeFailures"] = map["writeFailures"].toList();
+      }
+      completer.complete(map);
     };
 
     _jsGitSalt.callMethod('postMessage', [message, cb]);
@@ -166,6 +209,58 @@ class GitSalt {
     return completer.future;
   }
 
+  Future<String> getCurrentBranch() {
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      completer.complete(result["branch"]);
+    };
+
+    _postFrame("currentBranch", {}, cb);
+
+    return completer.future;
+  }
+
+  /**
+   * Streams ref changes instead of polling [getCurrentBranch]. An event is
+   * emitted only when HEAD, a branch, a tag or packed-refs changed; it
+   * carries the current "head", either "refs/heads/<name>" or a commit id for
+   * a detached HEAD. Remote-tracking and prefetched refs are not watched.
+   * The refs are checked every [interval] milliseconds. Cancelling the
+   * subscription stops the watcher.
+   */
+  Stream<Map> subscribe({int interval: 1000}) {
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "subscribe",
+      "arg": new js.JsObject.jsify({
+        "interval" : interval
+      })
+    });
+
+    StreamController<Map> controller;
+    controller = new StreamController(onCancel: () {
+      var stop = new js.JsObject.jsify({
+        "subject" : genMessageId(),
+        "name" : "unsubscribe",
+        "arg": new js.JsObject.jsify({})
+      });
+      _jsGitSalt.callMethod('postMessage', [stop, (result) {}]);
+    });
+
+    Function cb = (result) {
+      if (result["done"]) {
+        controller.close();
+      } else {
+        controller.add(toDartMap(result));
+      }
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return controller.stream;
+  }
+
   Future<List<String>> getLocalBranches() {
     return getBranches(GitSaltConstants.GIT_SALT_LOCAL_BRANCHES);
   }
@@ -200,7 +295,51 @@ class GitSalt {
     return completer.future;
   }
 
-  Future add(List<chrome.Entry> entries) {
+  /**
+   * Lists branches with their tip "id", "summary", commit "time" in seconds,
+   * "upstream" and "ahead"/"behind" counts against it. The upstream is empty
+   * for branches without one.
+   */
+  Future<List<Map>> branchOverview(
+      {int flags: GitSaltConstants.GIT_SALT_LOCAL_BRANCHES}) {
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "branchOverview",
+      "arg": new js.JsObject.jsify({
+        "flags" : flags
+      })
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      List<Map> branches = [];
+      js.JsArray names = result["names"];
+      for (int i = 0; i < names.length; i++) {
+        branches.add({
+          "name" : names[i],
+          "id" : result["ids"][i],
+          "summary" : result["summaries"][i],
+          "time" : result["times"][i],
+          "upstream" : result["upstreams"][i],
+          "ahead" : result["ahead"][i],
+          "behind" : result["behind"][i]
+        });
+      }
+      completer.complete(branches);
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Stages [entries]. Completes with "filesWritten" and "elapsed"; when large
+   * files were streamed into the object database, also with their
+   * "bytesStreamed" and the "streamMs" it took.
+   */
+  Future<Map> add(List<chrome.Entry> entries) {
 
     entries = entries.map((entry) {
       if (entry.fullPath.length > root.fullPath.length) {
@@ -223,7 +362,7 @@ class GitSalt {
     Completer completer = new Completer();
 
     Function cb = (result) {
-      completer.complete();
+      completer.complete(toDartMap(result));
     };
 
     _jsGitSalt.callMethod('postMessage', [message, cb]);
@@ -251,6 +390,358 @@ class GitSalt {
     return completer.future;
   }
 
+  /**
+   * Returns the status of the working tree with renames and copies detected.
+   * Files are paired only when they are at least [renameThreshold] percent
+   * similar, and inexact matching is skipped when more than [renameLimit]
+   * files are involved on either side.
+   */
+  Future<GitSaltStatus> statusWithRenames({int renameLimit: 200,
+      int renameThreshold: 50, bool findCopies: false}) {
+
+    var arg = new js.JsObject.jsify({
+      "renames" : true,
+      "renameLimit" : renameLimit,
+      "renameThreshold" : renameThreshold,
+      "findCopies" : findCopies
+    });
+
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "status",
+      "arg": arg
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      completer.complete(new GitSaltStatus(toDartMap(result["statuses"]),
+          toDartMap(result["renames"]), toDartMap(result["copies"])));
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Diffs the tree of revision [from] against revision [to], or against the
+   * working directory when [to] is omitted. Each delta is a map with
+   * "status", "oldPath", "newPath" and, for renames and copies, "similarity".
+   */
+  Future<List<Map>> diff({String from: "HEAD", String to, bool renames: false,
+      int renameLimit: 200, int renameThreshold: 50, bool findCopies: false}) {
+
+    Map options = {
+      "from" : from,
+      "renames" : renames,
+      "renameLimit" : renameLimit,
+      "renameThreshold" : renameThreshold,
+      "findCopies" : findCopies
+    };
+    if (to != null) {
+      options["to"] = to;
+    }
+
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "diff",
+      "arg": new js.JsObject.jsify(options)
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      completer.complete(result["deltas"].toList().map(toDartMap).toList());
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Blames lines [minLine] to [maxLine] of [path] at [commit]. Hunks of a
+   * narrowed range are delivered in batches as soon as they are attributed,
+   * so a viewport can be painted before the whole range is done. Each hunk
+   * is a map with "start", "lines", "commit", "name", "email", "time",
+   * "origPath", "origStart" and "boundary". A failure is added to the stream
+   * as an error before it closes.
+   */
+  Stream<List<Map>> blame(String path, {String commit: "HEAD", int minLine: 1,
+      int maxLine: 0}) {
+    var arg = new js.JsObject.jsify({
+      "path" : path,
+      "commit" : commit,
+      "minLine" : minLine,
+      "maxLine" : maxLine
+    });
+
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "blame",
+      "arg": arg
+    });
+
+    StreamController<List<Map>> controller = new StreamController();
+
+    Function cb = (result) {
+      List hunks = result["hunks"].toList();
+      if (hunks.isNotEmpty) {
+        controller.add(hunks.map(toDartMap).toList());
+      }
+      if (result["done"]) {
+        if (result["message"] != null) {
+          controller.addError(result["message"]);
+        }
+        controller.close();
+      }
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return controller.stream;
+  }
+
+  /**
+   * Lists one level of a tree: the tree at [path] in revision [rev], or the
+   * tree with id [tree]. At most [limit] entries starting at [offset] are
+   * returned. The result has the tree "id", the "total" number of entries and
+   * the "entries", each with "name", "mode", "type", "id" and, for blobs,
+   * "size". Completes with an error message when the tree cannot be found.
+   */
+  Future<Map> lsTree({String rev: "HEAD", String path: "", String tree,
+      int offset: 0, int limit: 500}) {
+    Map options = {
+      "rev" : rev,
+      "path" : path,
+      "offset" : offset,
+      "limit" : limit
+    };
+    if (tree != null) {
+      options["tree"] = tree;
+    }
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      if (result["success"] == false) {
+        completer.completeError(result["message"]);
+        return;
+      }
+      completer.complete({
+        "tree" : result["tree"],
+        "total" : result["total"],
+        "entries" : result["entries"].toList().map(toDartMap).toList()
+      });
+    };
+
+    _postFrame("lsTree", options, cb);
+
+    return completer.future;
+  }
+
+  /**
+   * Reads the blob with id [id], or the file at [path] in revision [rev].
+   * Only [length] bytes starting at [offset] are returned when given. The
+   * result has the blob "id", its total "size", the "offset" and the bytes
+   * as an ArrayBuffer in "data". Completes with an error message when the
+   * blob cannot be found.
+   */
+  Future<Map> readBlob({String id, String rev: "HEAD", String path,
+      int offset: 0, int length: -1}) {
+    Map options = {
+      "rev" : rev,
+      "offset" : offset,
+      "length" : length
+    };
+    if (id != null) {
+      options["id"] = id;
+    }
+    if (path != null) {
+      options["path"] = path;
+    }
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      if (result["success"] == false) {
+        completer.completeError(result["message"]);
+        return;
+      }
+      completer.complete(toDartMap(result));
+    };
+
+    _postFrame("readBlob", options, cb);
+
+    return completer.future;
+  }
+
+  /**
+   * Resolves each of [revs], e.g. "HEAD", "v1.0", "master~3" or
+   * "HEAD:path/to/file", to a map with the object "id", "type" and "size".
+   * Revisions that do not resolve have an empty id and type.
+   */
+  Future<List<Map>> resolve(List<String> revs) {
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      List<Map> objects = [];
+      for (int i = 0; i < revs.length; i++) {
+        objects.add({
+          "id" : result["ids"][i],
+          "type" : result["types"][i],
+          "size" : result["sizes"][i]
+        });
+      }
+      completer.complete(objects);
+    };
+
+    _postFrame("resolve", {"revs" : revs}, cb);
+
+    return completer.future;
+  }
+
+  /**
+   * Switches the working tree to local [branch], or to revision [rev] with a
+   * detached HEAD. Only files that differ between the two trees are touched.
+   * Unless [force] is set, nothing is changed when one of those files has
+   * local modifications; they are listed under "conflicts" instead.
+   * [onProgress] is called with the number of completed and total updates.
+   * The result has "success" and, when that is false, the error "message".
+   * A checkout that fails part way keeps HEAD, with the files it already
+   * changed staged.
+   */
+  Future<Map> checkout({String branch, String rev, bool force: false,
+      void onProgress(int completed, int total)}) {
+    Map options = {
+      "force" : force
+    };
+    if (branch != null) {
+      options["branch"] = branch;
+    }
+    if (rev != null) {
+      options["rev"] = rev;
+    }
+
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "checkout",
+      "arg": new js.JsObject.jsify(options)
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      if (!result["done"]) {
+        if (onProgress != null) {
+          onProgress(result["completed"], result["total"]);
+        }
+        return;
+      }
+      Map summary = toDartMap(result);
+      summary["conflicts"] = result["conflicts"].toList();
+      completer.complete(summary);
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Merges [rev] into HEAD. The result's "analysis" is one of "upToDate",
+   * "fastForward", "normal" or "unborn". With [preview] the merge is only
+   * computed in memory and "mergeConflicts" lists the conflicting paths with
+   * their ancestor, ours and theirs blob ids; nothing is written. Otherwise
+   * a conflict free merge is checked out and committed, and the new HEAD is
+   * returned as "commit". "success" is false, with the reason in "message",
+   * when the merge failed, had conflicts or, with [fastForwardOnly], could
+   * not be fast-forwarded.
+   */
+  Future<Map> merge(String rev, {bool preview: false,
+      bool fastForwardOnly: false, bool force: false, String userName,
+      String userEmail, String commitMessage,
+      void onProgress(int completed, int total)}) {
+    Map options = {
+      "rev" : rev,
+      "preview" : preview,
+      "fastForwardOnly" : fastForwardOnly,
+      "force" : force
+    };
+    if (userName != null) {
+      options["userName"] = userName;
+    }
+    if (userEmail != null) {
+      options["userEmail"] = userEmail;
+    }
+    if (commitMessage != null) {
+      options["commitMessage"] = commitMessage;
+    }
+
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "merge",
+      "arg": new js.JsObject.jsify(options)
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      if (!result["done"]) {
+        if (onProgress != null) {
+          onProgress(result["completed"], result["total"]);
+        }
+        return;
+      }
+      Map summary = toDartMap(result);
+      summary["conflicts"] = result["conflicts"].toList();
+      summary["mergeConflicts"] =
+          result["mergeConflicts"].toList().map(toDartMap).toList();
+      completer.complete(summary);
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Restricts the working tree to [directories], plus the files directly in
+   * the root and in their parents, and updates it accordingly. Excluded files
+   * stay in the index and are left out of status. An empty list checks out
+   * everything again. The result is the same as for [checkout].
+   */
+  Future<Map> sparseCheckout(List<String> directories, {bool force: false,
+      void onProgress(int completed, int total)}) {
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "sparseCheckout",
+      "arg": new js.JsObject.jsify({
+        "directories" : directories,
+        "force" : force
+      })
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      if (!result["done"]) {
+        if (onProgress != null) {
+          onProgress(result["completed"], result["total"]);
+        }
+        return;
+      }
+      Map summary = toDartMap(result);
+      summary["conflicts"] = result["conflicts"].toList();
+      completer.complete(summary);
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
   Future<List<String>> lsRemoteRefs(String url) {
     var arg = new js.JsObject.jsify({
       "url" : url
@@ -273,6 +764,292 @@ class GitSalt {
     return completer.future;
   }
 
+  /**
+   * Returns instrumentation counters: "hits" and "misses" for the "refs",
+   * "revisions" and "similarity" caches, and under "scheduler" the queue
+   * "depth", "peakDepth", "completed", "waitMs", "maxWaitMs" and "yields" of
+   * the "interactive", "normal" and "background" classes. "prefetch" holds
+   * the "interval", "runs", "failures", "backoff" level, "objects" and
+   * "bytes" of background prefetching. "indexing" holds pack indexing
+   * totals ("packs", "fallbacks", "objects", "deltas", "cacheHits",
+   * "cacheMisses") and the "threads", "receiveMs", "parseMs", "resolveMs"
+   * and "writeMs" of the last pack. "search" has the "blobs" and "trigrams"
+   * of the search index, and "mounts" the number of working tree mounts
+   * "mounted", how many of them are "idle" and how often one was "reused".
+   * "startup" maps each startup phase ("init", "naclIo", "libgit2",
+   * "workers" and the lazily mounted file systems) to its duration "ms" and
+   * the time it ended "at", in milliseconds since the module was created.
+   */
+  Future<Map> stats() {
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "stats",
+      "arg": new js.JsObject.jsify({})
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      Map stats = toDartMap(result);
+      stats.keys.toList().forEach((key) {
+        stats[key] = toDartMap(stats[key]);
+      });
+      ["scheduler", "startup"].forEach((name) {
+        Map nested = stats[name];
+        nested.keys.toList().forEach((key) {
+          nested[key] = toDartMap(nested[key]);
+        });
+      });
+      completer.complete(stats);
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Packs loose objects and refs. Once packs have piled up, everything
+   * reachable is repacked into one and the old packs are removed. With
+   * [idle] the work waits until no other command has come in for a few
+   * seconds. Completes with the file counts and sizes from before and
+   * after, as "filesBefore", "filesAfter", "bytesBefore" and "bytesAfter",
+   * along with "objectsPacked" and "packsRemoved".
+   */
+  Future<Map> maintenance({bool idle: false}) {
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "maintenance",
+      "arg": new js.JsObject.jsify({
+        "idle" : idle
+      })
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      completer.complete(toDartMap(result));
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Fetches all remotes into refs/prefetch/<remote>/<branch> every
+   * [interval] milliseconds while the user is idle, or stops for 0.
+   * Completes with the interval in effect; it is never below a minute.
+   */
+  Future<int> prefetch(int interval) {
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "prefetch",
+      "arg": new js.JsObject.jsify({
+        "interval" : interval
+      })
+    });
+
+    Completer completer = new Completer();
+
+    Function cb = (result) {
+      completer.complete(result["interval"]);
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return completer.future;
+  }
+
+  /**
+   * Searches for lines matching [pattern], a literal unless [regex] is set.
+   * The files of [rev] are searched when given, else the index with [cached]
+   * or the working tree. Matches are delivered in batches as files are
+   * searched; each is a map with "path", "line" and "text". [onDone] gets the
+   * "count" of matches, whether they were "truncated" at [maxResults],
+   * "filesSearched" and "elapsed".
+   */
+  Stream<List<Map>> grep(String pattern, {bool regex: false,
+      bool ignoreCase: false, String rev, bool cached: false,
+      int maxResults: 1000, void onDone(Map summary)}) {
+    Map options = {
+      "pattern" : pattern,
+      "regex" : regex,
+      "ignoreCase" : ignoreCase,
+      "cached" : cached,
+      "maxResults" : maxResults
+    };
+    if (rev != null) {
+      options["rev"] = rev;
+    }
+
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "grep",
+      "arg": new js.JsObject.jsify(options)
+    });
+
+    StreamController<List<Map>> controller = new StreamController();
+
+    Function cb = (result) {
+      List matches = result["matches"].toList();
+      if (matches.isNotEmpty) {
+        controller.add(matches.map(toDartMap).toList());
+      }
+      if (result["done"]) {
+        if (result["message"] != null) {
+          controller.addError(result["message"]);
+        } else if (onDone != null) {
+          Map summary = toDartMap(result);
+          summary.remove("matches");
+          onDone(summary);
+        }
+        controller.close();
+      }
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return controller.stream;
+  }
+
+  /**
+   * Like [grep] over [rev], but only the files that the trigram index says
+   * may contain [pattern] are read. The index is brought up to date first,
+   * which reads only blobs it has not seen. The summary also has
+   * "blobsIndexed", "candidates" and "indexMs".
+   */
+  Stream<List<Map>> search(String pattern, {String rev: "HEAD",
+      bool regex: false, bool ignoreCase: false, int maxResults: 1000,
+      void onDone(Map summary)}) {
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "search",
+      "arg": new js.JsObject.jsify({
+        "pattern" : pattern,
+        "rev" : rev,
+        "regex" : regex,
+        "ignoreCase" : ignoreCase,
+        "maxResults" : maxResults
+      })
+    });
+
+    StreamController<List<Map>> controller = new StreamController();
+
+    Function cb = (result) {
+      List matches = result["matches"].toList();
+      if (matches.isNotEmpty) {
+        controller.add(matches.map(toDartMap).toList());
+      }
+      if (result["done"]) {
+        if (result["message"] != null) {
+          controller.addError(result["message"]);
+        } else if (onDone != null) {
+          Map summary = toDartMap(result);
+          summary.remove("matches");
+          onDone(summary);
+        }
+        controller.close();
+      }
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return controller.stream;
+  }
+
+  /**
+   * Exports the tree of [rev] as a "zip" or "tar" [format], with [prefix]
+   * in front of every path. With [path] the archive is written to that
+   * file; otherwise it is streamed back in chunks. [onDone] gets the
+   * "filesWritten", the "bytes" of file contents, the archive "size" and
+   * "elapsed".
+   */
+  Stream<ByteBuffer> archive({String rev: "HEAD", String format: "zip",
+      String prefix: "", String path, void onDone(Map summary)}) {
+    Map options = {
+      "rev" : rev,
+      "format" : format,
+      "prefix" : prefix
+    };
+    if (path != null) {
+      options["path"] = path;
+    }
+
+    var message = new js.JsObject.jsify({
+      "subject" : genMessageId(),
+      "name" : "archive",
+      "arg": new js.JsObject.jsify(options)
+    });
+
+    StreamController<ByteBuffer> controller = new StreamController();
+
+    Function cb = (result) {
+      if (!result["done"]) {
+        controller.add(result["data"]);
+        return;
+      }
+      if (result["message"] != null) {
+        controller.addError(result["message"]);
+      } else if (onDone != null) {
+        onDone(toDartMap(result));
+      }
+      controller.close();
+    };
+
+    _jsGitSalt.callMethod('postMessage', [message, cb]);
+
+    return controller.stream;
+  }
+
+  /**
+   * Posts [name] as a single ArrayBuffer frame instead of a dictionary, which
+   * is cheaper for small, frequent queries. [args] may only hold bools, ints,
+   * strings and lists of strings.
+   */
+  void _postFrame(String name, Map args, Function cb) {
+    String subject = genMessageId();
+    List<int> frame = [GitSaltConstants.GIT_SALT_FRAME_VERSION];
+    _writeFrameString(frame, name);
+    _writeFrameString(frame, subject);
+    _writeVarint(frame, args.length);
+    args.forEach((String key, value) {
+      _writeFrameString(frame, key);
+      if (value is bool) {
+        frame.add(value ? GitSaltConstants.GIT_SALT_FRAME_TRUE
+            : GitSaltConstants.GIT_SALT_FRAME_FALSE);
+      } else if (value is int) {
+        frame.add(GitSaltConstants.GIT_SALT_FRAME_INT);
+        _writeVarint(frame, value >= 0 ? value * 2 : -value * 2 - 1);
+      } else if (value is String) {
+        frame.add(GitSaltConstants.GIT_SALT_FRAME_STRING);
+        _writeFrameString(frame, value);
+      } else {
+        frame.add(GitSaltConstants.GIT_SALT_FRAME_STRINGS);
+        _writeVarint(frame, value.length);
+        value.forEach((String string) => _writeFrameString(frame, string));
+      }
+    });
+
+    _jsGitSalt.callMethod('postFrame',
+        [subject, new Uint8List.fromList(frame).buffer, cb]);
+  }
+
+  static void _writeVarint(List<int> frame, int value) {
+    // Arithmetic rather than bit operations, which are 32 bit in JavaScript.
+    while (value >= 128) {
+      frame.add(value % 128 + 128);
+      value ~/= 128;
+    }
+    frame.add(value);
+  }
+
+  static void _writeFrameString(List<int> frame, String string) {
+    List<int> bytes = UTF8.encode(string);
+    _writeVarint(frame, bytes.length);
+    frame.addAll(bytes);
+  }
+
   Map toDartMap(js.JsObject jsMap) {
     Map map = {};
     List<String> keys = js.context['Object'].callMethod('keys', [jsMap]);
@@ -282,3 +1059,15 @@ class GitSalt {
     return map;
   }
 }
+
+/**
+ * Working tree status along with the renames and copies found in it. Both
+ * [renames] and [copies] map a new path to the path it came from.
+ */
+class GitSaltStatus {
+  final Map statuses;
+  final Map renames;
+  final Map copies;
+
+  GitSaltStatus(this.statuses, this.renames, this.copies);
+}
@@ -178,7 +178,11 @@ GitSalt.prototype.handleResponse = function(response) {
    var cb = this.callbacks[response.data.regarding];
    if (cb != null) {
      cb(response.data.arg);
-     this.callbacks[response.data] = null;
+     // Streaming commands answer with several batches and mark all but the
+     // last one with done == false.
+     if (response.data.arg.done !== false) {
+       delete this.callbacks[response.data.regarding];
+     }
    }
 };
 
@@ -202,5 +206,14 @@ GitSalt.prototype.postMessage = function(message, cb) {
   this.naclModule.postMessage(message);
 };
 
+/**
+ * Posts a request encoded as a single ArrayBuffer (see cpp/message_frame.h)
+ * instead of a dictionary. The response comes back like any other.
+ */
+GitSalt.prototype.postFrame = function(subject, frame, cb) {
+  this.callbacks[subject] = cb;
+  this.naclModule.postMessage(frame);
+};
+
 var gitSalt = new GitSalt();
 